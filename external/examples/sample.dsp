@@ -0,0 +1,17 @@
+declare name "sample";
+declare description "simple sample player using the soundfile primitive";
+declare author "Albert Graef";
+declare version "2.0";
+
+import("stdfaust.lib");
+
+// The sound file is looked up relative to the patch and on the Pd search path.
+sound = soundfile("sound [url:{'examples/sine.wav'}]", 1);
+
+gain = hslider("gain", 0.5, 0, 1, 0.01);
+play = button("play");
+
+// restart at each press of the play button
+index = ba.countup(ma.SR*10, play > play');
+
+process = 0, index : sound : !, !, *(gain);
@@ -19,9 +19,11 @@ typedef struct _faust_io_manager
     
     size_t      f_ninlets;
     t_inlet**   f_inlets;
+    size_t      f_ncontrols; // control inlets, following the dsp inputs
     
     size_t      f_noutlets;
     t_outlet**  f_outlets;
+    size_t      f_ncontrol_outs; // control outlets, following the dsp outputs
     t_outlet*   f_extra_outlet;
     
     char        f_valid;
@@ -89,7 +91,7 @@ static char faust_io_manager_resize_inputs(t_faust_io_manager *x, size_t const n
 {
     t_inlet** ninlets;
     size_t i;
-    size_t const cins = faust_io_manager_get_ninputs(x);
+    size_t const cins = x->f_ninlets;
     size_t const rnins = nins;
     if(rnins == cins)
     {
@@ -123,7 +125,7 @@ static char faust_io_manager_resize_outputs(t_faust_io_manager *x, size_t const
 {
     t_outlet** noutlets;
     size_t i;
-    size_t const couts = faust_io_manager_get_noutputs(x);
+    size_t const couts = x->f_noutlets;
     size_t const rnouts = nouts;
     
     if(rnouts == couts)
@@ -169,8 +171,10 @@ t_faust_io_manager* faust_io_manager_new(t_object* owner, t_canvas* canvas)
         x->f_signals        = NULL;
         x->f_ninlets        = 0;
         x->f_inlets         = NULL;
+        x->f_ncontrols      = 0;
         x->f_noutlets       = 0;
         x->f_outlets        = NULL;
+        x->f_ncontrol_outs  = 0;
         x->f_extra_outlet   = outlet_new((t_object *)x->f_owner, NULL);
         x->f_valid          = 0;
         if(!x->f_extra_outlet)
@@ -194,12 +198,22 @@ void faust_io_manager_free(t_faust_io_manager* x)
 
 size_t faust_io_manager_get_ninputs(t_faust_io_manager const *x)
 {
-    return x->f_ninlets;
+    return x->f_ninlets - x->f_ncontrols;
+}
+
+size_t faust_io_manager_get_ncontrols(t_faust_io_manager const *x)
+{
+    return x->f_ncontrols;
+}
+
+size_t faust_io_manager_get_ncontrol_outputs(t_faust_io_manager const *x)
+{
+    return x->f_ncontrol_outs;
 }
 
 size_t faust_io_manager_get_noutputs(t_faust_io_manager const *x)
 {
-    return x->f_noutlets;
+    return x->f_noutlets - x->f_ncontrol_outs;
 }
 
 t_outlet* faust_io_manager_get_extra_output(t_faust_io_manager *x)
@@ -207,7 +221,7 @@ t_outlet* faust_io_manager_get_extra_output(t_faust_io_manager *x)
     return x->f_extra_outlet;
 }
 
-char faust_io_manager_init(t_faust_io_manager *x, int const nins, int const nouts)
+char faust_io_manager_init(t_faust_io_manager *x, int const nins, int const nouts, int const nctls, int const nctlouts)
 {
     char valid = 0;
     char const redraw = x->f_owner->te_binbuf && gobj_shouldvis((t_gobj *)x->f_owner, x->f_canvas) && glist_isvisible(x->f_canvas);
@@ -215,9 +229,11 @@ char faust_io_manager_init(t_faust_io_manager *x, int const nins, int const nout
     {
         gobj_vis((t_gobj *)x->f_owner, x->f_canvas, 0);
     }
-    valid += faust_io_manager_resize_inputs(x, (size_t)nins);
-    valid += faust_io_manager_resize_outputs(x, (size_t)nouts);
-    valid += faust_io_manager_resize_signals(x, (size_t)nins + (size_t)nouts);
+    valid += faust_io_manager_resize_inputs(x, (size_t)nins + (size_t)nctls);
+    x->f_ncontrols = valid ? 0 : (size_t)nctls;
+    valid += faust_io_manager_resize_outputs(x, (size_t)nouts + (size_t)nctlouts);
+    x->f_ncontrol_outs = x->f_noutlets < (size_t)nctlouts ? 0 : (size_t)nctlouts;
+    valid += faust_io_manager_resize_signals(x, (size_t)nins + (size_t)nctls + (size_t)nouts + (size_t)nctlouts);
     if(redraw)
     {
         gobj_vis((t_gobj *)x->f_owner, x->f_canvas, 1);
@@ -283,12 +299,29 @@ t_sample** faust_io_manager_get_input_signals(t_faust_io_manager *x)
     return x->f_signals;
 }
 
+t_sample** faust_io_manager_get_control_signals(t_faust_io_manager *x)
+{
+    return x->f_signals+x->f_ninlets-x->f_ncontrols;
+}
+
 t_sample** faust_io_manager_get_output_signals(t_faust_io_manager *x)
 {
     return x->f_signals+x->f_ninlets;
 }
 
+t_sample** faust_io_manager_get_control_output_signals(t_faust_io_manager *x)
+{
+    return x->f_signals+x->f_ninlets+x->f_noutlets-x->f_ncontrol_outs;
+}
+
 void faust_io_manager_print(t_faust_io_manager const* x, char const log)
 {
-    logpost(x->f_owner, 2+log, "%i inputs, %i outputs", (int)faust_io_manager_get_ninputs(x), (int)faust_io_manager_get_noutputs(x));
+    if(x->f_ncontrols || x->f_ncontrol_outs)
+    {
+        logpost(x->f_owner, 2+log, "%i inputs, %i outputs, %i control inputs, %i control outputs", (int)faust_io_manager_get_ninputs(x), (int)faust_io_manager_get_noutputs(x), (int)x->f_ncontrols, (int)x->f_ncontrol_outs);
+    }
+    else
+    {
+        logpost(x->f_owner, 2+log, "%i inputs, %i outputs", (int)faust_io_manager_get_ninputs(x), (int)faust_io_manager_get_noutputs(x));
+    }
 }
@@ -20,16 +20,28 @@ size_t faust_io_manager_get_ninputs(t_faust_io_manager const *x);
 
 size_t faust_io_manager_get_noutputs(t_faust_io_manager const *x);
 
+size_t faust_io_manager_get_ncontrols(t_faust_io_manager const *x);
+
+size_t faust_io_manager_get_ncontrol_outputs(t_faust_io_manager const *x);
+
 t_outlet* faust_io_manager_get_extra_output(t_faust_io_manager *x);
 
-char faust_io_manager_init(t_faust_io_manager *x, int const nins, int const nouts);
+// nctls extra signal inlets following the dsp inputs feed controls, see
+// faust_ui_manager_signal_in; likewise, nctlouts extra signal outlets
+// following the dsp outputs carry passive controls, see
+// faust_ui_manager_signal_out
+char faust_io_manager_init(t_faust_io_manager *x, int const nins, int const nouts, int const nctls, int const nctlouts);
 
 char faust_io_manager_prepare(t_faust_io_manager *x, t_signal **sp);
 
 t_sample** faust_io_manager_get_input_signals(t_faust_io_manager *x);
 
+t_sample** faust_io_manager_get_control_signals(t_faust_io_manager *x);
+
 t_sample** faust_io_manager_get_output_signals(t_faust_io_manager *x);
 
+t_sample** faust_io_manager_get_control_output_signals(t_faust_io_manager *x);
+
 void faust_io_manager_print(t_faust_io_manager const* x, char const log);
 
 #endif
@@ -0,0 +1,596 @@
+/*
+// Copyright (c) 2018 - GRAME CNCM - CICM - ANR MUSICOLL - Pierre Guillot.
+// For information on usage and redistribution, and for a DISCLAIMER OF ALL
+// WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+*/
+
+#include "faust_tilde_sound.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+// These must match the definitions in faust/gui/Soundfile.h.
+#define SOUND_MAXPARTS  256     // MAX_SOUNDFILE_PARTS
+#define SOUND_MAXCHAN   64      // MAX_CHAN
+#define SOUND_BUFSIZE   1024    // BUFFER_SIZE, length of an empty part
+#define SOUND_SR        44100   // SAMPLE_RATE, sample rate of an empty part
+
+// Layout of Faust's Soundfile struct, as accessed by the generated code. The
+// sample data of each channel (fBuffers) is a float or double array holding
+// all parts, with part p starting at frame fOffset[p]. Unused parts are
+// empty, i.e., they are SOUND_BUFSIZE frames of silence.
+struct Soundfile
+{
+    void*   fBuffers;
+    int*    fLength;
+    int*    fSR;
+    int*    fOffset;
+    int     fChannels;
+    int     fParts;
+    bool    fIsDouble;
+};
+
+enum { SOUND_LOADING, SOUND_READY, SOUND_FAILED };
+
+typedef struct _faust_sound
+{
+    struct Soundfile f_sf;
+    int         f_length[SOUND_MAXPARTS];
+    int         f_sr[SOUND_MAXPARTS];
+    int         f_offset[SOUND_MAXPARTS];
+    void*       f_chans[SOUND_MAXCHAN];
+    void*       f_data;     // sample data of all channels
+    int         f_isdbl;
+    t_symbol*   f_key;      // cache key: precision and resolved paths
+    t_symbol*   f_name;     // the url
+    size_t      f_nfiles;
+    long*       f_mtimes;   // modification times of the files
+    char        f_error[MAXPDSTRING];
+    // these are shared with the loader thread and guarded by sound_lock
+    int         f_state;
+    int         f_refcount;
+    bool        f_cached;
+    struct _faust_sound* f_next;
+}t_faust_sound;
+
+static t_faust_sound* sound_cache = NULL;
+
+// ag: The lock and the loader thread use the native Windows API on Windows
+// and pthreads everywhere else.
+#ifdef _WIN32
+static CRITICAL_SECTION sound_lock;
+static bool sound_lock_ready = false;
+
+// Only faust_sound_load creates sounds, in the main thread, so doing this
+// there when it's first called is safe.
+static void sound_lock_init(void)
+{
+    if(!sound_lock_ready)
+    {
+        InitializeCriticalSection(&sound_lock);
+        sound_lock_ready = true;
+    }
+}
+
+static void sound_lock_acquire(void)
+{
+    EnterCriticalSection(&sound_lock);
+}
+
+static void sound_lock_release(void)
+{
+    LeaveCriticalSection(&sound_lock);
+}
+#else
+static pthread_mutex_t sound_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void sound_lock_init(void)
+{
+}
+
+static void sound_lock_acquire(void)
+{
+    pthread_mutex_lock(&sound_lock);
+}
+
+static void sound_lock_release(void)
+{
+    pthread_mutex_unlock(&sound_lock);
+}
+#endif
+
+// WAV FILES
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+typedef struct
+{
+    int     format;     // 1 = integer PCM, 3 = floating point
+    int     channels;
+    int     sr;
+    int     bits;
+    long    data;       // file offset of the sample data
+    size_t  frames;
+}t_wav_info;
+
+static uint32_t wav_le(unsigned char const *p, int n)
+{
+    uint32_t v = 0;
+    while(n--) v = (v<<8)|p[n];
+    return v;
+}
+
+static int wav_header(FILE *fp, t_wav_info *info, char const *path, char *error)
+{
+    unsigned char buf[40];
+    bool fmt = false;
+    if(fread(buf, 1, 12, fp) != 12 || memcmp(buf, "RIFF", 4) || memcmp(buf+8, "WAVE", 4))
+    {
+        snprintf(error, MAXPDSTRING, "%s: not a WAV file", path);
+        return -1;
+    }
+    while(fread(buf, 1, 8, fp) == 8)
+    {
+        const uint32_t size = wav_le(buf+4, 4);
+        if(!memcmp(buf, "fmt ", 4))
+        {
+            const size_t n = size < sizeof(buf) ? size : sizeof(buf);
+            if(n < 16 || fread(buf, 1, n, fp) != n)
+            {
+                break;
+            }
+            info->format = wav_le(buf, 2);
+            info->channels = wav_le(buf+2, 2);
+            info->sr = wav_le(buf+4, 4);
+            info->bits = wav_le(buf+14, 2);
+            if(info->format == 0xfffe && n >= 26)
+            {
+                // WAVE_FORMAT_EXTENSIBLE, the format is in the subformat GUID
+                info->format = wav_le(buf+24, 2);
+            }
+            fmt = true;
+            if(fseek(fp, (long)(size - n + (size&1)), SEEK_CUR))
+            {
+                break;
+            }
+        }
+        else if(!memcmp(buf, "data", 4))
+        {
+            if(!fmt)
+            {
+                break;
+            }
+            if(!((info->format == 1 && (info->bits == 8 || info->bits == 16 ||
+                                        info->bits == 24 || info->bits == 32)) ||
+                 (info->format == 3 && (info->bits == 32 || info->bits == 64))) ||
+               info->channels < 1 || info->channels > SOUND_MAXCHAN || info->sr <= 0)
+            {
+                snprintf(error, MAXPDSTRING, "%s: unsupported WAV format", path);
+                return -1;
+            }
+            info->data = ftell(fp);
+            info->frames = size / (info->channels*info->bits/8);
+            return 0;
+        }
+        else if(fseek(fp, (long)size + (size&1), SEEK_CUR))
+        {
+            break;
+        }
+    }
+    snprintf(error, MAXPDSTRING, "%s: bad WAV file", path);
+    return -1;
+}
+
+static double wav_sample(unsigned char const *p, int format, int bits)
+{
+    switch(bits)
+    {
+        case 8:
+            return (p[0]-128)/128.0;
+        case 16:
+            return (int16_t)wav_le(p, 2)/32768.0;
+        case 24:
+            return (int32_t)(wav_le(p, 3)<<8)/2147483648.0;
+        case 32:
+            if(format == 3)
+            {
+                const uint32_t u = wav_le(p, 4);
+                float f;
+                memcpy(&f, &u, sizeof(f));
+                return f;
+            }
+            return (int32_t)wav_le(p, 4)/2147483648.0;
+        default:
+        {
+            const uint64_t u = ((uint64_t)wav_le(p+4, 4)<<32)|wav_le(p, 4);
+            double d;
+            memcpy(&d, &u, sizeof(d));
+            return d;
+        }
+    }
+}
+
+// Decode the sample data of a file into the channel buffers, starting at
+// the given frame. Frames missing at the end of a truncated file are left
+// silent.
+static void wav_read(FILE *fp, t_wav_info const *info, void **chans, int isdbl, size_t offset)
+{
+    const size_t bytes = info->bits/8, framesize = info->channels*bytes;
+    unsigned char buf[8192];
+    size_t k = 0, n;
+    while(k < info->frames &&
+          (n = fread(buf, framesize, sizeof(buf)/framesize, fp)) > 0)
+    {
+        if(n > info->frames - k) n = info->frames - k;
+        for(size_t i = 0; i < n; i++, k++)
+        {
+            unsigned char const *p = buf + i*framesize;
+            for(int c = 0; c < info->channels; c++, p += bytes)
+            {
+                const double v = wav_sample(p, info->format, info->bits);
+                if(isdbl)
+                    ((double*)chans[c])[offset+k] = v;
+                else
+                    ((float*)chans[c])[offset+k] = (float)v;
+            }
+        }
+    }
+}
+
+// LOADING
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+// The file names are in the cache key, one per line after the precision.
+static char const* sound_next_path(char const *s, char *path)
+{
+    char const *e = strchr(s, '\n');
+    size_t n = e ? (size_t)(e-s) : strlen(s);
+    if(n >= MAXPDSTRING) n = MAXPDSTRING-1;
+    memcpy(path, s, n);
+    path[n] = 0;
+    return e ? e+1 : s+strlen(s);
+}
+
+// This runs in the loader thread, so it must not call into Pd, except for
+// getbytes and freebytes which are just wrappers around the C library. The
+// results are only looked at by the main thread once f_state has been set.
+static int faust_sound_decode(t_faust_sound *x)
+{
+    t_wav_info info[SOUND_MAXPARTS];
+    char path[MAXPDSTRING];
+    char const *s = strchr(x->f_key->s_name, '\n')+1;
+    const size_t elemsize = x->f_isdbl ? sizeof(double) : sizeof(float);
+    size_t total = 0, i;
+    int nchans = 0;
+    for(i = 0; i < x->f_nfiles; i++)
+    {
+        FILE *fp;
+        s = sound_next_path(s, path);
+        fp = fopen(path, "rb");
+        if(!fp)
+        {
+            snprintf(x->f_error, MAXPDSTRING, "%s: can't open", path);
+            return 0;
+        }
+        if(wav_header(fp, info+i, path, x->f_error))
+        {
+            fclose(fp);
+            return 0;
+        }
+        fclose(fp);
+        if(info[i].frames > (size_t)INT_MAX - SOUND_BUFSIZE - total)
+        {
+            snprintf(x->f_error, MAXPDSTRING, "%s: file too large", path);
+            return 0;
+        }
+        total += info[i].frames;
+        if(info[i].channels > nchans) nchans = info[i].channels;
+    }
+    // room for the empty parts at the end
+    total += SOUND_BUFSIZE;
+    x->f_data = calloc((size_t)nchans*total, elemsize);
+    if(!x->f_data)
+    {
+        snprintf(x->f_error, MAXPDSTRING, "memory allocation failed");
+        return 0;
+    }
+    for(int c = 0; c < SOUND_MAXCHAN; c++)
+    {
+        // channels beyond those in the files share the existing buffers
+        x->f_chans[c] = c < nchans ? (char*)x->f_data + c*total*elemsize : x->f_chans[c % nchans];
+    }
+    s = strchr(x->f_key->s_name, '\n')+1;
+    total = 0;
+    for(i = 0; i < x->f_nfiles; i++)
+    {
+        FILE *fp;
+        s = sound_next_path(s, path);
+        fp = fopen(path, "rb");
+        if(!fp || fseek(fp, info[i].data, SEEK_SET))
+        {
+            if(fp) fclose(fp);
+            snprintf(x->f_error, MAXPDSTRING, "%s: can't read", path);
+            return 0;
+        }
+        wav_read(fp, info+i, x->f_chans, x->f_isdbl, total);
+        fclose(fp);
+        x->f_length[i] = (int)info[i].frames;
+        x->f_sr[i] = info[i].sr;
+        x->f_offset[i] = (int)total;
+        total += info[i].frames;
+    }
+    for(; i < SOUND_MAXPARTS; i++)
+    {
+        x->f_length[i] = SOUND_BUFSIZE;
+        x->f_sr[i] = SOUND_SR;
+        x->f_offset[i] = (int)total;
+    }
+    x->f_sf.fBuffers = x->f_chans;
+    x->f_sf.fLength = x->f_length;
+    x->f_sf.fSR = x->f_sr;
+    x->f_sf.fOffset = x->f_offset;
+    x->f_sf.fChannels = nchans;
+    x->f_sf.fParts = (int)x->f_nfiles;
+    x->f_sf.fIsDouble = x->f_isdbl != 0;
+    return 1;
+}
+
+// must be called with sound_lock held
+static void faust_sound_uncache(t_faust_sound *x)
+{
+    t_faust_sound **y = &sound_cache;
+    if(!x->f_cached) return;
+    while(*y && *y != x) y = &(*y)->f_next;
+    if(*y) *y = x->f_next;
+    x->f_next = NULL;
+    x->f_cached = false;
+}
+
+static void faust_sound_delete(t_faust_sound *x)
+{
+    if(x->f_data) free(x->f_data);
+    freebytes(x->f_mtimes, x->f_nfiles*sizeof(long));
+    freebytes(x, sizeof(t_faust_sound));
+}
+
+static void faust_sound_finish(t_faust_sound *x, int ok)
+{
+    bool last;
+    sound_lock_acquire();
+    x->f_state = ok ? SOUND_READY : SOUND_FAILED;
+    last = --x->f_refcount == 0;
+    if(last) faust_sound_uncache(x);
+    sound_lock_release();
+    if(last) faust_sound_delete(x);
+}
+
+#ifdef _WIN32
+static DWORD WINAPI faust_sound_thread(LPVOID arg)
+{
+    t_faust_sound *x = (t_faust_sound*)arg;
+    faust_sound_finish(x, faust_sound_decode(x));
+    return 0;
+}
+
+// Start a detached loader thread; returns false if that fails.
+static bool faust_sound_start(t_faust_sound *x)
+{
+    HANDLE thread = CreateThread(NULL, 0, faust_sound_thread, x, 0, NULL);
+    if(!thread) return false;
+    CloseHandle(thread);
+    return true;
+}
+#else
+static void* faust_sound_thread(void *arg)
+{
+    t_faust_sound *x = (t_faust_sound*)arg;
+    faust_sound_finish(x, faust_sound_decode(x));
+    return NULL;
+}
+
+// Start a detached loader thread; returns false if that fails.
+static bool faust_sound_start(t_faust_sound *x)
+{
+    pthread_t thread;
+    pthread_attr_t attr;
+    bool ok;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    ok = pthread_create(&thread, &attr, faust_sound_thread, x) == 0;
+    pthread_attr_destroy(&attr);
+    return ok;
+}
+#endif
+
+static long file_mtime(char const *path)
+{
+    struct stat attrib;
+    return stat(path, &attrib) ? -1 : (long)attrib.st_mtime;
+}
+
+// Split the url into file names; returns the number of names.
+static size_t sound_parse_url(char *buf, char **names)
+{
+    size_t n = 0;
+    char *s = buf, *e;
+    while(*s == ' ' || *s == '{') s++;
+    e = s + strlen(s);
+    while(e > s && (e[-1] == ' ' || e[-1] == '}')) *--e = 0;
+    while(*s && n < SOUND_MAXPARTS)
+    {
+        char *t = strchr(s, ';'), *next = t ? t+1 : s+strlen(s);
+        if(t) *t = 0;
+        while(*s == ' ' || *s == '\'') s++;
+        e = s + strlen(s);
+        while(e > s && (e[-1] == ' ' || e[-1] == '\'')) *--e = 0;
+        if(*s) names[n++] = s;
+        s = next;
+    }
+    return n;
+}
+
+t_faust_sound* faust_sound_load(t_object* owner, t_canvas* canvas, char const *url, int isdbl)
+{
+    const size_t urlsize = strlen(url)+1;
+    char *buf = (char*)getbytes(urlsize), *names[SOUND_MAXPARTS], *key = NULL;
+    long *mtimes = NULL;
+    size_t n = 0, keysize = 0, k;
+    t_faust_sound *x = NULL, *y;
+    sound_lock_init();
+    if(buf)
+    {
+        memcpy(buf, url, urlsize);
+        n = sound_parse_url(buf, names);
+        keysize = 2 + n*MAXPDSTRING;
+        key = (char*)getbytes(keysize);
+        mtimes = n ? (long*)getbytes(n*sizeof(long)) : NULL;
+    }
+    if(!buf || !key || (n && !mtimes))
+    {
+        if(owner) pd_error(owner, "faustgen2~: memory allocation failed - soundfile");
+        goto done;
+    }
+    if(!n)
+    {
+        if(owner) pd_error(owner, "faustgen2~: soundfile: no file name");
+        goto done;
+    }
+    // resolve the file names
+    k = snprintf(key, keysize, "%c", isdbl ? 'd' : 'f');
+    for(size_t i = 0; i < n; i++)
+    {
+        char dir[MAXPDSTRING], *name = NULL;
+        int fd = canvas_open(canvas, names[i], "", dir, &name, MAXPDSTRING, 1);
+        if(fd < 0)
+        {
+            if(owner) pd_error(owner, "faustgen2~: can't find soundfile %s", names[i]);
+            goto done;
+        }
+        sys_close(fd);
+        k += snprintf(key+k, keysize-k, "\n%s/%s", dir, name);
+        mtimes[i] = file_mtime(strrchr(key, '\n')+1);
+    }
+    sound_lock_acquire();
+    for(y = sound_cache; y && y->f_key != gensym(key); y = y->f_next);
+    if(y)
+    {
+        if(!memcmp(y->f_mtimes, mtimes, n*sizeof(long)))
+        {
+            y->f_refcount++;
+            sound_lock_release();
+            x = y;
+            goto done;
+        }
+        // the files have changed, the objects still using the old sound keep
+        // it until they let go of it
+        faust_sound_uncache(y);
+    }
+    sound_lock_release();
+    x = (t_faust_sound*)getbytes(sizeof(t_faust_sound));
+    if(!x)
+    {
+        if(owner) pd_error(owner, "faustgen2~: memory allocation failed - soundfile");
+        goto done;
+    }
+    x->f_isdbl = isdbl;
+    x->f_key = gensym(key);
+    x->f_name = gensym(url);
+    x->f_nfiles = n;
+    x->f_mtimes = mtimes;
+    mtimes = NULL;
+    x->f_data = NULL;
+    *x->f_error = 0;
+    x->f_state = SOUND_LOADING;
+    // one reference for the caller, one for the loader thread
+    x->f_refcount = 2;
+    sound_lock_acquire();
+    x->f_cached = true;
+    x->f_next = sound_cache;
+    sound_cache = x;
+    sound_lock_release();
+    if(!faust_sound_start(x))
+    {
+        // no thread, load the files right away
+        faust_sound_finish(x, faust_sound_decode(x));
+    }
+done:
+    if(mtimes) freebytes(mtimes, n*sizeof(long));
+    if(key) freebytes(key, keysize);
+    if(buf) freebytes(buf, urlsize);
+    return x;
+}
+
+void faust_sound_free(t_faust_sound *x)
+{
+    bool last;
+    sound_lock_acquire();
+    last = --x->f_refcount == 0;
+    if(last) faust_sound_uncache(x);
+    sound_lock_release();
+    if(last) faust_sound_delete(x);
+}
+
+int faust_sound_poll(t_faust_sound *x, struct Soundfile **sf)
+{
+    int state;
+    sound_lock_acquire();
+    state = x->f_state;
+    sound_lock_release();
+    if(state == SOUND_READY)
+    {
+        *sf = &x->f_sf;
+        return 1;
+    }
+    return state == SOUND_FAILED ? -1 : 0;
+}
+
+char const* faust_sound_get_name(t_faust_sound const *x)
+{
+    return x->f_name->s_name;
+}
+
+char const* faust_sound_get_error(t_faust_sound const *x)
+{
+    return x->f_error;
+}
+
+struct Soundfile* faust_sound_empty(int isdbl)
+{
+    // all bits zero is 0.0 in both precisions, so the same buffer serves both
+    static double zeros[SOUND_BUFSIZE];
+    static void* chans[SOUND_MAXCHAN];
+    static int length[SOUND_MAXPARTS], sr[SOUND_MAXPARTS], offset[SOUND_MAXPARTS];
+    static struct Soundfile empty[2];
+    if(!chans[0])
+    {
+        for(int c = 0; c < SOUND_MAXCHAN; c++)
+        {
+            chans[c] = zeros;
+        }
+        for(int i = 0; i < SOUND_MAXPARTS; i++)
+        {
+            length[i] = SOUND_BUFSIZE;
+            sr[i] = SOUND_SR;
+            offset[i] = 0;
+        }
+        for(int k = 0; k < 2; k++)
+        {
+            empty[k].fBuffers = chans;
+            empty[k].fLength = length;
+            empty[k].fSR = sr;
+            empty[k].fOffset = offset;
+            empty[k].fChannels = 1;
+            empty[k].fParts = 0;
+            empty[k].fIsDouble = k != 0;
+        }
+    }
+    return &empty[isdbl != 0];
+}
@@ -0,0 +1,45 @@
+/*
+// Copyright (c) 2018 - GRAME CNCM - CICM - ANR MUSICOLL - Pierre Guillot.
+// For information on usage and redistribution, and for a DISCLAIMER OF ALL
+// WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+*/
+
+#ifndef FAUST_TILDE_SOUND_H
+#define FAUST_TILDE_SOUND_H
+
+#include <m_pd.h>
+#include <g_canvas.h>
+
+// ag: Sound files for the Faust soundfile primitive. The decoded audio lives
+// in a process-wide cache keyed by the resolved file paths, their
+// modification times and the sample precision, so that all instances and
+// voices using the same files share a single copy. Files are decoded in a
+// background thread; until they're ready, the dsp gets a silent soundfile.
+// Only WAV files (integer PCM and floating point) are supported for now.
+
+struct Soundfile;
+struct _faust_sound;
+typedef struct _faust_sound t_faust_sound;
+
+// Get a reference to the sound for a Faust soundfile url, which is either a
+// single file name or a list of file names of the form {'a.wav';'b.wav'},
+// each file making up one part of the soundfile. The files are searched for
+// along the search path of canvas. Returns NULL if a file can't be found;
+// this is reported if owner isn't NULL.
+t_faust_sound* faust_sound_load(t_object* owner, t_canvas* canvas, char const *url, int isdbl);
+
+// Release a reference; the sound is freed along with the last one.
+void faust_sound_free(t_faust_sound *x);
+
+// Check whether the sound is ready. Returns 1 and the soundfile in *sf if
+// it is, 0 while it's still loading, and -1 if it couldn't be decoded.
+int faust_sound_poll(t_faust_sound *x, struct Soundfile **sf);
+
+// Description of the sound (the url), and the error if decoding failed.
+char const* faust_sound_get_name(t_faust_sound const *x);
+char const* faust_sound_get_error(t_faust_sound const *x);
+
+// Shared silent soundfile, used until the sound is ready.
+struct Soundfile* faust_sound_empty(int isdbl);
+
+#endif
@@ -0,0 +1,655 @@
+/*
+// Copyright (c) 2018 - GRAME CNCM - CICM - ANR MUSICOLL - Pierre Guillot.
+// For information on usage and redistribution, and for a DISCLAIMER OF ALL
+// WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+*/
+
+#include "faust_tilde_tuning.h"
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <stdbool.h>
+#include <sys/stat.h>
+
+typedef struct _faust_tuning
+{
+    t_object*   f_owner;
+    // the scale: degrees 1..n in cents, degree 0 = 0 cents is implicit, and
+    // degree n is the period
+    size_t      f_n;
+    double*     f_cents;
+    // keyboard mapping (see the .kbm format); f_size = 0 is a linear mapping
+    // of the scale degrees to consecutive keys, f_octave = 0 is the period
+    int         f_size, f_first, f_last, f_middle, f_refnote, f_octave;
+    double      f_reffreq;
+    int*        f_map; // scale degrees of the keys, -1 = unmapped
+    // note frequencies by MIDI channel, see faust_tuning_update
+    t_float     f_freq[TUNING_NCHANNELS][128];
+    // tunings loaded from files are kept in a process-wide cache, see
+    // faust_tuning_load; these are shared and must not be modified
+    int         f_refcount;
+    t_symbol*   f_key;      // cache key, NULL if not in the cache
+    t_symbol*   f_path;     // scale file, NULL if none
+    long        f_mtime[2]; // modification times of the scale and mapping
+    struct _faust_tuning* f_next;
+}t_faust_tuning;
+
+static t_faust_tuning* tuning_cache = NULL;
+
+// 12-tet in double precision (Pd's mtof() is only single precision)
+static double mtof_dbl(double num)
+{
+    return 440.0*pow(2.0, (num-69.0)/12.0);
+}
+
+static long floor_div(long a, long b)
+{
+    long q = a/b;
+    return (a%b != 0 && (a < 0) != (b < 0)) ? q-1 : q;
+}
+
+// pitch of a scale degree (any integer) in cents
+static double faust_tuning_degree(t_faust_tuning const *x, long k)
+{
+    const long n = (long)x->f_n;
+    const long q = floor_div(k, n), r = k - q*n;
+    return q*x->f_cents[n-1] + (r ? x->f_cents[r-1] : 0.0);
+}
+
+// pitch of a key in cents relative to scale degree 0; returns 0 if the key
+// isn't mapped
+static int faust_tuning_key(t_faust_tuning const *x, int num, double *c)
+{
+    long d = num - x->f_middle, q, r;
+    if(!x->f_size)
+    {
+        *c = faust_tuning_degree(x, d);
+        return 1;
+    }
+    if(num < x->f_first || num > x->f_last)
+    {
+        return 0;
+    }
+    q = floor_div(d, x->f_size);
+    r = d - q*x->f_size;
+    if(x->f_map[r] < 0)
+    {
+        return 0;
+    }
+    *c = q*faust_tuning_degree(x, x->f_octave ? x->f_octave : (long)x->f_n) +
+        faust_tuning_degree(x, x->f_map[r]);
+    return 1;
+}
+
+// frequency of a key, 0 if it isn't mapped
+static double faust_tuning_compute(t_faust_tuning const *x, int num)
+{
+    double ref, c;
+    if(!faust_tuning_key(x, x->f_refnote, &ref))
+    {
+        // the reference key isn't mapped, use its linear position instead
+        ref = faust_tuning_degree(x, x->f_refnote - x->f_middle);
+    }
+    return faust_tuning_key(x, num, &c) ? x->f_reffreq*pow(2.0, (c-ref)/1200.0) : 0.0;
+}
+
+static void faust_tuning_update(t_faust_tuning *x)
+{
+    for(int i = 0; i < 128; i++)
+    {
+        x->f_freq[0][i] = (t_float)faust_tuning_compute(x, i);
+    }
+    for(int k = 1; k < TUNING_NCHANNELS; k++)
+    {
+        memcpy(x->f_freq[k], x->f_freq[0], sizeof(x->f_freq[0]));
+    }
+}
+
+static void faust_tuning_free_map(t_faust_tuning *x)
+{
+    if(x->f_map)
+    {
+        freebytes(x->f_map, x->f_size*sizeof(int));
+    }
+    x->f_map = NULL;
+    x->f_size = x->f_octave = 0;
+    x->f_first = 0;
+    x->f_last = 127;
+}
+
+// replace the scale, resetting the mapping to the default
+static void faust_tuning_set_scale(t_faust_tuning *x, double *cents, size_t n,
+                                   int refnote, double reffreq)
+{
+    if(x->f_cents)
+    {
+        freebytes(x->f_cents, x->f_n*sizeof(double));
+    }
+    x->f_cents = cents;
+    x->f_n = n;
+    faust_tuning_free_map(x);
+    x->f_middle = 60;
+    x->f_refnote = refnote;
+    x->f_reffreq = reffreq;
+    faust_tuning_update(x);
+}
+
+t_faust_tuning* faust_tuning_new(t_object* owner)
+{
+    t_faust_tuning* x = (t_faust_tuning*)getbytes(sizeof(t_faust_tuning));
+    double *cents = x ? (double*)getbytes(12*sizeof(double)) : NULL;
+    if(!cents)
+    {
+        if(x) freebytes(x, sizeof(t_faust_tuning));
+        pd_error(owner, "faustgen2~: memory allocation failed - tuning");
+        return NULL;
+    }
+    for(int i = 0; i < 12; i++)
+    {
+        cents[i] = 100.0*(i+1);
+    }
+    x->f_owner = owner;
+    x->f_cents = NULL;
+    x->f_map = NULL;
+    x->f_refcount = 1;
+    x->f_key = x->f_path = NULL;
+    x->f_next = NULL;
+    faust_tuning_set_scale(x, cents, 12, 69, 440.0);
+    return x;
+}
+
+static void faust_tuning_uncache(t_faust_tuning *x)
+{
+    t_faust_tuning **y = &tuning_cache;
+    while(*y && *y != x) y = &(*y)->f_next;
+    if(*y) *y = x->f_next;
+    x->f_key = NULL;
+    x->f_next = NULL;
+}
+
+void faust_tuning_free(t_faust_tuning *x)
+{
+    if(--x->f_refcount > 0)
+    {
+        return;
+    }
+    if(x->f_key)
+    {
+        faust_tuning_uncache(x);
+    }
+    faust_tuning_free_map(x);
+    if(x->f_cents)
+    {
+        freebytes(x->f_cents, x->f_n*sizeof(double));
+    }
+    freebytes(x, sizeof(t_faust_tuning));
+}
+
+void faust_tuning_set_offsets(t_faust_tuning *x, t_float const offsets[12])
+{
+    double *cents = (double*)getbytes(12*sizeof(double));
+    if(!cents)
+    {
+        pd_error(x->f_owner, "faustgen2~: memory allocation failed - tuning");
+        return;
+    }
+    // make the offsets relative to C, which becomes the reference key
+    for(int i = 1; i < 12; i++)
+    {
+        cents[i-1] = 100.0*i + offsets[i] - offsets[0];
+    }
+    cents[11] = 1200.0;
+    x->f_path = NULL;
+    faust_tuning_set_scale(x, cents, 12, 60, mtof_dbl(60.0+offsets[0]/100.0));
+}
+
+static bool is_blank(const char *s)
+{
+    while (isblank(*s)) s++;
+    return *s == 0;
+}
+
+// Read the next line which isn't empty or a comment (beginning with '!').
+static char *scala_line(FILE *fp, char *buf, size_t *lines)
+{
+    while(fgets(buf, MAXPDSTRING, fp))
+    {
+        size_t l = strlen(buf);
+        (*lines)++;
+        // remove the trailing newline
+        while(l > 0 && (buf[l-1] == '\n' || buf[l-1] == '\r')) buf[--l] = 0;
+        if(*buf != '!' && !is_blank(buf))
+        {
+            return buf;
+        }
+    }
+    return NULL;
+}
+
+// Parse a pitch value: a ratio or an integer (which is a ratio with
+// denominator 1), or a cent value, which must contain a period. Anything
+// following the value after some whitespace is ignored.
+static int scala_pitch(const char *buf, double *c)
+{
+    int p, q, pos;
+    while(isblank(*buf)) buf++;
+    if(strchr(buf, '.') && sscanf(buf, "%lf%n", c, &pos) == 1 &&
+       (!buf[pos] || isspace(buf[pos])))
+    {
+        return 0;
+    }
+    if(sscanf(buf, "%d/%d%n", &p, &q, &pos) == 2 || sscanf(buf, "%d%n", &p, &pos) == 1)
+    {
+        if(!strchr(buf, '/')) q = 1;
+        if(p > 0 && q > 0 && (!buf[pos] || isspace(buf[pos])))
+        {
+            *c = 1200.0*log((double)p/(double)q)/log(2.0);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static int faust_tuning_read_scale(t_faust_tuning *x, char const *path, int base)
+{
+    FILE *fp = fopen(path, "r");
+    char buf[MAXPDSTRING], *line;
+    size_t lines = 0, i;
+    double *cents = NULL;
+    int n;
+    if(!fp)
+    {
+        pd_error(x->f_owner, "faustgen2~: can't open %s", path);
+        return -1;
+    }
+    // description
+    if((line = scala_line(fp, buf, &lines)))
+    {
+        logpost(x->f_owner, 3, "%s", line);
+    }
+    // scale size
+    if(!(line = scala_line(fp, buf, &lines)) ||
+       sscanf(line, "%d", &n) != 1 || n < 1 || n > 0x10000)
+    {
+        pd_error(x->f_owner, "faustgen2~: %s:%lu: expected scale size", path, (unsigned long)lines);
+        fclose(fp);
+        return -1;
+    }
+    cents = (double*)getbytes(n*sizeof(double));
+    if(!cents)
+    {
+        pd_error(x->f_owner, "faustgen2~: memory allocation failed - tuning");
+        fclose(fp);
+        return -1;
+    }
+    for(i = 0; i < (size_t)n; i++)
+    {
+        if(!(line = scala_line(fp, buf, &lines)) || scala_pitch(line, cents+i))
+        {
+            pd_error(x->f_owner, "faustgen2~: %s:%lu: expected ratio or cent value", path, (unsigned long)lines);
+            freebytes(cents, n*sizeof(double));
+            fclose(fp);
+            return -1;
+        }
+    }
+    fclose(fp);
+    if(cents[n-1] <= 0.0)
+    {
+        pd_error(x->f_owner, "faustgen2~: %s: period must be positive", path);
+        freebytes(cents, n*sizeof(double));
+        return -1;
+    }
+    if(base < 0 || base >= n)
+    {
+        pd_error(x->f_owner, "faustgen2~: %s: reference tone %d out of range (0..%d)", path, base, n-1);
+        freebytes(cents, n*sizeof(double));
+        return -1;
+    }
+    // scale degree base at key 60+base gets the pitch of that key in 12-tet
+    faust_tuning_set_scale(x, cents, n, 60+base, mtof_dbl(60.0+base));
+    return 0;
+}
+
+int faust_tuning_read_mapping(t_faust_tuning *x, char const *path)
+{
+    FILE *fp = fopen(path, "r");
+    char buf[MAXPDSTRING], *line;
+    size_t lines = 0;
+    int hdr[7], size, *map = NULL, i, pos;
+    double reffreq;
+    if(!fp)
+    {
+        pd_error(x->f_owner, "faustgen2~: can't open %s", path);
+        return -1;
+    }
+    // map size, first and last key, middle key, reference key and frequency,
+    // formal octave
+    for(i = 0; i < 7; i++)
+    {
+        bool ok = (line = scala_line(fp, buf, &lines)) != NULL;
+        if(ok && i == 5)
+            ok = sscanf(line, "%lf%n", &reffreq, &pos) == 1 && reffreq > 0.0;
+        else if(ok)
+            ok = sscanf(line, "%d%n", &hdr[i], &pos) == 1 && hdr[i] >= 0;
+        if(!ok)
+        {
+            pd_error(x->f_owner, "faustgen2~: %s:%lu: bad keyboard mapping", path, (unsigned long)lines);
+            fclose(fp);
+            return -1;
+        }
+    }
+    size = hdr[0];
+    if(size > 0x10000 || hdr[1] > 127 || hdr[2] > 127 || hdr[3] > 127 || hdr[4] > 127)
+    {
+        pd_error(x->f_owner, "faustgen2~: %s: keyboard mapping out of range", path);
+        fclose(fp);
+        return -1;
+    }
+    if(size)
+    {
+        map = (int*)getbytes(size*sizeof(int));
+        if(!map)
+        {
+            pd_error(x->f_owner, "faustgen2~: memory allocation failed - tuning");
+            fclose(fp);
+            return -1;
+        }
+        // the keys at the end of the map may be omitted, they're unmapped
+        for(i = 0; i < size; i++)
+        {
+            map[i] = -1;
+        }
+        for(i = 0; i < size && (line = scala_line(fp, buf, &lines)); i++)
+        {
+            while(isblank(*line)) line++;
+            if(*line != 'x' && (sscanf(line, "%d", &map[i]) != 1 || map[i] < 0))
+            {
+                pd_error(x->f_owner, "faustgen2~: %s:%lu: expected scale degree or 'x'", path, (unsigned long)lines);
+                freebytes(map, size*sizeof(int));
+                fclose(fp);
+                return -1;
+            }
+        }
+    }
+    fclose(fp);
+    faust_tuning_free_map(x);
+    x->f_size = size;
+    x->f_map = map;
+    x->f_first = hdr[1];
+    x->f_last = hdr[2];
+    x->f_middle = hdr[3];
+    x->f_refnote = hdr[4];
+    x->f_reffreq = reffreq;
+    x->f_octave = hdr[6];
+    faust_tuning_update(x);
+    return 0;
+}
+
+t_faust_tuning* faust_tuning_copy(t_object* owner, t_faust_tuning const *x)
+{
+    t_faust_tuning* y;
+    if(!x)
+    {
+        return faust_tuning_new(owner);
+    }
+    y = (t_faust_tuning*)getbytes(sizeof(t_faust_tuning));
+    if(!y)
+    {
+        pd_error(owner, "faustgen2~: memory allocation failed - tuning");
+        return NULL;
+    }
+    memcpy(y, x, sizeof(t_faust_tuning));
+    y->f_cents = (double*)getbytes(x->f_n*sizeof(double));
+    y->f_map = x->f_size ? (int*)getbytes(x->f_size*sizeof(int)) : NULL;
+    if(!y->f_cents || (x->f_size && !y->f_map))
+    {
+        if(y->f_cents) freebytes(y->f_cents, x->f_n*sizeof(double));
+        if(y->f_map) freebytes(y->f_map, x->f_size*sizeof(int));
+        freebytes(y, sizeof(t_faust_tuning));
+        pd_error(owner, "faustgen2~: memory allocation failed - tuning");
+        return NULL;
+    }
+    memcpy(y->f_cents, x->f_cents, x->f_n*sizeof(double));
+    if(x->f_size)
+    {
+        memcpy(y->f_map, x->f_map, x->f_size*sizeof(int));
+    }
+    y->f_owner = owner;
+    y->f_refcount = 1;
+    y->f_key = NULL;
+    y->f_next = NULL;
+    return y;
+}
+
+static long file_mtime(char const *path)
+{
+    struct stat attrib;
+    return stat(path, &attrib) ? -1 : (long)attrib.st_mtime;
+}
+
+t_faust_tuning* faust_tuning_load(t_object* owner, char const *scl, int base, char const *kbm)
+{
+    char buf[2*MAXPDSTRING+32];
+    t_faust_tuning *x;
+    t_symbol *key;
+    long mtime[2];
+    snprintf(buf, sizeof(buf), "%s\t%d\t%s", scl, kbm ? 0 : base, kbm ? kbm : "");
+    key = gensym(buf);
+    mtime[0] = file_mtime(scl);
+    mtime[1] = kbm ? file_mtime(kbm) : 0;
+    for(x = tuning_cache; x && x->f_key != key; x = x->f_next);
+    if(x)
+    {
+        if(x->f_mtime[0] == mtime[0] && x->f_mtime[1] == mtime[1])
+        {
+            x->f_refcount++;
+            return x;
+        }
+        // the files have changed, the objects still using the old tuning
+        // keep it until they let go of it
+        faust_tuning_uncache(x);
+    }
+    x = faust_tuning_new(owner);
+    if(!x)
+    {
+        return NULL;
+    }
+    if(faust_tuning_read_scale(x, scl, base) || (kbm && faust_tuning_read_mapping(x, kbm)))
+    {
+        faust_tuning_free(x);
+        return NULL;
+    }
+    // the tuning may outlive its owner
+    x->f_owner = NULL;
+    x->f_key = key;
+    x->f_path = gensym(scl);
+    x->f_mtime[0] = mtime[0];
+    x->f_mtime[1] = mtime[1];
+    x->f_next = tuning_cache;
+    tuning_cache = x;
+    return x;
+}
+
+int faust_tuning_is_shared(t_faust_tuning const *x)
+{
+    return x->f_key || x->f_refcount > 1;
+}
+
+char const* faust_tuning_get_path(t_faust_tuning const *x)
+{
+    return x->f_path ? x->f_path->s_name : NULL;
+}
+
+size_t faust_tuning_get_size(t_faust_tuning const *x)
+{
+    return x->f_n;
+}
+
+void faust_tuning_get_scale(t_faust_tuning const *x, t_atom *argv)
+{
+    for(size_t i = 0; i < x->f_n; i++)
+    {
+        SETFLOAT(argv+i, x->f_cents[i]);
+    }
+}
+
+int faust_tuning_get_offsets(t_faust_tuning const *x, t_float offsets[12])
+{
+    double ref;
+    if(x->f_n != 12 || x->f_size || fabs(x->f_cents[11]-1200.0) > 1e-8)
+    {
+        return -1;
+    }
+    // the deviation of the reference key from 12-tet, and that of each
+    // scale degree from the 12-tet pitch of its key
+    faust_tuning_key(x, x->f_refnote, &ref);
+    ref = 1200.0*log(x->f_reffreq/mtof_dbl(x->f_refnote))/log(2.0) - ref +
+        100.0*(x->f_refnote - x->f_middle);
+    for(int i = 0; i < 12; i++)
+    {
+        const int k = (x->f_middle + i) % 12;
+        offsets[k] = faust_tuning_degree(x, i) - 100.0*i + ref;
+    }
+    return 0;
+}
+
+// frequency of an MTS note (xx yy zz = semitone and 14 bit fraction)
+static t_float mts_freq(unsigned char const *b)
+{
+    return (t_float)mtof_dbl(b[0] + ((b[1]<<7)|b[2])/16384.0);
+}
+
+// retune single notes on all channels, n entries of kk xx yy zz
+static void mts_notes(t_faust_tuning *x, unsigned char const *b, int n)
+{
+    for(int i = 0; i < n; i++, b += 4)
+    {
+        // 7f 7f 7f means no change
+        if(b[1] == 0x7f && b[2] == 0x7f && b[3] == 0x7f) continue;
+        const t_float f = mts_freq(b+1);
+        for(int k = 0; k < TUNING_NCHANNELS; k++)
+        {
+            x->f_freq[k][b[0]] = f;
+        }
+    }
+}
+
+// retune the pitch classes on the channels in the channel mask ff gg hh,
+// followed by 12 offsets of the given size (1 or 2 bytes)
+static void mts_octave(t_faust_tuning *x, unsigned char const *b, int size)
+{
+    const unsigned long mask = ((unsigned long)b[0]<<14)|((unsigned long)b[1]<<7)|b[2];
+    double cents[12];
+    b += 3;
+    for(int i = 0; i < 12; i++, b += size)
+    {
+        if(size == 1)
+            // -64..+63 cents, 0x40 = 12-tet
+            cents[i] = b[0] - 64.0;
+        else
+            // -100..+100 cents, 0x2000 = 12-tet
+            cents[i] = (((b[0]<<7)|b[1]) - 8192)*100.0/8192.0;
+    }
+    for(int k = 0; k < TUNING_NCHANNELS; k++)
+    {
+        if(!(mask & (1UL<<k))) continue;
+        for(int i = 0; i < 128; i++)
+        {
+            x->f_freq[k][i] = (t_float)mtof_dbl(i + cents[i%12]/100.0);
+        }
+    }
+}
+
+int faust_tuning_mts(t_faust_tuning *x, int argc, t_atom const *argv)
+{
+    unsigned char b[512];
+    int n = 0, m;
+    // strip the sysex framing
+    if(argc > 0 && argv[0].a_type == A_FLOAT && (int)argv[0].a_w.w_float == 0xf0)
+    {
+        argc--; argv++;
+    }
+    if(argc > 0 && argv[argc-1].a_type == A_FLOAT && (int)argv[argc-1].a_w.w_float == 0xf7)
+    {
+        argc--;
+    }
+    // universal (non-)real-time header: 7e/7f, device id, 08 (MTS), sub-id
+    if(argc < 4 || argc > (int)sizeof(b))
+    {
+        return -1;
+    }
+    for(int i = 0; i < argc; i++)
+    {
+        const int v = argv[i].a_type == A_FLOAT ? (int)argv[i].a_w.w_float : -1;
+        if(v < 0 || v > 0x7f) return -1;
+        b[n++] = (unsigned char)v;
+    }
+    if((b[0] != 0x7e && b[0] != 0x7f) || b[2] != 0x08)
+    {
+        return -1;
+    }
+    // Each of the tuning messages below changes the table, which then no
+    // longer reflects the scale file (if any).
+    switch(b[3])
+    {
+        case 0x01:
+            // bulk dump: program, 16 byte name, 128 notes, checksum
+            if(n < 5+16+128*3) break;
+            for(int i = 0; i < 128; i++)
+            {
+                unsigned char const *c = b+5+16+3*i;
+                if(c[0] == 0x7f && c[1] == 0x7f && c[2] == 0x7f) continue;
+                const t_float f = mts_freq(c);
+                for(int k = 0; k < TUNING_NCHANNELS; k++)
+                {
+                    x->f_freq[k][i] = f;
+                }
+            }
+            x->f_path = NULL;
+            return b[0] == 0x7f;
+        case 0x02:
+            // real-time single note tuning: program, count, notes
+            if(n < 6 || n < 6+4*(m = b[5])) break;
+            mts_notes(x, b+6, m);
+            x->f_path = NULL;
+            return b[0] == 0x7f;
+        case 0x07:
+            // single note tuning with bank: bank, program, count, notes
+            if(n < 7 || n < 7+4*(m = b[6])) break;
+            mts_notes(x, b+7, m);
+            x->f_path = NULL;
+            return b[0] == 0x7f;
+        case 0x08:
+            // scale/octave tuning, 1 byte form
+            if(n < 7+12) break;
+            mts_octave(x, b+4, 1);
+            x->f_path = NULL;
+            return b[0] == 0x7f;
+        case 0x09:
+            // scale/octave tuning, 2 byte form
+            if(n < 7+24) break;
+            mts_octave(x, b+4, 2);
+            x->f_path = NULL;
+            return b[0] == 0x7f;
+        default:
+            // dump requests etc.
+            return -1;
+    }
+    pd_error(x->f_owner, "faustgen2~: malformed MTS message");
+    return -1;
+}
+
+t_float faust_tuning_freq(t_faust_tuning const *x, int chan, int num)
+{
+    if(!x)
+    {
+        return mtof(num);
+    }
+    if(num < 0 || num > 127)
+    {
+        // not in the table
+        return (t_float)faust_tuning_compute(x, num);
+    }
+    return x->f_freq[chan < 0 ? 0 : chan % TUNING_NCHANNELS][num];
+}
@@ -0,0 +1,84 @@
+/*
+// Copyright (c) 2018 - GRAME CNCM - CICM - ANR MUSICOLL - Pierre Guillot.
+// For information on usage and redistribution, and for a DISCLAIMER OF ALL
+// WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+*/
+
+#ifndef FAUST_TILDE_TUNING_H
+#define FAUST_TILDE_TUNING_H
+
+#include <m_pd.h>
+
+// ag: Tunings map the MIDI note numbers to frequencies. A tuning consists of
+// a scale of arbitrary size and period, as found in Scala files
+// (http://www.huygens-fokker.org/scala/scl_format.html), and a keyboard
+// mapping, as found in Scala .kbm files, which assigns the scale degrees to
+// the keys and fixes the pitch of a reference key. The frequencies of all
+// notes are kept in a table per MIDI channel, which is rebuilt whenever the
+// tuning changes, so that looking up the frequency of a note is cheap.
+//
+// Tunings loaded from files are cached process-wide, keyed by the file paths
+// and modification times, so that objects switching to the same tuning share
+// a single parsed copy. Shared tunings are immutable; use faust_tuning_copy
+// to get a private copy which can be modified.
+
+struct _faust_tuning;
+typedef struct _faust_tuning t_faust_tuning;
+
+#define TUNING_NCHANNELS 16
+
+// Create a new tuning, initially 12-tet with A4 = 440 Hz.
+t_faust_tuning* faust_tuning_new(t_object* owner);
+
+// Release a tuning; shared tunings are freed along with the last reference.
+void faust_tuning_free(t_faust_tuning *x);
+
+// Get a shared tuning from a Scala file and an optional keyboard mapping
+// (kbm may be NULL), loading it into the cache if needed. Without a keyboard
+// mapping, scale degree 0 is on middle C and scale degree base has the same
+// pitch as in 12-tet. Returns NULL if the files can't be loaded.
+t_faust_tuning* faust_tuning_load(t_object* owner, char const *scl, int base, char const *kbm);
+
+// Get a private copy of a tuning (a new 12-tet tuning if x is NULL).
+t_faust_tuning* faust_tuning_copy(t_object* owner, t_faust_tuning const *x);
+
+// Whether the tuning is shared (and thus may not be modified).
+int faust_tuning_is_shared(t_faust_tuning const *x);
+
+// The scale file the tuning was loaded from, NULL if none.
+char const* faust_tuning_get_path(t_faust_tuning const *x);
+
+// The following functions modify the tuning, which must not be shared.
+
+// Set an octave-based 12-tone tuning given as offsets in cents from 12-tet.
+void faust_tuning_set_offsets(t_faust_tuning *x, t_float const offsets[12]);
+
+// Load a keyboard mapping for the current scale from a Scala .kbm file.
+int faust_tuning_read_mapping(t_faust_tuning *x, char const *path);
+
+// Number of degrees of the current scale; the last one is the period.
+size_t faust_tuning_get_size(t_faust_tuning const *x);
+
+// Get the current scale degrees in cents (degree 0 = 0 cents is implicit).
+void faust_tuning_get_scale(t_faust_tuning const *x, t_atom *argv);
+
+// Get the offsets in cents from 12-tet of the 12 pitch classes. This returns
+// -1 if the tuning isn't an octave-based 12-tone tuning with the default
+// mapping.
+int faust_tuning_get_offsets(t_faust_tuning const *x, t_float offsets[12]);
+
+// Apply a MIDI Tuning Standard sysex message, given as a list of data bytes
+// with or without the enclosing 0xf0 and 0xf7 bytes. Supported are the bulk
+// dump, single note and scale/octave tuning messages; the tuning program and
+// bank numbers are ignored. These messages change the frequency tables
+// directly, until the next scale or mapping is loaded. Returns 1 for a
+// real-time and 0 for a non-real-time message, -1 if the message isn't a
+// supported MTS message (malformed MTS messages are reported).
+int faust_tuning_mts(t_faust_tuning *x, int argc, t_atom const *argv);
+
+// Frequency of the given note on the given MIDI channel (counting from 0;
+// channels beyond 15 wrap around, -1 = none). Keys which aren't mapped
+// yield 0. With no tuning (NULL), this is the same as mtof().
+t_float faust_tuning_freq(t_faust_tuning const *x, int chan, int num);
+
+#endif
@@ -6,15 +6,27 @@
 
 
 #include "faust_tilde_ui.h"
+#include "faust_tilde_sound.h"
+#include <g_canvas.h>
 #ifdef DSPC
 #include <faust/dsp/llvm-dsp-c.h>
 #else
 #include <faust/dsp/llvm-c-dsp.h>
 #endif
+#include <stdio.h>
 #include <string.h>
 #include <ctype.h>
 #include <float.h>
+#include <limits.h>
 #include <math.h>
+#include <stdint.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define HAVE_SHM 1
+#endif
 
 #define MAXFAUSTSTRING 4096
 #define FAUST_UI_TYPE_BUTTON     0
@@ -62,12 +74,23 @@ static const char *midi_sym_s[N_MIDI] = {
   NULL, "ctl", "noteon", "noteoff", "note",
   "polytouch", "pgm", "touch", "bend",
   "start", "stop", "clock"
-  // currently unsupported: cont, sysex
+  // currently unsupported: cont; sysex is handled in faustgen_tilde.c (MTS
+  // tuning messages only, see faust_ui_manager_mts)
 };
 
 // corresponding Pd symbols
 static t_symbol *midi_sym[N_MIDI];
 
+static void faust_ui_midi_init(void)
+{
+  if (!midi_sym[MIDI_CTRL]) {
+    // populate the midi_sym table
+    for (int i = 1; i < N_MIDI; i++)
+      if (midi_sym_s[i])
+        midi_sym[i] = gensym(midi_sym_s[i]);
+  }
+}
+
 // Argument count of the different SMMF messages (excluding the trailing
 // channel argument). Note that there are some idiosyncrasies in the argument
 // order of the 2-argument messages to account for the way the Pd MIDI objects
@@ -83,19 +106,76 @@ static int midi_argc[N_MIDI] = {
   0, 0, 0
 };
 
+// Precomputed control values for all MIDI values of a binding. These are
+// kept in a process-wide cache and shared by all bindings with the same MIDI
+// range and control parameters, in all ui managers (most notably, those of
+// the voices in old-style polyphony), see faust_midi_ui_table.
+typedef struct _faust_midi_table {
+  int range, type, scale; // MIDI range (max value), control type and scale
+  FAUSTFLOAT min, max, step;
+  int refcount;
+  int n;
+  FAUSTFLOAT *v;
+  struct _faust_midi_table *next;
+} t_faust_midi_table;
+
+static t_faust_midi_table *midi_table_cache = NULL;
+
+static void faust_midi_table_release(t_faust_midi_table *t);
+
 typedef struct {
   int msg;  // message type (see MIDI_XYZ enum above)
   int num;  // parameter (note or controller number)
   int chan; // MIDI channel (-1 if none)
   int val;  // last output value (passive controls only)
+  // precomputed control values (active controls only, NULL if none)
+  t_faust_midi_table *table;
 } t_faust_midi_ui;
 
+// [scale:xyz] meta data
+enum { SCALE_LIN, SCALE_LOG, SCALE_EXP };
+
 typedef struct {
   t_symbol *msg; // message selector
   double a, b;   // target range (both zero if none)
   int val;       // last output value (passive controls only)
 } t_faust_osc_ui;
 
+// Entry of the MIDI dispatch index, see faust_ui_manager_update_midi_index
+// below. The entries are sorted by message type, channel and number (the
+// latter being 0 for messages which don't have a note or controller number),
+// and then by the order of the bindings in the ui list (seq), so that
+// matching bindings are processed in the same order as before.
+typedef struct {
+  int msg, chan, num;
+  size_t seq;
+  struct _faust_ui *ui;
+  size_t j; // index into ui->p_midi
+} t_faust_midi_entry;
+
+// Entry of the OSC dispatch index, see faust_ui_manager_update_osc_index
+// below. Exact entries (k < 0) are keyed by the OSC address of the binding,
+// while addresses of the form /prefix/N also get an entry keyed by /prefix
+// with k = N, which is used to dispatch multi-argument messages.
+typedef struct {
+  const t_symbol *key;
+  int k;
+  size_t seq;
+  struct _faust_ui *ui;
+  size_t j; // index into ui->p_osc
+} t_faust_osc_entry;
+
+// Family of controls whose names only differ in a numeric suffix, such as
+// gain0, gain1, etc. These are used to process list messages such as
+// "gain 0 0.1 0.2 ..." quickly, see faust_ui_manager_set_list below. The
+// controls are stored in a dense array indexed by the suffix minus base
+// (NULL for gaps).
+typedef struct {
+  int base;
+  size_t n;
+  struct _faust_ui **uis;
+} t_faust_family;
+
 // Temporary storage for ui meta data. The ui meta callback is always invoked
 // before the callback which creates the ui element itself, so we need to keep
 // the meta data somewhere until it can be processed. This is only used for
@@ -106,6 +186,9 @@ typedef struct {
 static struct {
   FAUSTFLOAT* zone;
   int voice;
+  bool signal; // [pd:signal]
+  double smooth; // [smooth:ms]
+  int scale; // [scale:lin|log|exp]
   size_t n_midi;
   t_faust_midi_ui midi[N_MIDI_UI];
   size_t n_osc;
@@ -118,7 +201,9 @@ typedef struct {
   struct _faust_ui_manager *owner;
   t_symbol *uisym; // the symbol to bind to
   t_symbol *lname; // the actual long name of the symbol
-  int type; // 0 is an ordinary gui element, 1 = active, 2 = init, 3 = panic
+  // 0 is an ordinary gui element, 1 = active, 2 = init, 3 = panic,
+  // 4 = previous page, 5 = next page
+  int type;
   // recursive means that we're currently sending a message which might
   // trigger an update, so we don't want to receive messages in that case.
   bool recursive;
@@ -148,11 +233,33 @@ static void faust_ui_receive_free(t_faust_ui_proxy *r)
 static void faust_ui_receive(t_faust_ui_proxy *r, t_floatarg v);
 static void faust_bang_receive(t_faust_ui_proxy *r);
 
+// ag: Invisible placeholder object which watches an instance subpatch for
+// the lazy GUI, see faust_ui_manager_gui_watch below.
+typedef struct _faust_gui_sentinel
+{
+  t_gobj g;
+  struct _faust_ui_manager *owner;
+  t_glist *canvas;
+  t_clock *clock;
+} t_faust_gui_sentinel;
+
+static t_class *faust_gui_sentinel_class;
+static t_widgetbehavior faust_gui_sentinel_widget;
+
+static void faust_gui_sentinel_free(t_faust_gui_sentinel *y);
+static void faust_gui_sentinel_getrect(t_gobj *z, t_glist *gl,
+                                       int *x1, int *y1, int *x2, int *y2);
+static void faust_gui_sentinel_vis(t_gobj *z, t_glist *gl, int vis);
+
 void faust_ui_receive_setup(void)
 {
   faust_ui_proxy_class = class_new(gensym("faustgen2~ proxy receive"), 0, 0, sizeof(t_faust_ui_proxy), 0, 0);
   class_addbang(faust_ui_proxy_class, faust_bang_receive);
   class_addfloat(faust_ui_proxy_class, faust_ui_receive);
+  faust_gui_sentinel_class = class_new(gensym("faustgen2~ gui sentinel"), 0, (t_method)faust_gui_sentinel_free, sizeof(t_faust_gui_sentinel), CLASS_GOBJ, 0);
+  faust_gui_sentinel_widget.w_getrectfn = faust_gui_sentinel_getrect;
+  faust_gui_sentinel_widget.w_visfn = faust_gui_sentinel_vis;
+  class_setwidget(faust_gui_sentinel_class, &faust_gui_sentinel_widget);
 }
 
 typedef struct _faust_ui
@@ -161,7 +268,6 @@ typedef struct _faust_ui
     t_symbol*           p_longname;
     t_symbol*           p_uisym;
     t_faust_ui_proxy *  p_uirecv;
-    FAUSTFLOAT          p_uival;
     int                 p_type;
     FAUSTFLOATX*        p_zone;
     FAUSTFLOAT          p_min;
@@ -171,8 +277,13 @@ typedef struct _faust_ui
     FAUSTFLOAT          p_saved;
     char                p_kept;
     size_t              p_index;
+    size_t              p_slot; // index into the control table
+    size_t              p_pslot; // index into its passive list
     FAUSTFLOAT          p_tempv;
     int                 p_voice;
+    bool                p_signal; // [pd:signal] meta data
+    double              p_smooth; // [smooth:ms] meta data (0 = none)
+    int                 p_scale; // [scale:xyz] meta data (SCALE_LIN etc.)
     size_t              p_nmidi;
     t_faust_midi_ui*    p_midi;
     size_t              p_nosc;
@@ -180,9 +291,216 @@ typedef struct _faust_ui
     struct _faust_ui*   p_next;
 }t_faust_ui;
 
+// Zone accessors for a given precision, see faustflt below. These are
+// selected once per compilation, so that the loops which access many zones
+// don't have to check the precision for each access.
+typedef struct {
+  FAUSTFLOAT (*get)(const FAUSTFLOATX *z);
+  FAUSTFLOAT (*set)(FAUSTFLOATX *z, FAUSTFLOAT v);
+  // Read the zones zones[idx[0..n-1]] (zones[0..n-1] if idx is NULL) into v.
+  void (*gather)(FAUSTFLOATX *const *zones, const size_t *idx, size_t n,
+                 FAUSTFLOAT *v);
+  // Write v[idx[0..n-1]] into the zones zones[idx[0..n-1]].
+  void (*scatter)(FAUSTFLOATX *const *zones, const size_t *idx, size_t n,
+                  const FAUSTFLOAT *v);
+} t_faust_zone_ops;
+
+#define FAUST_ZONE_OPS(T)                                               \
+  static FAUSTFLOAT zone_get_##T(const FAUSTFLOATX *z)                  \
+  {                                                                     \
+    return *(const T*)z;                                                \
+  }                                                                     \
+  static FAUSTFLOAT zone_set_##T(FAUSTFLOATX *z, FAUSTFLOAT v)          \
+  {                                                                     \
+    return (*(T*)z = v);                                                \
+  }                                                                     \
+  static void zone_gather_##T(FAUSTFLOATX *const *zones,                \
+                              const size_t *idx, size_t n,              \
+                              FAUSTFLOAT *v)                            \
+  {                                                                     \
+    if (idx)                                                            \
+      for (size_t i = 0; i < n; i++) v[i] = *(const T*)zones[idx[i]];   \
+    else                                                                \
+      for (size_t i = 0; i < n; i++) v[i] = *(const T*)zones[i];        \
+  }                                                                     \
+  static void zone_scatter_##T(FAUSTFLOATX *const *zones,               \
+                               const size_t *idx, size_t n,             \
+                               const FAUSTFLOAT *v)                     \
+  {                                                                     \
+    for (size_t i = 0; i < n; i++) *(T*)zones[idx[i]] = v[idx[i]];      \
+  }                                                                     \
+  static const t_faust_zone_ops zone_ops_##T = {                        \
+    zone_get_##T, zone_set_##T, zone_gather_##T, zone_scatter_##T       \
+  };
+
+FAUST_ZONE_OPS(float)
+FAUST_ZONE_OPS(double)
+
+// Control table. This keeps the data of the ui elements that the periodic
+// scans (passive control output, state save/restore) need in contiguous
+// arrays, in the order of the ui list, along with index lists of the passive
+// controls which have bindings, so that these scans touch only the controls
+// they are interested in. The table is rebuilt after each compilation; the
+// saved values live here while the dsp is running, and are copied back to
+// the ui elements in faust_ui_manager_prepare_changes.
+typedef struct _faust_ctltab {
+  size_t n;
+  struct _faust_ui **uis;
+  FAUSTFLOATX **zones;
+  FAUSTFLOAT *min, *max, *init, *step;
+  int *type;
+  FAUSTFLOAT *saved;  // saved state (save_states/restore_states)
+  FAUSTFLOAT *values; // scratch space for gathered zone values
+  uint32_t *dirty;    // scratch space for change bitmaps
+  uint32_t *guidirty; // controls written behind the gui's back (n bits)
+  size_t nactive, *active;   // active controls, except voice controls
+  size_t npassive, *passive; // passive controls with a gui
+  size_t nmidiout, *midiout; // passive controls with MIDI bindings
+  size_t noscout, *oscout;   // passive controls with OSC bindings
+  // Zone values at the time of the last gui update, MIDI and OSC output,
+  // indexed like the corresponding lists above. Only the controls whose
+  // values differ from these need to be looked at.
+  FAUSTFLOAT *guishadow, *midishadow, *oscshadow;
+  // Minimum changes which count as a change in these comparisons, computed
+  // from the delta settings of the ui manager and the control ranges.
+  FAUSTFLOAT *guithr, *midithr, *oscthr;
+} t_faust_ctltab;
+
+#define DIRTY_WORDS(n) (((n)+31)/32)
+
+// ag: Shared-memory parameter block, see faust_ui_manager_shm_open. The block
+// consists of a header, followed by the descriptions of the n controls (in
+// control table order) and their n values. External writers update the
+// values using a seqlock protocol: increment seq (making it odd), write the
+// values, increment seq again (making it even). The layout counter is bumped
+// whenever the block is rebuilt after a recompile, at which point writers
+// have to remap the block and read the new control descriptions.
+#define FAUST_SHM_MAGIC   "FAUSTSHM"
+#define FAUST_SHM_VERSION 1
+#define FAUST_SHM_NAMELEN 64
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t n;      // number of controls
+  uint32_t seq;    // seqlock counter, odd while a writer is active
+  uint32_t layout; // layout counter
+} t_faust_shm_header;
+
+typedef struct {
+  char name[FAUST_SHM_NAMELEN]; // long name of the control
+  int32_t type, pad;            // 0 = button, 1 = toggle, 2 = number, 3 = bargraph
+  double min, max, init;
+} t_faust_shm_control;
+
+typedef struct {
+  t_symbol *name;     // shm object name (NULL if none)
+  void *base;         // mapped block
+  size_t size, n;
+  double *values;     // values in the mapped block
+  uint32_t seq;       // last sequence number read
+  double *snap;       // snapshot of the values, last values applied
+  size_t nchanged, *changed; // slots changed by the last poll
+  double *next;       // their new values, while the poll is in progress
+} t_faust_shm;
+
+// Open-addressing hash table keyed by symbols. Symbols are unique, so we can
+// simply hash the pointers. The table is kept at most half full, and the
+// first value stored under a given key wins.
+typedef struct _faust_symtab {
+  size_t h_size; // number of slots (a power of 2, 0 if empty)
+  const t_symbol **h_keys;
+  void **h_vals;
+} t_faust_symtab;
+
+static size_t faust_symtab_hash(const t_symbol *s)
+{
+  size_t h = (size_t)((uintptr_t)s >> 3);
+  h ^= h >> 16;
+  h *= 0x45d9f3bu;
+  h ^= h >> 16;
+  return h;
+}
+
+static void faust_symtab_free(t_faust_symtab *t)
+{
+  if (t->h_size) {
+    freebytes(t->h_keys, t->h_size*sizeof(t_symbol*));
+    freebytes(t->h_vals, t->h_size*sizeof(void*));
+  }
+  t->h_keys = NULL;
+  t->h_vals = NULL;
+  t->h_size = 0;
+}
+
+// (Re)initialize the table so that it can hold n keys.
+static bool faust_symtab_init(t_faust_symtab *t, size_t n)
+{
+  size_t size = 8;
+  faust_symtab_free(t);
+  if (!n) return true;
+  while (size < 2*n) size *= 2;
+  t->h_keys = getzbytes(size*sizeof(t_symbol*));
+  t->h_vals = getzbytes(size*sizeof(void*));
+  if (!t->h_keys || !t->h_vals) {
+    if (t->h_keys) freebytes(t->h_keys, size*sizeof(t_symbol*));
+    if (t->h_vals) freebytes(t->h_vals, size*sizeof(void*));
+    t->h_keys = NULL;
+    t->h_vals = NULL;
+    return false;
+  }
+  t->h_size = size;
+  return true;
+}
+
+static void faust_symtab_insert(t_faust_symtab *t, const t_symbol *key, void *val)
+{
+  size_t i, mask = t->h_size-1;
+  if (!t->h_size) return;
+  for (i = faust_symtab_hash(key) & mask; t->h_keys[i]; i = (i+1) & mask)
+    if (t->h_keys[i] == key) return;
+  t->h_keys[i] = key;
+  t->h_vals[i] = val;
+}
+
+static void *faust_symtab_lookup(const t_faust_symtab *t, const t_symbol *key)
+{
+  size_t i, mask = t->h_size-1;
+  if (!t->h_size) return NULL;
+  for (i = faust_symtab_hash(key) & mask; t->h_keys[i]; i = (i+1) & mask)
+    if (t->h_keys[i] == key) return t->h_vals[i];
+  return NULL;
+}
+
+// Record of the objects generated in the GUI subpatch, which lets us update
+// the GUI incrementally after recompiling, see faust_ui_manager_gui.
+typedef struct {
+  t_symbol *lname, *name; // long and short name of the control
+  int type;
+  FAUSTFLOAT min, max;
+  int y; // position in the subpatch
+  int nobjs;
+  t_gobj *objs[2];
+} t_faust_gui_item;
+
+enum { GUI_PANIC, GUI_INIT, GUI_ACTIVE, GUI_PREV, GUI_NEXT, N_GUI_SPECIAL };
+
+typedef struct {
+  t_glist *canvas; // the subpatch (NULL if none)
+  t_symbol *unique_name, *instance_name;
+  int ht; // height of the GOP area
+  size_t n;
+  t_faust_gui_item *items;
+  // panic (if any), init and active controls, page controls (if any)
+  t_gobj *special[N_GUI_SPECIAL];
+  // paging (page_size = 0 means that all controls are shown)
+  int page_size, page;
+} t_faust_gui_rec;
+
 // keep track of voice controls
 typedef struct _faust_voice {
   int num; // current note playing, if any
+  int chan; // and its MIDI channel (-1 if none)
   struct _faust_ui *freq_c, *gain_c, *gate_c;
   struct _faust_voice *next_free, *next_used;
 } t_faust_voice;
@@ -192,24 +510,171 @@ typedef struct _faust_key {
   struct _faust_key *next;
 } t_faust_key;
 
+// Soundfile zone of the dsp, and the (possibly still loading) sound for it.
+typedef struct {
+  struct Soundfile **zone;
+  t_faust_sound *sound;
+  bool pending; // still loading
+  bool quiet;   // don't report errors
+} t_faust_sound_ui;
+
+// Preset bank. Each slot holds the values of all controls as a dense array
+// aligned with the control table; names are the long names of the controls
+// in this layout, so that the presets can be carried over to a recompiled
+// dsp (see faust_ui_manager_update_bank).
+typedef struct {
+  size_t n;            // number of controls
+  t_symbol **names;    // their long names
+  size_t nslots;
+  FAUSTFLOAT **slots;  // NULL = empty slot
+} t_faust_bank;
+
+// Preset morph in progress: the values of the two presets, scratch space for
+// the interpolated values, and the position (0..1) and its increment per
+// sample. A morph is in progress if n > 0.
+typedef struct {
+  size_t n;
+  FAUSTFLOAT *from, *to, *v;
+  double pos, inc;
+} t_faust_morph;
+
+// Parameter ramps in progress: the table slot of the control, its target
+// value and the remaining time in msecs. These are kept in a compact list,
+// along with the index of the ramp of each control (SIZE_MAX if none).
+typedef struct {
+  size_t slot;
+  FAUSTFLOAT target;
+  double time;
+} t_faust_ramp;
+
+// Automation lane: control changes recorded to or played back from a file,
+// see faust_ui_manager_auto_record and faust_ui_manager_auto_play. The events
+// pass through a ring buffer of AUTO_RING entries (a power of 2), which is
+// filled or drained by faust_ui_manager_auto_flush. The controls are given by
+// their index in names (the long names of the controls in the file); slots
+// maps these to the table slots and ctls vice versa (SIZE_MAX if there's no
+// such control), these are rebuilt after each compilation.
+#define AUTO_RING 8192
+enum { AUTO_IDLE, AUTO_RECORD, AUTO_PLAY };
+
+typedef struct {
+  uint64_t time;       // sample time
+  uint32_t ctl;        // index into names
+  FAUSTFLOAT value;
+  float ms;            // ramp time (0 if the value is set right away)
+} t_faust_auto_event;
+
+typedef struct {
+  int state;
+  FILE *fp;
+  t_symbol **names;
+  size_t n;
+  size_t *slots, *ctls;
+  size_t nctls;
+  t_faust_auto_event *ring;
+  size_t head, tail;   // ring positions (not masked)
+  uint64_t pos;        // sample time of the next dsp block
+  int nsamples;        // size of the last dsp block
+  double systime;      // logical time of the last dsp block
+  double sr;
+  uint64_t last;       // time of the last event written or read
+  uint64_t start;      // playback: start time of the current pass
+  long data;           // playback: file offset of the first event
+  bool loop, eof;
+  size_t dropped;      // recording: events lost to a full ring buffer
+} t_faust_auto;
+
+// names of controls to be connected to signal inlets or outlets
+typedef struct {
+  t_symbol **names;
+  size_t n, size;
+} t_faust_signames;
+
+static void faust_signames_free(t_faust_signames *s)
+{
+  if (s->names) freebytes(s->names, s->size*sizeof(t_symbol*));
+  s->names = NULL;
+  s->n = s->size = 0;
+}
+
 typedef struct _faust_ui_manager
 {
     UIGlue      f_glue;
     t_object*   f_owner;
     t_faust_ui* f_uis;
     size_t      f_nuis;
+    t_faust_ctltab f_ctl;
+    // short and long names of the elements in f_uis, rebuilt after each
+    // compilation
+    t_faust_symtab f_lookup;
+    // MIDI bindings of the active controls, rebuilt after each compilation
+    t_faust_midi_entry* f_midi_index;
+    size_t      f_nmidi_index;
+    // OSC bindings of the active controls, rebuilt after each compilation;
+    // the hash tables map OSC addresses and prefixes to the first matching
+    // entry in f_osc_index
+    t_faust_osc_entry* f_osc_index;
+    size_t      f_nosc_index;
+    t_faust_symtab f_osc_exact, f_osc_prefix;
+    // name families, rebuilt after each compilation; the hash table maps
+    // the name prefixes to the entries in f_families
+    t_faust_family* f_families;
+    size_t      f_nfamilies;
+    t_faust_symtab f_family_lookup;
+    // GUI objects in the instance subpatch
+    t_faust_gui_rec f_gui;
+    // shared-memory parameter block (if any)
+    t_faust_shm f_shm;
+    // presets
+    t_faust_bank f_bank;
+    t_faust_morph f_morph;
+    // table slots of the controls named in the last saved state that was
+    // loaded, see faust_ui_manager_load_state
+    size_t*     f_statemap;
+    size_t      f_nstatemap;
+    // parameter ramps, rebuilt after each compilation
+    t_faust_ramp* f_ramps;
+    size_t*     f_rampidx;
+    size_t      f_nramps, f_maxramps;
+    // automation lane
+    t_faust_auto f_auto;
+    // controls driven by signal inlets and fed to signal outlets: the names
+    // requested by the owner (kept across compilations), and the table slots
+    // of the matching controls (rebuilt after each compilation)
+    t_faust_signames f_signames_in, f_signames_out;
+    size_t*     f_sigins;
+    FAUSTFLOAT* f_sigvals; // last values read from the signals
+    size_t      f_nsigins;
+    size_t*     f_sigouts;
+    size_t      f_nsigouts;
     t_symbol**  f_names;
     size_t      f_nnames;
     MetaGlue    f_meta_glue;
     bool        f_isdouble;
+    const t_faust_zone_ops *f_zone; // accessors for f_isdouble
     bool        f_quiet;
     bool        f_midi, f_osc;
+    // minimum changes of passive controls for output, as a fraction of
+    // the control range (0 = any change)
+    double      f_gui_delta, f_midi_delta, f_osc_delta;
     // new-style polyphony
     int         f_nvoices;
     t_faust_voice *f_voices, *f_free, *f_used;
     t_faust_key *f_keys;
     t_faust_ui_proxy *f_panic_recv, *f_init_recv, *f_active_recv;
-    t_float *f_tuning;
+    t_faust_ui_proxy *f_prev_recv, *f_next_recv;
+    t_faust_tuning *f_tuning;
+    // soundfiles of the dsp instance, see faust_ui_manager_ui_add_sound_file
+    t_faust_sound_ui* f_sounds;
+    size_t      f_nsounds;
+    void*       f_dsp;
+    t_clock*    f_sound_clock;
+    // page flips requested from the GUI, carried out by f_page_clock
+    t_clock*    f_page_clock;
+    int         f_page_delta;
+    // lazy GUI, see faust_ui_manager_gui_watch
+    t_faust_gui_sentinel* f_sentinel;
+    t_canvas*   f_canvas;
     // old-style polyphony (nvoices meta data), >0 when set
     int         f_npoly;
     struct _faust_ui *freq_c, *gain_c, *gate_c;
@@ -297,6 +762,7 @@ static void faust_new_voices(t_faust_ui_manager *x)
       else
         x->f_voices[i].next_free = NULL;
       x->f_voices[i].next_used = NULL;
+      x->f_voices[i].chan = -1;
     }
     x->f_used = NULL;
   }
@@ -304,14 +770,94 @@ static void faust_new_voices(t_faust_ui_manager *x)
 
 static void faust_ui_free(t_faust_ui *c)
 {
-  if (c->p_midi)
+  if (c->p_midi) {
+    for (size_t i = 0; i < c->p_nmidi; i++)
+      if (c->p_midi[i].table)
+        faust_midi_table_release(c->p_midi[i].table);
     freebytes(c->p_midi, c->p_nmidi*sizeof(t_faust_midi_ui));
+  }
   if (c->p_osc)
     freebytes(c->p_osc, c->p_nosc*sizeof(t_faust_osc_ui));
   if (c->p_uirecv)
     faust_ui_receive_free(c->p_uirecv);
 }
 
+static void faust_ui_manager_free_osc_index(t_faust_ui_manager *x)
+{
+  if (x->f_osc_index) {
+    freebytes(x->f_osc_index, x->f_nosc_index*sizeof(t_faust_osc_entry));
+    x->f_osc_index = NULL;
+    x->f_nosc_index = 0;
+  }
+  faust_symtab_free(&x->f_osc_exact);
+  faust_symtab_free(&x->f_osc_prefix);
+}
+
+static void faust_ui_manager_free_families(t_faust_ui_manager *x)
+{
+  if (x->f_families) {
+    for (size_t i = 0; i < x->f_nfamilies; i++)
+      freebytes(x->f_families[i].uis,
+                x->f_families[i].n*sizeof(t_faust_ui*));
+    freebytes(x->f_families, x->f_nfamilies*sizeof(t_faust_family));
+    x->f_families = NULL;
+    x->f_nfamilies = 0;
+  }
+  faust_symtab_free(&x->f_family_lookup);
+}
+
+static void faust_ctltab_free(t_faust_ctltab *t)
+{
+  if (t->n) {
+    freebytes(t->uis, t->n*sizeof(t_faust_ui*));
+    freebytes(t->zones, t->n*sizeof(FAUSTFLOATX*));
+    freebytes(t->min, t->n*sizeof(FAUSTFLOAT));
+    freebytes(t->max, t->n*sizeof(FAUSTFLOAT));
+    freebytes(t->init, t->n*sizeof(FAUSTFLOAT));
+    freebytes(t->step, t->n*sizeof(FAUSTFLOAT));
+    freebytes(t->type, t->n*sizeof(int));
+    freebytes(t->saved, t->n*sizeof(FAUSTFLOAT));
+    freebytes(t->values, t->n*sizeof(FAUSTFLOAT));
+    freebytes(t->dirty, DIRTY_WORDS(t->n)*sizeof(uint32_t));
+    freebytes(t->guidirty, DIRTY_WORDS(t->n)*sizeof(uint32_t));
+    freebytes(t->guishadow, t->n*sizeof(FAUSTFLOAT));
+    freebytes(t->midishadow, t->n*sizeof(FAUSTFLOAT));
+    freebytes(t->oscshadow, t->n*sizeof(FAUSTFLOAT));
+    freebytes(t->guithr, t->n*sizeof(FAUSTFLOAT));
+    freebytes(t->midithr, t->n*sizeof(FAUSTFLOAT));
+    freebytes(t->oscthr, t->n*sizeof(FAUSTFLOAT));
+    freebytes(t->passive, t->n*sizeof(size_t));
+    freebytes(t->midiout, t->n*sizeof(size_t));
+    freebytes(t->oscout, t->n*sizeof(size_t));
+    freebytes(t->active, t->n*sizeof(size_t));
+  }
+  memset(t, 0, sizeof(t_faust_ctltab));
+}
+
+static void faust_ui_manager_free_signals(t_faust_ui_manager *x);
+
+static void faust_ui_manager_free_statemap(t_faust_ui_manager *x)
+{
+    if(x->f_statemap)
+    {
+        freebytes(x->f_statemap, x->f_nstatemap*sizeof(size_t));
+    }
+    x->f_statemap = NULL;
+    x->f_nstatemap = 0;
+}
+
+static void faust_ui_manager_free_ramps(t_faust_ui_manager *x)
+{
+    if(x->f_ramps)
+    {
+        freebytes(x->f_ramps, x->f_maxramps*sizeof(t_faust_ramp));
+        freebytes(x->f_rampidx, x->f_maxramps*sizeof(size_t));
+    }
+    x->f_ramps = NULL;
+    x->f_rampidx = NULL;
+    x->f_nramps = x->f_maxramps = 0;
+}
+
 static void faust_ui_manager_free_uis(t_faust_ui_manager *x)
 {
     t_faust_ui *c = x->f_uis;
@@ -322,21 +868,454 @@ static void faust_ui_manager_free_uis(t_faust_ui_manager *x)
         freebytes(c, sizeof(*c));
         c = x->f_uis;
     }
+    faust_ctltab_free(&x->f_ctl);
+    faust_symtab_free(&x->f_lookup);
+    faust_ui_manager_free_signals(x);
+    faust_ui_manager_free_ramps(x);
+    faust_ui_manager_free_statemap(x);
+    if(x->f_midi_index)
+    {
+        freebytes(x->f_midi_index, x->f_nmidi_index*sizeof(t_faust_midi_entry));
+        x->f_midi_index = NULL;
+        x->f_nmidi_index = 0;
+    }
+    faust_ui_manager_free_osc_index(x);
+    faust_ui_manager_free_families(x);
     faust_free_voices(x);
 }
 
+// Note that while the ui is being rebuilt, the lookup table still refers to
+// the elements of the previous compilation, which is exactly what
+// faust_ui_manager_add_param needs to pick up the previous values.
 static t_faust_ui* faust_ui_manager_get(t_faust_ui_manager const *x, t_symbol const *name)
 {
-    t_faust_ui *c = x->f_uis;
-    while(c)
+    return (t_faust_ui*)faust_symtab_lookup(&x->f_lookup, name);
+}
+
+static int midi_entry_cmp(const void *a, const void *b)
+{
+  const t_faust_midi_entry *e1 = a, *e2 = b;
+  if (e1->msg != e2->msg) return e1->msg < e2->msg ? -1 : 1;
+  if (e1->chan != e2->chan) return e1->chan < e2->chan ? -1 : 1;
+  if (e1->num != e2->num) return e1->num < e2->num ? -1 : 1;
+  if (e1->seq != e2->seq) return e1->seq < e2->seq ? -1 : 1;
+  return 0;
+}
+
+// Build the MIDI dispatch index, which lists the MIDI bindings of all active
+// controls keyed by message type, channel and note/controller number. This
+// lets faust_ui_manager_get_midi find the bindings matching a MIDI message
+// with a binary search, rather than having to scan through all the controls.
+static void faust_ui_manager_update_midi_index(t_faust_ui_manager *x)
+{
+  t_faust_ui *c;
+  size_t n = 0;
+  if (x->f_midi_index) {
+    freebytes(x->f_midi_index, x->f_nmidi_index*sizeof(t_faust_midi_entry));
+    x->f_midi_index = NULL;
+    x->f_nmidi_index = 0;
+  }
+  for (c = x->f_uis; c; c = c->p_next)
+    if (c->p_type != FAUST_UI_TYPE_BARGRAPH)
+      n += c->p_nmidi;
+  if (!n) return;
+  x->f_midi_index = getbytes(n*sizeof(t_faust_midi_entry));
+  if (!x->f_midi_index) {
+    if (!x->f_quiet) pd_error(x->f_owner, "faustgen2~: memory allocation failed - midi index");
+    return;
+  }
+  x->f_nmidi_index = n;
+  n = 0;
+  for (c = x->f_uis; c; c = c->p_next) {
+    if (c->p_type == FAUST_UI_TYPE_BARGRAPH) continue;
+    for (size_t j = 0; j < c->p_nmidi; j++, n++) {
+      t_faust_midi_entry *e = &x->f_midi_index[n];
+      e->msg = c->p_midi[j].msg;
+      e->chan = c->p_midi[j].chan;
+      // the number only matters for 2-argument messages (ctl, note etc.)
+      e->num = midi_argc[e->msg] > 1 ? c->p_midi[j].num : 0;
+      e->seq = n;
+      e->ui = c;
+      e->j = j;
+    }
+  }
+  qsort(x->f_midi_index, n, sizeof(t_faust_midi_entry), midi_entry_cmp);
+}
+
+static int osc_entry_cmp(const void *a, const void *b)
+{
+  const t_faust_osc_entry *e1 = a, *e2 = b;
+  // exact entries go first
+  if ((e1->k < 0) != (e2->k < 0)) return e1->k < 0 ? -1 : 1;
+  if (e1->key != e2->key)
+    return (uintptr_t)e1->key < (uintptr_t)e2->key ? -1 : 1;
+  if (e1->seq != e2->seq) return e1->seq < e2->seq ? -1 : 1;
+  return 0;
+}
+
+// Build the OSC dispatch index. This is the OSC counterpart of the MIDI
+// index above; here the matching entries are found with a hash lookup on
+// the message selector.
+static void faust_ui_manager_update_osc_index(t_faust_ui_manager *x)
+{
+  t_faust_ui *c;
+  size_t n = 0, m = 0;
+  faust_ui_manager_free_osc_index(x);
+  for (c = x->f_uis; c; c = c->p_next)
+    if (c->p_type != FAUST_UI_TYPE_BARGRAPH)
+      n += c->p_nosc;
+  if (!n) return;
+  // We need at most two entries per binding.
+  x->f_osc_index = getbytes(2*n*sizeof(t_faust_osc_entry));
+  if (!x->f_osc_index ||
+      !faust_symtab_init(&x->f_osc_exact, n) ||
+      !faust_symtab_init(&x->f_osc_prefix, n)) {
+    if (x->f_osc_index)
+      freebytes(x->f_osc_index, 2*n*sizeof(t_faust_osc_entry));
+    x->f_osc_index = NULL;
+    faust_ui_manager_free_osc_index(x);
+    if (!x->f_quiet) pd_error(x->f_owner, "faustgen2~: memory allocation failed - osc index");
+    return;
+  }
+  for (c = x->f_uis; c; c = c->p_next) {
+    if (c->p_type == FAUST_UI_TYPE_BARGRAPH) continue;
+    for (size_t j = 0; j < c->p_nosc; j++) {
+      const char *name = c->p_osc[j].msg->s_name;
+      const char *p = strrchr(name, '/');
+      t_faust_osc_entry *e = &x->f_osc_index[m++];
+      int k, l;
+      e->key = c->p_osc[j].msg;
+      e->k = -1;
+      e->seq = m;
+      e->ui = c;
+      e->j = j;
+      // Check for an address of the form /prefix/N, to be matched by the
+      // multi-argument message /prefix.
+      if (p && p > name && sscanf(p+1, "%d%n", &k, &l) == 1 &&
+          p[l+1] == 0 && k >= 0) {
+        char prefix[MAXFAUSTSTRING];
+        size_t len = p-name;
+        if (len < MAXFAUSTSTRING) {
+          memcpy(prefix, name, len);
+          prefix[len] = 0;
+          e = &x->f_osc_index[m++];
+          e->key = gensym(prefix);
+          e->k = k;
+          e->seq = m;
+          e->ui = c;
+          e->j = j;
+        }
+      }
+    }
+  }
+  if (m < 2*n) {
+    x->f_osc_index = resizebytes(x->f_osc_index,
+                                 2*n*sizeof(t_faust_osc_entry),
+                                 m*sizeof(t_faust_osc_entry));
+  }
+  x->f_nosc_index = m;
+  qsort(x->f_osc_index, m, sizeof(t_faust_osc_entry), osc_entry_cmp);
+  // The entries are sorted, so the first one entered for each key is the
+  // start of its range.
+  for (size_t i = 0; i < m; i++) {
+    t_faust_osc_entry *e = &x->f_osc_index[i];
+    faust_symtab_insert(e->k < 0 ? &x->f_osc_exact : &x->f_osc_prefix,
+                        e->key, e);
+  }
+}
+
+typedef struct {
+  const t_symbol *prefix;
+  int num;
+  t_faust_ui *ui;
+} t_faust_member;
+
+static int member_cmp(const void *a, const void *b)
+{
+  const t_faust_member *m1 = a, *m2 = b;
+  if (m1->prefix != m2->prefix)
+    return (uintptr_t)m1->prefix < (uintptr_t)m2->prefix ? -1 : 1;
+  if (m1->num != m2->num) return m1->num < m2->num ? -1 : 1;
+  return 0;
+}
+
+// Count the ways in which the given name can be written as prefix+%i, or
+// actually enter these into the members array if it is non-NULL. This
+// follows the way list messages have always constructed the names of their
+// targets, so that, e.g., gain12 is both member 12 of gain and member 2 of
+// gain1, while gain012 can only be member 12 of gain0.
+#define MAX_FAMILY_DIGITS 9
+static size_t family_members(const t_symbol *name, t_faust_ui *ui,
+                             t_faust_member *members)
+{
+  const char *s = name->s_name;
+  size_t len = strlen(s), l = len, n = 0;
+  char prefix[MAXFAUSTSTRING];
+  if (len >= MAXFAUSTSTRING) return 0;
+  while (l > 0 && len-l < MAX_FAMILY_DIGITS && isdigit((unsigned char)s[l-1]))
+    l--;
+  for (size_t i = l; i < len; i++) {
+    // s[i..] is the suffix, which can't have a leading zero unless it is 0
+    int num;
+    if (s[i] == '0' && i+1 < len) continue;
+    num = atoi(s+i);
+    if (i > 0) {
+      if (members) {
+        memcpy(prefix, s, i); prefix[i] = 0;
+        members[n].prefix = gensym(prefix);
+        members[n].num = num;
+        members[n].ui = ui;
+      }
+      n++;
+    }
+    if (i > 1 && s[i-1] == '-' && num > 0) {
+      // negative suffix
+      if (members) {
+        memcpy(prefix, s, i-1); prefix[i-1] = 0;
+        members[n].prefix = gensym(prefix);
+        members[n].num = -num;
+        members[n].ui = ui;
+      }
+      n++;
+    }
+  }
+  return n;
+}
+
+// Build the name families. We use the name lookup table here, so that the
+// family members are exactly the controls faust_ui_manager_get would find.
+static void faust_ui_manager_update_families(t_faust_ui_manager *x)
+{
+  t_faust_symtab *t = &x->f_lookup;
+  t_faust_member *members;
+  size_t i, n = 0, m = 0;
+  faust_ui_manager_free_families(x);
+  for (i = 0; i < t->h_size; i++)
+    if (t->h_keys[i])
+      n += family_members(t->h_keys[i], t->h_vals[i], NULL);
+  if (!n) return;
+  members = getbytes(n*sizeof(t_faust_member));
+  x->f_families = getbytes(n*sizeof(t_faust_family));
+  if (!members || !x->f_families || !faust_symtab_init(&x->f_family_lookup, n)) {
+    if (members) freebytes(members, n*sizeof(t_faust_member));
+    if (x->f_families) freebytes(x->f_families, n*sizeof(t_faust_family));
+    x->f_families = NULL;
+    faust_symtab_free(&x->f_family_lookup);
+    if (!x->f_quiet) pd_error(x->f_owner, "faustgen2~: memory allocation failed - name families");
+    return;
+  }
+  n = 0;
+  for (i = 0; i < t->h_size; i++)
+    if (t->h_keys[i])
+      n += family_members(t->h_keys[i], t->h_vals[i], members+n);
+  qsort(members, n, sizeof(t_faust_member), member_cmp);
+  for (i = 0; i < n; ) {
+    size_t j = i+1;
+    uint64_t span;
+    while (j < n && members[j].prefix == members[i].prefix) j++;
+    // Only create a family if the array isn't too sparse, otherwise we
+    // leave it to the slow path in faustgen~.
+    span = (uint64_t)((int64_t)members[j-1].num - members[i].num) + 1;
+    if (span <= 4*(j-i)+64) {
+      t_faust_family *f = &x->f_families[m];
+      f->uis = getzbytes(span*sizeof(t_faust_ui*));
+      if (f->uis) {
+        f->base = members[i].num;
+        f->n = span;
+        for (size_t k = i; k < j; k++)
+          f->uis[members[k].num - f->base] = members[k].ui;
+        faust_symtab_insert(&x->f_family_lookup, members[i].prefix, f);
+        m++;
+      }
+    }
+    i = j;
+  }
+  freebytes(members, n*sizeof(t_faust_member));
+  if (m) {
+    x->f_families = resizebytes(x->f_families, n*sizeof(t_faust_family),
+                                m*sizeof(t_faust_family));
+  } else {
+    freebytes(x->f_families, n*sizeof(t_faust_family));
+    x->f_families = NULL;
+  }
+  x->f_nfamilies = m;
+}
+
+// Find the range of index entries matching the given key.
+static size_t faust_ui_manager_find_midi(t_faust_ui_manager const *x,
+                                         int msg, int chan, int num,
+                                         size_t *end)
+{
+  t_faust_midi_entry key;
+  size_t lo = 0, hi = x->f_nmidi_index;
+  key.msg = msg; key.chan = chan; key.num = num; key.seq = 0;
+  while (lo < hi) {
+    size_t mid = lo + (hi-lo)/2;
+    if (midi_entry_cmp(&x->f_midi_index[mid], &key) < 0)
+      lo = mid+1;
+    else
+      hi = mid;
+  }
+  hi = lo;
+  while (hi < x->f_nmidi_index && x->f_midi_index[hi].msg == msg &&
+         x->f_midi_index[hi].chan == chan && x->f_midi_index[hi].num == num)
+    hi++;
+  *end = hi;
+  return lo;
+}
+
+static FAUSTFLOAT faustflt(const t_faust_ui_manager *x, FAUSTFLOATX *z);
+
+static void faust_ctltab_thresholds(const t_faust_ctltab *t, const size_t *idx,
+                                    size_t n, double delta, FAUSTFLOAT *thr)
+{
+  for (size_t k = 0; k < n; k++)
+    thr[k] = delta*fabs(t->max[idx[k]] - t->min[idx[k]]);
+}
+
+static void faust_ui_manager_update_thresholds(t_faust_ui_manager *x)
+{
+  const t_faust_ctltab *t = &x->f_ctl;
+  if (!t->n) return;
+  faust_ctltab_thresholds(t, t->passive, t->npassive, x->f_gui_delta, t->guithr);
+  faust_ctltab_thresholds(t, t->midiout, t->nmidiout, x->f_midi_delta, t->midithr);
+  faust_ctltab_thresholds(t, t->oscout, t->noscout, x->f_osc_delta, t->oscthr);
+}
+
+static void faust_ui_manager_update_ctltab(t_faust_ui_manager *x)
+{
+    t_faust_ctltab *t = &x->f_ctl;
+    t_faust_ui *c;
+    size_t i, n = 0;
+    faust_ctltab_free(t);
+    for(c = x->f_uis; c; c = c->p_next)
+    {
+        n++;
+    }
+    if(!n)
     {
-        if(c->p_name == name || c->p_longname == name)
+        return;
+    }
+    t->uis     = getbytes(n*sizeof(t_faust_ui*));
+    t->zones   = getbytes(n*sizeof(FAUSTFLOATX*));
+    t->min     = getbytes(n*sizeof(FAUSTFLOAT));
+    t->max     = getbytes(n*sizeof(FAUSTFLOAT));
+    t->init    = getbytes(n*sizeof(FAUSTFLOAT));
+    t->step    = getbytes(n*sizeof(FAUSTFLOAT));
+    t->type    = getbytes(n*sizeof(int));
+    t->saved   = getbytes(n*sizeof(FAUSTFLOAT));
+    t->values  = getbytes(n*sizeof(FAUSTFLOAT));
+    t->dirty   = getbytes(DIRTY_WORDS(n)*sizeof(uint32_t));
+    t->guidirty = getbytes(DIRTY_WORDS(n)*sizeof(uint32_t));
+    t->guishadow  = getbytes(n*sizeof(FAUSTFLOAT));
+    t->midishadow = getbytes(n*sizeof(FAUSTFLOAT));
+    t->oscshadow  = getbytes(n*sizeof(FAUSTFLOAT));
+    t->guithr  = getbytes(n*sizeof(FAUSTFLOAT));
+    t->midithr = getbytes(n*sizeof(FAUSTFLOAT));
+    t->oscthr  = getbytes(n*sizeof(FAUSTFLOAT));
+    t->passive = getbytes(n*sizeof(size_t));
+    t->midiout = getbytes(n*sizeof(size_t));
+    t->oscout  = getbytes(n*sizeof(size_t));
+    t->active  = getbytes(n*sizeof(size_t));
+    t->n = n;
+    if(!t->uis || !t->zones || !t->min || !t->max || !t->init || !t->step || !t->type ||
+       !t->saved || !t->values || !t->dirty || !t->guidirty || !t->passive || !t->midiout || !t->oscout ||
+       !t->guishadow || !t->midishadow || !t->oscshadow ||
+       !t->guithr || !t->midithr || !t->oscthr || !t->active)
+    {
+        // freebytes is fine with NULL pointers
+        faust_ctltab_free(t);
+        if (!x->f_quiet) pd_error(x->f_owner, "faustgen2~: memory allocation failed - ui table");
+        return;
+    }
+    for(c = x->f_uis, i = 0; c; c = c->p_next, i++)
+    {
+        c->p_slot    = i;
+        t->uis[i]    = c;
+        t->zones[i]  = c->p_zone;
+        t->min[i]    = c->p_min;
+        t->max[i]    = c->p_max;
+        t->init[i]   = c->p_default;
+        t->step[i]   = c->p_step;
+        t->type[i]   = c->p_type;
+        t->saved[i]  = c->p_saved;
+        if(c->p_type == FAUST_UI_TYPE_BARGRAPH)
+        {
+            // The MIDI and OSC shadows start out as NaN, so that all
+            // bindings are checked on the first scan.
+            c->p_pslot = t->npassive;
+            t->guishadow[t->npassive] = faustflt(x, c->p_zone);
+            t->passive[t->npassive++] = i;
+            if(c->p_nmidi)
+            {
+                t->midishadow[t->nmidiout] = NAN;
+                t->midiout[t->nmidiout++] = i;
+            }
+            if(c->p_nosc)
+            {
+                t->oscshadow[t->noscout] = NAN;
+                t->oscout[t->noscout++] = i;
+            }
+        }
+        else if(!c->p_voice)
         {
-            return c;
+            t->active[t->nactive++] = i;
         }
+    }
+    faust_ui_manager_update_thresholds(x);
+}
+
+// Compare the n zone values in v against their shadow copies, setting the
+// corresponding bits in dirty (n bits) for those which differ by more than
+// the given thresholds, and update the shadows of these. Returns the number
+// of bitmap words with changes. This is written so that the compiler can
+// vectorize the inner loop. Note that a NaN shadow always counts as a
+// change.
+static size_t faust_ctltab_diff(const FAUSTFLOAT *v, FAUSTFLOAT *shadow,
+                                const FAUSTFLOAT *thr, size_t n,
+                                uint32_t *dirty)
+{
+  size_t count = 0;
+  for (size_t w = 0; w < DIRTY_WORDS(n); w++) {
+    const size_t m = n-32*w < 32 ? n-32*w : 32;
+    const FAUSTFLOAT *a = v+32*w, *d = thr+32*w;
+    FAUSTFLOAT *b = shadow+32*w;
+    uint32_t bits = 0;
+    for (size_t i = 0; i < m; i++)
+      bits |= (uint32_t)!(fabs(a[i] - b[i]) <= d[i]) << i;
+    dirty[w] = bits;
+    if (bits) {
+      for (size_t i = 0; i < m; i++)
+        if (bits & (1u << i)) b[i] = a[i];
+      count++;
+    }
+  }
+  return count;
+}
+
+static void faust_ui_manager_update_lookup(t_faust_ui_manager *x)
+{
+    t_faust_ui *c = x->f_uis;
+    size_t n = 0;
+    while(c)
+    {
+        n++;
+        c = c->p_next;
+    }
+    if(!faust_symtab_init(&x->f_lookup, 2*n))
+    {
+        if (!x->f_quiet) pd_error(x->f_owner, "faustgen2~: memory allocation failed - ui lookup");
+        return;
+    }
+    // Elements are entered in list order, so that, as with a linear search,
+    // the first element with a matching short or long name wins.
+    c = x->f_uis;
+    while(c)
+    {
+        faust_symtab_insert(&x->f_lookup, c->p_name, c);
+        faust_symtab_insert(&x->f_lookup, c->p_longname, c);
         c = c->p_next;
     }
-    return NULL;
 }
 
 // Generic zone value accesses. Note that the actual floating point type of
@@ -351,18 +1330,12 @@ static t_faust_ui* faust_ui_manager_get(t_faust_ui_manager const *x, t_symbol co
 
 static FAUSTFLOAT faustflt(const t_faust_ui_manager *x, FAUSTFLOATX *z)
 {
-  if (x->f_isdouble)
-    return *(double*)z;
-  else
-    return *(float*)z;
+  return x->f_zone->get(z);
 }
 
 static FAUSTFLOAT setfaustflt(t_faust_ui_manager *x, FAUSTFLOATX *z, FAUSTFLOAT v)
 {
-  if (x->f_isdouble)
-    return (*(double*)z = v);
-  else
-    return (*(float*)z = v);
+  return x->f_zone->set(z, v);
 }
 
 static void faust_ui_manager_prepare_changes(t_faust_ui_manager *x, int isdbl)
@@ -375,6 +1348,10 @@ static void faust_ui_manager_prepare_changes(t_faust_ui_manager *x, int isdbl)
     {
         c->p_kept  = 0;
         c->p_tempv = faustflt(x, c->p_zone);
+        if(c->p_slot < x->f_ctl.n && x->f_ctl.uis[c->p_slot] == c)
+        {
+            c->p_saved = x->f_ctl.saved[c->p_slot];
+        }
         c = c->p_next;
     }
     x->f_nuis = 0;
@@ -383,10 +1360,14 @@ static void faust_ui_manager_prepare_changes(t_faust_ui_manager *x, int isdbl)
     // compilation, depending on the compilation options (specifically,
     // whether -double is used or not).
     x->f_isdouble = isdbl;
+    x->f_zone = isdbl ? &zone_ops_double : &zone_ops_float;
     x->f_midi = x->f_osc = true;
     faust_free_voices(x);
     last_meta.n_midi = 0;
     last_meta.voice = VOICE_NONE;
+    last_meta.signal = false;
+    last_meta.smooth = 0.0;
+    last_meta.scale = SCALE_LIN;
     last_meta.n_osc = 0;
 }
 
@@ -425,6 +1406,14 @@ static void faust_ui_manager_sort(t_faust_ui_manager *x)
   }
 }
 
+static void faust_ui_manager_update_shm(t_faust_ui_manager *x);
+static void faust_ui_manager_update_signals(t_faust_ui_manager *x);
+static void faust_ui_manager_update_bank(t_faust_ui_manager *x);
+static void faust_ui_manager_update_ramps(t_faust_ui_manager *x);
+static void faust_ui_manager_update_auto(t_faust_ui_manager *x);
+static void faust_bank_free(t_faust_bank *b);
+static void faust_morph_free(t_faust_morph *m);
+
 static void faust_ui_manager_finish_changes(t_faust_ui_manager *x)
 {
     t_faust_ui *c = x->f_uis;
@@ -456,6 +1445,16 @@ static void faust_ui_manager_finish_changes(t_faust_ui_manager *x)
         faust_ui_manager_sort(x);
         faust_new_voices(x);
     }
+    faust_ui_manager_update_ctltab(x);
+    faust_ui_manager_update_lookup(x);
+    faust_ui_manager_update_midi_index(x);
+    faust_ui_manager_update_osc_index(x);
+    faust_ui_manager_update_families(x);
+    faust_ui_manager_update_shm(x);
+    faust_ui_manager_update_signals(x);
+    faust_ui_manager_update_bank(x);
+    faust_ui_manager_update_ramps(x);
+    faust_ui_manager_update_auto(x);
 }
 
 static void faust_ui_manager_free_names(t_faust_ui_manager *x)
@@ -550,7 +1549,10 @@ static t_symbol* faust_ui_manager_get_name(t_faust_ui_manager *x, const char* la
 }
 
 static int midi_defaultval(FAUSTFLOAT z, FAUSTFLOAT p_min, FAUSTFLOAT p_max,
-                           int p_type, int msg);
+                           int p_type, int p_scale, int msg);
+static void faust_midi_ui_table(t_faust_midi_ui *m, int p_type, int p_scale,
+                                FAUSTFLOAT p_min, FAUSTFLOAT p_max,
+                                FAUSTFLOAT p_step);
 static int osc_defaultval(FAUSTFLOAT z, FAUSTFLOAT p_min, FAUSTFLOAT p_max,
                           int p_type, double a, double b);
 
@@ -598,8 +1600,15 @@ static void faust_ui_manager_add_param(t_faust_ui_manager *x, const char* label,
     c->p_midi      = NULL;
     c->p_nmidi     = 0;
     c->p_voice     = VOICE_NONE;
+    c->p_signal    = false;
+    c->p_smooth    = 0.0;
+    c->p_scale     = SCALE_LIN;
     setfaustflt(x, c->p_zone, current);
     if (last_meta.zone == zone) {
+      c->p_signal = last_meta.signal;
+      c->p_scale = last_meta.scale;
+      if (c->p_type == FAUST_UI_TYPE_NUMBER)
+        c->p_smooth = last_meta.smooth;
       if (last_meta.voice) {
         if (c->p_type != FAUST_UI_TYPE_BARGRAPH) {
           c->p_voice = last_meta.voice;
@@ -640,7 +1649,11 @@ static void faust_ui_manager_add_param(t_faust_ui_manager *x, const char* label,
             c->p_midi[i].num  = last_meta.midi[i].num;
             c->p_midi[i].chan = last_meta.midi[i].chan;
             c->p_midi[i].val  = midi_defaultval(init, min, max, type,
-                                                c->p_midi[i].msg);
+                                                c->p_scale, c->p_midi[i].msg);
+            c->p_midi[i].table = NULL;
+            if (type != FAUST_UI_TYPE_BARGRAPH)
+              faust_midi_ui_table(&c->p_midi[i], type, c->p_scale,
+                                  min, max, step);
           }
         } else if (!x->f_quiet) {
           pd_error(x->f_owner, "faustgen2~: memory allocation failed - ui midi");
@@ -669,6 +1682,9 @@ static void faust_ui_manager_add_param(t_faust_ui_manager *x, const char* label,
     }
     last_meta.n_osc = last_meta.n_midi = 0;
     last_meta.voice = VOICE_NONE;
+    last_meta.signal = false;
+    last_meta.smooth = 0.0;
+    last_meta.scale = SCALE_LIN;
     // old-style polyphony
     if (strcmp(name->s_name, "freq") == 0) {
       x->freq_c = c;
@@ -775,9 +1791,85 @@ static void faust_ui_manager_ui_add_bargraph(t_faust_ui_manager* x, const char*
     faust_ui_manager_add_param(x, label, FAUST_UI_TYPE_BARGRAPH, zone, 0, min, max, 0);
 }
 
+// ag: Polling interval for soundfiles being loaded (msecs).
+#define SOUND_POLL 20
+
+// Hand the soundfiles which have finished loading to the dsp.
+static void faust_ui_manager_sound_tick(t_faust_ui_manager* x)
+{
+    bool pending = false;
+    for(size_t i = 0; i < x->f_nsounds; i++)
+    {
+        t_faust_sound_ui *snd = &x->f_sounds[i];
+        struct Soundfile *sf;
+        int ret;
+        if(!snd->pending) continue;
+        ret = faust_sound_poll(snd->sound, &sf);
+        if(ret > 0)
+        {
+            *snd->zone = sf;
+            snd->pending = false;
+            if(!snd->quiet) logpost(x->f_owner, 3, "faustgen2~: soundfile %s loaded", faust_sound_get_name(snd->sound));
+        }
+        else if(ret < 0)
+        {
+            snd->pending = false;
+            if(!snd->quiet) pd_error(x->f_owner, "faustgen2~: soundfile %s: %s", faust_sound_get_name(snd->sound), faust_sound_get_error(snd->sound));
+        }
+        else
+        {
+            pending = true;
+        }
+    }
+    if(pending)
+    {
+        clock_delay(x->f_sound_clock, SOUND_POLL);
+    }
+}
+
+static void faust_sound_list_free(t_faust_sound_ui *sounds, size_t n)
+{
+    for(size_t i = 0; i < n; i++)
+    {
+        faust_sound_free(sounds[i].sound);
+    }
+    if(sounds)
+    {
+        freebytes(sounds, n*sizeof(t_faust_sound_ui));
+    }
+}
+
+// The sound is shared by all instances and voices using the same files (see
+// faust_tilde_sound.h). The dsp gets a silent soundfile until it has been
+// loaded.
 static void faust_ui_manager_ui_add_sound_file(t_faust_ui_manager* x, const char* label, const char* filename, struct Soundfile** sf_zone)
 {
-    if (!x->f_quiet) pd_error(x->f_owner, "faustgen2~: add sound file not supported yet");
+    t_faust_sound_ui *sounds;
+    t_faust_sound *sound;
+    *sf_zone = faust_sound_empty(x->f_isdouble);
+    // no url, the label is the file name
+    sound = faust_sound_load(x->f_quiet ? NULL : x->f_owner, x->f_canvas,
+                             filename && *filename ? filename : label, x->f_isdouble);
+    if(!sound)
+    {
+        return;
+    }
+    sounds = (t_faust_sound_ui*)resizebytes(x->f_sounds, x->f_nsounds*sizeof(t_faust_sound_ui),
+                                            (x->f_nsounds+1)*sizeof(t_faust_sound_ui));
+    if(!sounds)
+    {
+        faust_sound_free(sound);
+        if (!x->f_quiet) pd_error(x->f_owner, "faustgen2~: memory allocation failed - soundfile");
+        return;
+    }
+    x->f_sounds = sounds;
+    sounds[x->f_nsounds].zone = sf_zone;
+    sounds[x->f_nsounds].sound = sound;
+    sounds[x->f_nsounds].pending = true;
+    sounds[x->f_nsounds].quiet = x->f_quiet;
+    x->f_nsounds++;
+    // this picks up sounds which are already in the cache right away
+    faust_ui_manager_sound_tick(x);
 }
 
 // DECLARE UIS
@@ -787,7 +1879,29 @@ static void faust_ui_manager_ui_declare(t_faust_ui_manager* x, FAUSTFLOAT* zone,
 {
   if (zone && value && *value) {
     //if (!x->f_quiet) logpost(x->f_owner, 3, "             %s: %s (%p)", key, value, zone);
-    if (strcmp(key, "voice") == 0) {
+    if (strcmp(key, "pd") == 0) {
+      // Pd-specific options
+      if (strcmp(value, "signal") == 0) {
+        last_meta.zone = zone;
+        last_meta.signal = true;
+      }
+    } else if (strcmp(key, "smooth") == 0) {
+      // default ramp time in msecs for new values
+      double ms;
+      if (sscanf(value, "%lg", &ms) == 1 && ms > 0) {
+        last_meta.zone = zone;
+        last_meta.smooth = ms;
+      }
+    } else if (strcmp(key, "scale") == 0) {
+      // mapping curve of MIDI values
+      last_meta.zone = zone;
+      if (strcmp(value, "log") == 0)
+        last_meta.scale = SCALE_LOG;
+      else if (strcmp(value, "exp") == 0)
+        last_meta.scale = SCALE_EXP;
+      else
+        last_meta.scale = SCALE_LIN;
+    } else if (strcmp(key, "voice") == 0) {
       if (strcmp(value, "freq") == 0) {
         last_meta.zone = zone;
         last_meta.voice = VOICE_FREQ;
@@ -985,11 +2099,14 @@ static void faust_ui_manager_meta_declare(t_faust_ui_manager* x, const char* key
 }
 
 
+static void faust_ui_manager_page_tick(t_faust_ui_manager *x);
+static void faust_ui_manager_gui_unwatch(t_faust_ui_manager *x);
+
 //////////////////////////////////////////////////////////////////////////////////////////////////
 //                                      PUBLIC INTERFACE                                        //
 //////////////////////////////////////////////////////////////////////////////////////////////////
 
-t_faust_ui_manager* faust_ui_manager_new(t_object* owner)
+t_faust_ui_manager* faust_ui_manager_new(t_object* owner, t_canvas* canvas)
 {
     t_faust_ui_manager* ui_manager = (t_faust_ui_manager*)getbytes(sizeof(t_faust_ui_manager));
     if(ui_manager)
@@ -1014,10 +2131,45 @@ t_faust_ui_manager* faust_ui_manager_new(t_object* owner)
         ui_manager->f_owner     = owner;
         ui_manager->f_uis       = NULL;
         ui_manager->f_nuis      = 0;
+        memset(&ui_manager->f_ctl, 0, sizeof(t_faust_ctltab));
+        ui_manager->f_lookup.h_size = 0;
+        ui_manager->f_lookup.h_keys = NULL;
+        ui_manager->f_lookup.h_vals = NULL;
+        ui_manager->f_midi_index  = NULL;
+        ui_manager->f_nmidi_index = 0;
+        ui_manager->f_osc_index   = NULL;
+        ui_manager->f_nosc_index  = 0;
+        ui_manager->f_osc_exact.h_size = ui_manager->f_osc_prefix.h_size = 0;
+        ui_manager->f_osc_exact.h_keys = ui_manager->f_osc_prefix.h_keys = NULL;
+        ui_manager->f_osc_exact.h_vals = ui_manager->f_osc_prefix.h_vals = NULL;
+        ui_manager->f_families  = NULL;
+        ui_manager->f_nfamilies = 0;
+        ui_manager->f_family_lookup.h_size = 0;
+        ui_manager->f_family_lookup.h_keys = NULL;
+        ui_manager->f_family_lookup.h_vals = NULL;
+        memset(&ui_manager->f_gui, 0, sizeof(t_faust_gui_rec));
+        memset(&ui_manager->f_shm, 0, sizeof(t_faust_shm));
+        memset(&ui_manager->f_bank, 0, sizeof(t_faust_bank));
+        memset(&ui_manager->f_morph, 0, sizeof(t_faust_morph));
+        ui_manager->f_statemap  = NULL;
+        ui_manager->f_nstatemap = 0;
+        ui_manager->f_ramps     = NULL;
+        ui_manager->f_rampidx   = NULL;
+        ui_manager->f_nramps    = ui_manager->f_maxramps = 0;
+        memset(&ui_manager->f_auto, 0, sizeof(t_faust_auto));
+        memset(&ui_manager->f_signames_in, 0, sizeof(t_faust_signames));
+        memset(&ui_manager->f_signames_out, 0, sizeof(t_faust_signames));
+        ui_manager->f_sigins    = NULL;
+        ui_manager->f_sigvals   = NULL;
+        ui_manager->f_nsigins   = 0;
+        ui_manager->f_sigouts   = NULL;
+        ui_manager->f_nsigouts  = 0;
         ui_manager->f_names     = NULL;
         ui_manager->f_nnames    = 0;
         ui_manager->f_isdouble  = false;
+        ui_manager->f_zone      = &zone_ops_float;
         ui_manager->f_midi = ui_manager->f_osc = true;
+        ui_manager->f_gui_delta = ui_manager->f_midi_delta = ui_manager->f_osc_delta = 0.0;
         ui_manager->f_nvoices   = 0;
         ui_manager->f_npoly     = 0;
         ui_manager->freq_c = ui_manager->gain_c = ui_manager->gate_c = NULL;
@@ -1026,27 +2178,48 @@ t_faust_ui_manager* faust_ui_manager_new(t_object* owner)
         ui_manager->f_panic_recv = NULL;
         ui_manager->f_init_recv = NULL;
         ui_manager->f_active_recv = NULL;
+        ui_manager->f_prev_recv = ui_manager->f_next_recv = NULL;
         ui_manager->f_tuning = NULL;
+        ui_manager->f_sounds    = NULL;
+        ui_manager->f_nsounds   = 0;
+        ui_manager->f_dsp       = NULL;
+        ui_manager->f_sound_clock = clock_new(ui_manager, (t_method)faust_ui_manager_sound_tick);
+        ui_manager->f_page_clock = clock_new(ui_manager, (t_method)faust_ui_manager_page_tick);
+        ui_manager->f_page_delta = 0;
+        ui_manager->f_sentinel  = NULL;
+        ui_manager->f_canvas    = canvas;
         ui_manager->f_quiet = false;
         
         ui_manager->f_meta_glue.metaInterface = ui_manager;
         ui_manager->f_meta_glue.declare       = (metaDeclareFun)faust_ui_manager_meta_declare;
+        faust_ui_midi_init();
     }
     return ui_manager;
 }
 
 void faust_ui_manager_free(t_faust_ui_manager *x)
 {
+    faust_ui_manager_gui_unwatch(x);
     faust_ui_manager_clear(x);
+    clock_free(x->f_sound_clock);
+    clock_free(x->f_page_clock);
     freebytes(x, sizeof(*x));
 }
 
 void faust_ui_manager_init(t_faust_ui_manager *x, void* dspinstance, int isdbl, char quiet)
 {
+    t_faust_sound_ui *sounds = x->f_sounds;
+    size_t nsounds = x->f_nsounds;
     x->f_quiet = quiet;
+    x->f_sounds = NULL;
+    x->f_nsounds = 0;
+    x->f_dsp = dspinstance;
     faust_ui_manager_prepare_changes(x, isdbl);
     buildUserInterfaceCDSPInstance((llvm_dsp *)dspinstance, (UIGlue *)&(x->f_glue));
     faust_ui_manager_finish_changes(x);
+    // The soundfiles of the previous instance are only released now, so that
+    // those which are still in use don't get reloaded.
+    faust_sound_list_free(sounds, nsounds);
     faust_ui_manager_free_names(x);
     metadataCDSPInstance((llvm_dsp *)dspinstance, &x->f_meta_glue);
     x->f_quiet = false;
@@ -1057,7 +2230,17 @@ void faust_ui_manager_clear(t_faust_ui_manager *x)
     if (x->f_panic_recv) faust_ui_receive_free(x->f_panic_recv);
     if (x->f_init_recv) faust_ui_receive_free(x->f_init_recv);
     if (x->f_active_recv) faust_ui_receive_free(x->f_active_recv);
-    if (x->f_tuning) freebytes(x->f_tuning, 12*sizeof(t_float));
+    if (x->f_prev_recv) faust_ui_receive_free(x->f_prev_recv);
+    if (x->f_next_recv) faust_ui_receive_free(x->f_next_recv);
+    if (x->f_tuning) faust_tuning_free(x->f_tuning);
+    faust_ui_manager_release_sounds(x, x->f_dsp);
+    if (x->f_gui.items) freebytes(x->f_gui.items, x->f_gui.n*sizeof(t_faust_gui_item));
+    faust_ui_manager_shm_close(x);
+    faust_ui_manager_auto_stop(x);
+    faust_signames_free(&x->f_signames_in);
+    faust_signames_free(&x->f_signames_out);
+    faust_bank_free(&x->f_bank);
+    faust_morph_free(&x->f_morph);
     faust_ui_manager_free_uis(x);
     faust_ui_manager_free_names(x);
 }
@@ -1104,32 +2287,208 @@ static void gui_update(FAUSTFLOAT v, t_faust_ui_proxy *r)
   }
 }
 
+static void faust_ui_auto_push(t_faust_ui_manager *x, const t_faust_ui *ui, FAUSTFLOAT v, double ms);
+
 static void set_zone(t_faust_ui_manager *x, FAUSTFLOATX *z, FAUSTFLOAT v, t_faust_ui_proxy *r)
 {
   setfaustflt(x, z, v);
   gui_update(v, r);
 }
 
-char faust_ui_manager_set_value(t_faust_ui_manager *x, t_symbol const *name, t_float const f)
+// RAMPS
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void faust_ui_manager_update_ramps(t_faust_ui_manager *x)
 {
-    t_faust_ui* ui = faust_ui_manager_get(x, name);
-    if(ui)
+    const size_t n = x->f_ctl.n;
+    faust_ui_manager_free_ramps(x);
+    if(!n)
     {
-        if(ui->p_type == FAUST_UI_TYPE_BUTTON || ui->p_type == FAUST_UI_TYPE_TOGGLE)
-        {
-            set_zone(x, ui->p_zone, (FAUSTFLOAT)(f > FLT_EPSILON), ui->p_uirecv);
-            return 0;
-        }
-        else if(ui->p_type == FAUST_UI_TYPE_NUMBER)
-        {
-            const FAUSTFLOAT v = (FAUSTFLOAT)(f);
-            set_zone(x, ui->p_zone, (FAUSTFLOAT)(v < ui->p_min?ui->p_min:v > ui->p_max?ui->p_max:v), ui->p_uirecv);
+        return;
+    }
+    x->f_ramps = getbytes(n*sizeof(t_faust_ramp));
+    x->f_rampidx = getbytes(n*sizeof(size_t));
+    if(!x->f_ramps || !x->f_rampidx)
+    {
+        if(x->f_ramps) freebytes(x->f_ramps, n*sizeof(t_faust_ramp));
+        if(x->f_rampidx) freebytes(x->f_rampidx, n*sizeof(size_t));
+        x->f_ramps = NULL;
+        x->f_rampidx = NULL;
+        if (!x->f_quiet) pd_error(x->f_owner, "faustgen2~: memory allocation failed - ramps");
+        return;
+    }
+    for(size_t i = 0; i < n; i++)
+    {
+        x->f_rampidx[i] = SIZE_MAX;
+    }
+    x->f_maxramps = n;
+}
+
+static void faust_ui_ramp_remove(t_faust_ui_manager *x, size_t k)
+{
+    x->f_rampidx[x->f_ramps[k].slot] = SIZE_MAX;
+    if(k < --x->f_nramps)
+    {
+        x->f_ramps[k] = x->f_ramps[x->f_nramps];
+        x->f_rampidx[x->f_ramps[k].slot] = k;
+    }
+}
+
+// Cancel the ramp in progress on a control, if any. Each direct write of a
+// zone needs to do this, otherwise the ramp would move the control back
+// towards its old target in the next dsp cycle.
+static void faust_ui_ramp_cancel(t_faust_ui_manager *x, const t_faust_ui *ui)
+{
+    const size_t i = ui->p_slot;
+    if(i < x->f_maxramps && x->f_ctl.uis[i] == ui && x->f_rampidx[i] != SIZE_MAX)
+    {
+        faust_ui_ramp_remove(x, x->f_rampidx[i]);
+    }
+}
+
+void faust_ui_manager_clear_ramps(t_faust_ui_manager *x)
+{
+    for(size_t k = 0; k < x->f_nramps; k++)
+    {
+        x->f_rampidx[x->f_ramps[k].slot] = SIZE_MAX;
+    }
+    x->f_nramps = 0;
+}
+
+// Ramp a numeric control to the given value over the given time (msecs).
+// The gui shows the target value right away.
+static char faust_ui_ramp(t_faust_ui_manager *x, t_faust_ui *ui, t_float f, double ms)
+{
+    const size_t i = ui->p_slot;
+    FAUSTFLOAT v = (FAUSTFLOAT)f;
+    size_t k;
+    if(ui->p_type != FAUST_UI_TYPE_NUMBER || ui->p_voice)
+    {
+        return 1;
+    }
+    v = v < ui->p_min?ui->p_min:v > ui->p_max?ui->p_max:v;
+    if(ms <= 0 || i >= x->f_maxramps || x->f_ctl.uis[i] != ui)
+    {
+        faust_ui_ramp_cancel(x, ui);
+        faust_ui_auto_push(x, ui, v, 0);
+        set_zone(x, ui->p_zone, v, ui->p_uirecv);
+        return 0;
+    }
+    // the recording gets the ramp time, so that playback ramps the same way
+    faust_ui_auto_push(x, ui, v, ms);
+    k = x->f_rampidx[i];
+    if(k == SIZE_MAX)
+    {
+        k = x->f_nramps++;
+        x->f_ramps[k].slot = i;
+        x->f_rampidx[i] = k;
+    }
+    x->f_ramps[k].target = v;
+    x->f_ramps[k].time = ms;
+    gui_update(v, ui->p_uirecv);
+    return 0;
+}
+
+// Set a control to a new value from one of the inputs (GUI, MIDI, OSC).
+// Numeric controls with [smooth:ms] meta data ramp to the new value, all
+// others are set right away.
+static void faust_ui_input(t_faust_ui_manager *x, t_faust_ui *ui, FAUSTFLOAT v)
+{
+    if(ui->p_type == FAUST_UI_TYPE_NUMBER && ui->p_smooth > 0 && !ui->p_voice)
+    {
+        faust_ui_ramp(x, ui, v, ui->p_smooth);
+        return;
+    }
+    faust_ui_ramp_cancel(x, ui);
+    faust_ui_auto_push(x, ui, v, 0);
+    set_zone(x, ui->p_zone, v, ui->p_uirecv);
+}
+
+char faust_ui_manager_ramp(t_faust_ui_manager *x, t_symbol const *name, t_float f, double ms)
+{
+    t_faust_ui *ui = faust_ui_manager_get(x, name);
+    return ui ? faust_ui_ramp(x, ui, f, ms) : 1;
+}
+
+int faust_ui_manager_ramp_tick(t_faust_ui_manager *x, double ms)
+{
+    const t_faust_ctltab *t = &x->f_ctl;
+    size_t k = 0;
+    int n = x->f_nramps > 0;
+    while(k < x->f_nramps)
+    {
+        t_faust_ramp *r = x->f_ramps+k;
+        FAUSTFLOATX *z = t->zones[r->slot];
+        if(r->time <= ms)
+        {
+            setfaustflt(x, z, r->target);
+            faust_ui_ramp_remove(x, k);
+        }
+        else
+        {
+            const FAUSTFLOAT v = faustflt(x, z);
+            setfaustflt(x, z, v + (r->target - v)*(FAUSTFLOAT)(ms/r->time));
+            r->time -= ms;
+            k++;
+        }
+    }
+    return n;
+}
+
+static char faust_ui_set_value(t_faust_ui_manager *x, t_faust_ui *ui, t_float const f)
+{
+    if(ui)
+    {
+        if(ui->p_type == FAUST_UI_TYPE_BUTTON || ui->p_type == FAUST_UI_TYPE_TOGGLE)
+        {
+            faust_ui_ramp_cancel(x, ui);
+            faust_ui_auto_push(x, ui, (FAUSTFLOAT)(f > FLT_EPSILON), 0);
+            set_zone(x, ui->p_zone, (FAUSTFLOAT)(f > FLT_EPSILON), ui->p_uirecv);
+            return 0;
+        }
+        else if(ui->p_type == FAUST_UI_TYPE_NUMBER)
+        {
+            FAUSTFLOAT v = (FAUSTFLOAT)(f);
+            if(ui->p_smooth > 0)
+            {
+                // [smooth:ms] ramp to the new value
+                return faust_ui_ramp(x, ui, f, ui->p_smooth);
+            }
+            v = v < ui->p_min?ui->p_min:v > ui->p_max?ui->p_max:v;
+            faust_ui_ramp_cancel(x, ui);
+            faust_ui_auto_push(x, ui, v, 0);
+            set_zone(x, ui->p_zone, v, ui->p_uirecv);
             return 0;
         }
     }
     return 1;
 }
 
+char faust_ui_manager_set_value(t_faust_ui_manager *x, t_symbol const *name, t_float const f)
+{
+    return faust_ui_set_value(x, faust_ui_manager_get(x, name), f);
+}
+
+int faust_ui_manager_set_list(t_faust_ui_manager *x, t_symbol const *name, int start, int argc, t_atom const *argv)
+{
+    const t_faust_family *f = faust_symtab_lookup(&x->f_family_lookup, name);
+    int i;
+    if(!f)
+    {
+        return -1;
+    }
+    for(i = 0; i < argc; ++i)
+    {
+        int64_t k = (int64_t)start + i - f->base;
+        if(argv[i].a_type != A_FLOAT || k < 0 || (uint64_t)k >= f->n ||
+           faust_ui_set_value(x, f->uis[k], argv[i].a_w.w_float))
+        {
+            break;
+        }
+    }
+    return i;
+}
+
 char faust_ui_manager_get_value(t_faust_ui_manager const *x, t_symbol const *name, t_float* f)
 {
     t_faust_ui* ui = faust_ui_manager_get(x, name);
@@ -1147,9 +2506,36 @@ static double round_near(double x, double x0, double min, double max)
   return x;
 }
 
+// Map a normalized value u (0..1) to a control range with a [scale:log] or
+// [scale:exp] curve and back. These follow the value converters in Faust's
+// faust/gui/ValueConverter.h, so that the curves match the other Faust UIs.
+static double scale_from_unit(double u, double min, double max, int scale)
+{
+  if (scale == SCALE_LOG) {
+    double a = log(fmax(DBL_MIN, min)), b = log(fmax(DBL_MIN, max));
+    return exp(a + u*(b-a));
+  } else if (scale == SCALE_EXP) {
+    double a = fmin(DBL_MAX, exp(min)), b = fmin(DBL_MAX, exp(max));
+    return log(a + u*(b-a));
+  } else
+    return min + u*(max-min);
+}
+
+static double scale_to_unit(double v, double min, double max, int scale)
+{
+  if (scale == SCALE_LOG) {
+    double a = log(fmax(DBL_MIN, min)), b = log(fmax(DBL_MIN, max));
+    return b != a ? (log(fmax(DBL_MIN, v))-a)/(b-a) : 0.0;
+  } else if (scale == SCALE_EXP) {
+    double a = fmin(DBL_MAX, exp(min)), b = fmin(DBL_MAX, exp(max));
+    return b != a ? (fmin(DBL_MAX, exp(v))-a)/(b-a) : 0.0;
+  } else
+    return max != min ? (v-min)/(max-min) : 0.0;
+}
+
 static FAUSTFLOAT translate_from_midi(int val, int min, int max, int p_type,
-                                      FAUSTFLOAT p_min, FAUSTFLOAT p_max,
-                                      FAUSTFLOAT p_step)
+                                      int p_scale, FAUSTFLOAT p_min,
+                                      FAUSTFLOAT p_max, FAUSTFLOAT p_step)
 {
   // clamp val in the prescribed range
   if (val < min) val = min;
@@ -1170,11 +2556,16 @@ static FAUSTFLOAT translate_from_midi(int val, int min, int max, int p_type,
       FAUSTFLOAT temp = p_min;
       p_min = p_max; p_max = temp; p_step = -p_step;
     }
-    v *= (p_max - p_min);
-    // round near center value
-    v = round_near(v, (p_max-p_min)/2.0, p_min, p_max);
+    if (p_scale != SCALE_LIN) {
+      // the center value is somewhere else on these curves
+      v = scale_from_unit(v, p_min, p_max, p_scale);
+    } else {
+      v *= (p_max - p_min);
+      // round near center value
+      v = round_near(v, (p_max-p_min)/2.0, p_min, p_max);
+      v += p_min;
+    }
     // round near min and max
-    v += p_min;
     v = round_near(v, p_min, p_min, p_max);
     v = round_near(v, p_max, p_min, p_max);
     // Round to the nearest step. This needs to be done last, to avoid
@@ -1187,24 +2578,92 @@ static FAUSTFLOAT translate_from_midi(int val, int min, int max, int p_type,
   }
 }
 
-static void faust_ui_midi_init(void)
+// range of the MIDI values of a given message type
+static void midi_range(int msg, int *min, int *max)
 {
-  if (!midi_sym[MIDI_CTRL]) {
-    // populate the midi_sym table
-    for (int i = 1; i < N_MIDI; i++)
-      if (midi_sym_s[i])
-        midi_sym[i] = gensym(midi_sym_s[i]);
+  *min = 0;
+  switch (msg) {
+  case MIDI_START:
+  case MIDI_STOP:
+  case MIDI_CLOCK:
+    *max = 1;
+    break;
+  case MIDI_PITCHWHEEL:
+    *max = 16384;
+    break;
+  default:
+    *max = 128;
+    break;
+  }
+}
+
+// Precompute the control values for all MIDI values of a binding (max-min+1
+// entries, since translate_from_midi accepts the end of the range as well),
+// so that incoming MIDI values only need a table lookup. The table is taken
+// from the cache if another binding already computed it. If the table can't
+// be allocated, we fall back to translate_from_midi.
+static void faust_midi_ui_table(t_faust_midi_ui *m, int p_type, int p_scale,
+                                FAUSTFLOAT p_min, FAUSTFLOAT p_max,
+                                FAUSTFLOAT p_step)
+{
+  int min, max, n;
+  t_faust_midi_table *t;
+  midi_range(m->msg, &min, &max);
+  for (t = midi_table_cache; t; t = t->next) {
+    if (t->range == max && t->type == p_type && t->scale == p_scale &&
+        t->min == p_min && t->max == p_max && t->step == p_step) {
+      t->refcount++;
+      m->table = t;
+      return;
+    }
+  }
+  n = max-min+1;
+  t = getbytes(sizeof(t_faust_midi_table));
+  if (!t) return;
+  t->v = getbytes(n*sizeof(FAUSTFLOAT));
+  if (!t->v) {
+    freebytes(t, sizeof(t_faust_midi_table));
+    return;
+  }
+  t->range = max; t->type = p_type; t->scale = p_scale;
+  t->min = p_min; t->max = p_max; t->step = p_step;
+  t->refcount = 1;
+  t->n = n;
+  for (int k = 0; k < n; k++)
+    t->v[k] = translate_from_midi(min+k, min, max, p_type, p_scale,
+                                  p_min, p_max, p_step);
+  t->next = midi_table_cache;
+  midi_table_cache = t;
+  m->table = t;
+}
+
+static void faust_midi_table_release(t_faust_midi_table *t)
+{
+  t_faust_midi_table **y = &midi_table_cache;
+  if (--t->refcount > 0) return;
+  while (*y && *y != t) y = &(*y)->next;
+  if (*y) *y = t->next;
+  freebytes(t->v, t->n*sizeof(FAUSTFLOAT));
+  freebytes(t, sizeof(t_faust_midi_table));
+}
+
+static FAUSTFLOAT midi_lookup(const t_faust_midi_ui *m, const t_faust_ui *c, int val)
+{
+  if (m->table) {
+    const t_faust_midi_table *t = m->table;
+    return t->v[val < 0 ? 0 : val >= t->n ? t->n-1 : val];
+  } else {
+    int min, max;
+    midi_range(m->msg, &min, &max);
+    return translate_from_midi(val, min, max, c->p_type, c->p_scale,
+                               c->p_min, c->p_max, c->p_step);
   }
 }
 
-// simple MTS-like tuning facility (octave-based tunings only for now)
-static t_float note2cps(t_faust_ui_manager *x, int num)
+// note frequencies are looked up in the tuning tables
+static t_float note2cps(t_faust_ui_manager *x, int num, int chan)
 {
-  t_float f = num;
-  // tuning offset in cents
-  if (x->f_tuning) f += x->f_tuning[num%12]/100.0;
-  // Pd's mtof() function does the rest
-  return mtof(f);
+  return faust_tuning_freq(x->f_tuning, chan, num);
 }
 
 // aggraef's homegrown voice allocation algorithm. Note that we simply ignore
@@ -1237,7 +2696,8 @@ static void voices_noteon(t_faust_ui_manager *x, int num, int val, int chan)
       pd_error(x->f_owner, "faustgen2~: memory allocation failed - monophony");
     }
     t_faust_voice *v = x->f_voices;
-    if (v->freq_c) setfaustflt(x, v->freq_c->p_zone, note2cps(x, num));
+    v->chan = chan;
+    if (v->freq_c) setfaustflt(x, v->freq_c->p_zone, note2cps(x, num, chan));
     if (v->gain_c) setfaustflt(x, v->gain_c->p_zone, ((double)val)/127.0);
     if (v->gate_c) setfaustflt(x, v->gate_c->p_zone, 1.0);
     return;
@@ -1268,15 +2728,30 @@ static void voices_noteon(t_faust_ui_manager *x, int num, int val, int chan)
       x->f_used = v;
     }
     v->num = num;
+    v->chan = chan;
     // Simply bypass all checking of control ranges and steps for now. We
-    // might want to do something more comprehensive later. Also, having MTS
-    // support would be nice. :)
-    if (v->freq_c) setfaustflt(x, v->freq_c->p_zone, note2cps(x, num));
+    // might want to do something more comprehensive later.
+    if (v->freq_c) setfaustflt(x, v->freq_c->p_zone, note2cps(x, num, chan));
     if (v->gain_c) setfaustflt(x, v->gain_c->p_zone, ((double)val)/127.0);
     if (v->gate_c) setfaustflt(x, v->gate_c->p_zone, 1.0);
   }
 }
 
+// Update the frequencies of the sounding voices after a tuning change.
+static void voices_retune(t_faust_ui_manager *x)
+{
+#if MONOPHONIC
+  if (x->f_nvoices == 1) {
+    t_faust_voice *v = x->f_voices;
+    if (x->f_keys && v->freq_c)
+      setfaustflt(x, v->freq_c->p_zone, note2cps(x, x->f_keys->num, v->chan));
+    return;
+  }
+#endif
+  for (t_faust_voice *v = x->f_used; v; v = v->next_used)
+    if (v->freq_c) setfaustflt(x, v->freq_c->p_zone, note2cps(x, v->num, v->chan));
+}
+
 static void voices_noteoff(t_faust_ui_manager *x, int num, int chan)
 {
 #if MONOPHONIC
@@ -1300,7 +2775,8 @@ static void voices_noteoff(t_faust_ui_manager *x, int num, int chan)
           if (p) {
             // legato (change to the previous frequency); note that if you
             // want portamento, you'll have to do this in the Faust source
-            if (v->freq_c) setfaustflt(x, v->freq_c->p_zone, note2cps(x, p->num));
+            v->chan = chan;
+            if (v->freq_c) setfaustflt(x, v->freq_c->p_zone, note2cps(x, p->num, chan));
           } else {
             // note off
             if (v->gate_c) setfaustflt(x, v->gate_c->p_zone, 0.0);
@@ -1377,7 +2853,6 @@ static bool midichan_check(t_channelmask msk, int chan)
 int faust_ui_manager_get_midi(t_faust_ui_manager *x, t_symbol const *s, int argc, t_atom* argv, t_channelmask midichanmsk)
 {
   int i;
-  faust_ui_midi_init();
   for (i = 1; i < N_MIDI; i++) {
     if (s == midi_sym[i]) break;
   }
@@ -1428,65 +2903,47 @@ int faust_ui_manager_get_midi(t_faust_ui_manager *x, t_symbol const *s, int argc
       else
         voices_noteoff(x, num, chan);
     }
-    // Run through all the active UI elements with MIDI bindings and update
-    // the elements that match.
-    t_faust_ui *c = x->f_uis;
-    while (c) {
-      for (size_t j = 0; j < c->p_nmidi; j++) {
-        if (c->p_midi[j].msg == i &&
-            (c->p_midi[j].chan < 0 || c->p_midi[j].chan == chan) &&
-            c->p_type != FAUST_UI_TYPE_BARGRAPH) {
-          bool log = true;
-          switch (i) {
-          case MIDI_START:
-            setfaustflt(x, c->p_zone,
-              translate_from_midi(1, 0, 1,
-                                  c->p_type, c->p_min, c->p_max, c->p_step));
-            break;
-          case MIDI_STOP:
-            setfaustflt(x, c->p_zone,
-              translate_from_midi(0, 0, 1,
-                                  c->p_type, c->p_min, c->p_max, c->p_step));
-            break;
-          case MIDI_CLOCK:
-            // square signal which toggles at each clock
-            if (c->p_type == FAUST_UI_TYPE_BUTTON ||
-                c->p_type == FAUST_UI_TYPE_TOGGLE)
-              val = faustflt(x, c->p_zone) == 0.0;
-            else
-              val = faustflt(x, c->p_zone) == c->p_min;
-            setfaustflt(x, c->p_zone,
-              translate_from_midi(val, 0, 1,
-                                  c->p_type, c->p_min, c->p_max, c->p_step));
-            break;
-          case MIDI_PITCHWHEEL:
-            setfaustflt(x, c->p_zone,
-              translate_from_midi(val, 0, 16384,
-                                  c->p_type, c->p_min, c->p_max, c->p_step));
-            break;
-          default:
-            if (midi_argc[i] == 1) {
-              // Pd counts program changes starting at 1
-              if (i == MIDI_PGM) val--;
-              setfaustflt(x, c->p_zone,
-                translate_from_midi(val, 0, 128,
-                                    c->p_type, c->p_min, c->p_max, c->p_step));
-            } else if (c->p_midi[j].num == num) {
-              setfaustflt(x, c->p_zone,
-                translate_from_midi(val, 0, 128,
-                                    c->p_type, c->p_min, c->p_max, c->p_step));
-            } else {
-              log = false;
-            }
-            break;
-          }
-          if (log) {
-            //logpost(x->f_owner, 3, "%s = %g", c->p_name->s_name, *c->p_zone);
-            gui_update(faustflt(x, c->p_zone), c->p_uirecv);
-          }
-        }
+    // Look up the matching bindings in the dispatch index. Bindings without
+    // a channel match any channel, so we have to look at those as well,
+    // merging both ranges so that the bindings are processed in ui order.
+    size_t k1, end1, k2 = 0, end2 = 0;
+    if (!x->f_nmidi_index) return i;
+    k1 = faust_ui_manager_find_midi(x, i, -1, midi_argc[i] > 1 ? num : 0, &end1);
+    if (chan >= 0)
+      k2 = faust_ui_manager_find_midi(x, i, chan, midi_argc[i] > 1 ? num : 0, &end2);
+    while (k1 < end1 || k2 < end2) {
+      const t_faust_midi_entry *e;
+      if (k2 >= end2 ||
+          (k1 < end1 && x->f_midi_index[k1].seq < x->f_midi_index[k2].seq))
+        e = &x->f_midi_index[k1++];
+      else
+        e = &x->f_midi_index[k2++];
+      t_faust_ui *c = e->ui;
+      const t_faust_midi_ui *m = &c->p_midi[e->j];
+      FAUSTFLOAT v;
+      switch (i) {
+      case MIDI_START:
+        v = midi_lookup(m, c, 1);
+        break;
+      case MIDI_STOP:
+        v = midi_lookup(m, c, 0);
+        break;
+      case MIDI_CLOCK:
+        // square signal which toggles at each clock
+        if (c->p_type == FAUST_UI_TYPE_BUTTON ||
+            c->p_type == FAUST_UI_TYPE_TOGGLE)
+          val = faustflt(x, c->p_zone) == 0.0;
+        else
+          val = faustflt(x, c->p_zone) == c->p_min;
+        v = midi_lookup(m, c, val);
+        break;
+      default:
+        // Pd counts program changes starting at 1
+        v = midi_lookup(m, c, i == MIDI_PGM ? val-1 : val);
+        break;
       }
-      c = c->p_next;
+      //logpost(x->f_owner, 3, "%s = %g", c->p_name->s_name, v);
+      faust_ui_input(x, c, v);
     }
     return i;
   }
@@ -1592,168 +3049,1003 @@ const t_symbol *faust_ui_manager_get_osc(t_faust_ui_manager *x, t_symbol const *
     }
     return s;
   }
-  // Run through all the active UI elements with OSC bindings and update
-  // the elements that match.
-  t_faust_ui *c = x->f_uis;
-  while (c) {
-    if (c->p_type != FAUST_UI_TYPE_BARGRAPH) {
-      for (size_t j = 0; j < c->p_nosc; j++) {
-        bool log = true;
-        if (argc > 1) {
-          int k, n;
-          // Multiple arguments are handled by tacking on /0, /1 etc. to the
-          // message selector, following the OSC Support section in the Faust
-          // manual. First check whether the symbol actually matches a proper
-          // prefix of the current message selector.
-          size_t l = strlen(s->s_name);
-          if (strncmp(s->s_name, c->p_osc[j].msg->s_name, l) == 0 &&
-              c->p_osc[j].msg->s_name[l] == '/' &&
-              sscanf(c->p_osc[j].msg->s_name+l+1, "%d%n", &k, &n) == 1 &&
-              c->p_osc[j].msg->s_name[n+l+1] == 0 && k>=0 && k<argc &&
-              argv[k].a_type == A_FLOAT) {
-            double val = argv[k].a_w.w_float;
-            // Translate the value to the target range.
-            setfaustflt(x, c->p_zone,
-              translate_from_osc(val, c->p_osc[j].a, c->p_osc[j].b,
-                                 c->p_type, c->p_min, c->p_max, c->p_step));
-          } else {
-            log = false;
-          }
-        } else if (c->p_osc[j].msg == s &&
-                   (argc == 0 || argv[0].a_type == A_FLOAT)) {
-          // The Faust manual doesn't say how to handle the case of no
-          // arguments. Here we just assume a default value of b in that case.
-          double val = argc > 0 ? argv[0].a_w.w_float : c->p_osc[j].b;
-          // Translate the value to the target range.
-          setfaustflt(x, c->p_zone,
-            translate_from_osc(val, c->p_osc[j].a, c->p_osc[j].b,
-                               c->p_type, c->p_min, c->p_max, c->p_step));
-        } else {
-          log = false;
-        }
-        if (log) {
-          //logpost(x->f_owner, 3, "%s = %g", c->p_name->s_name, *c->p_zone);
-          gui_update(faustflt(x, c->p_zone), c->p_uirecv);
-        }
+  // Look up the matching bindings in the dispatch index.
+  if (argc > 1) {
+    // Multiple arguments are handled by tacking on /0, /1 etc. to the
+    // message selector, following the OSC Support section in the Faust
+    // manual. These bindings are found in the prefix table.
+    const t_faust_osc_entry *e =
+      faust_symtab_lookup(&x->f_osc_prefix, s);
+    const t_faust_osc_entry *end = x->f_osc_index + x->f_nosc_index;
+    for (; e && e < end && e->k >= 0 && e->key == s; e++) {
+      t_faust_ui *c = e->ui;
+      if (e->k < argc && argv[e->k].a_type == A_FLOAT) {
+        double val = argv[e->k].a_w.w_float;
+        // Translate the value to the target range.
+        faust_ui_input(x, c,
+          translate_from_osc(val, c->p_osc[e->j].a, c->p_osc[e->j].b,
+                             c->p_type, c->p_min, c->p_max, c->p_step));
       }
     }
-    c = c->p_next;
+  } else if (argc == 0 || argv[0].a_type == A_FLOAT) {
+    const t_faust_osc_entry *e =
+      faust_symtab_lookup(&x->f_osc_exact, s);
+    const t_faust_osc_entry *end = x->f_osc_index + x->f_nosc_index;
+    for (; e && e < end && e->k < 0 && e->key == s; e++) {
+      t_faust_ui *c = e->ui;
+      // The Faust manual doesn't say how to handle the case of no
+      // arguments. Here we just assume a default value of b in that case.
+      double val = argc > 0 ? argv[0].a_w.w_float : c->p_osc[e->j].b;
+      // Translate the value to the target range.
+      faust_ui_input(x, c,
+        translate_from_osc(val, c->p_osc[e->j].a, c->p_osc[e->j].b,
+                           c->p_type, c->p_min, c->p_max, c->p_step));
+    }
   }
   return s;
 }
 
 void faust_ui_manager_save_states(t_faust_ui_manager *x)
 {
-    t_faust_ui *c = x->f_uis;
-    while(c)
-    {
-        c->p_saved = faustflt(x, c->p_zone);
-        c = c->p_next;
-    }
+    const t_faust_ctltab *t = &x->f_ctl;
+    x->f_zone->gather(t->zones, NULL, t->n, t->saved);
 }
 
 void faust_ui_manager_restore_states(t_faust_ui_manager *x)
 {
-    t_faust_ui *c = x->f_uis;
-    while(c)
+    const t_faust_ctltab *t = &x->f_ctl;
+    faust_ui_manager_clear_ramps(x);
+    for(size_t i = 0; i < t->n; i++)
     {
-        set_zone(x, c->p_zone, c->p_saved, c->p_uirecv);
-        c = c->p_next;
+        set_zone(x, t->zones[i], t->saved[i], t->uis[i]->p_uirecv);
     }
 }
 
-void faust_ui_manager_restore_default(t_faust_ui_manager *x)
+void faust_ui_manager_copy_states(t_faust_ui_manager *x, t_faust_ui_manager const *src)
 {
-    t_faust_ui *c = x->f_uis;
-    faust_ui_manager_all_notes_off(x);
-    while(c)
+    // This requires that both managers belong to instances of the same dsp,
+    // so that the controls are in the same order. Voice controls and passive
+    // controls are left alone.
+    t_faust_ui *c = x->f_uis, *d = src->f_uis;
+    while(c && d)
     {
-        set_zone(x, c->p_zone, c->p_default, c->p_uirecv);
+        if(!c->p_voice && !d->p_voice && c->p_type != FAUST_UI_TYPE_BARGRAPH)
+        {
+            setfaustflt(x, c->p_zone, faustflt(src, d->p_zone));
+        }
         c = c->p_next;
+        d = d->p_next;
     }
 }
 
-static const char* faust_ui_manager_get_parameter_char(int const type)
+// PRESETS
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void faust_bank_free_slots(t_faust_bank *b)
 {
-    if(type == FAUST_UI_TYPE_BUTTON)
-        return "button";
-    else if(type == FAUST_UI_TYPE_TOGGLE)
-        return "toggle";
-    else if(type == FAUST_UI_TYPE_NUMBER)
-        return "number";
-    else
-        return "bargraph";
+  for (size_t i = 0; i < b->nslots; i++)
+    if (b->slots[i]) freebytes(b->slots[i], b->n*sizeof(FAUSTFLOAT));
+  if (b->slots) freebytes(b->slots, b->nslots*sizeof(FAUSTFLOAT*));
+  b->slots = NULL;
+  b->nslots = 0;
 }
 
-void faust_ui_manager_print(t_faust_ui_manager const *x, char const log)
+static void faust_bank_free(t_faust_bank *b)
 {
-    t_faust_ui *c = x->f_uis;
-    while(c)
-    {
-      if (!c->p_voice) {
-        const t_symbol *name = c->p_name, *lname = c->p_longname;
-        logpost(x->f_owner, 2+log, "parameter: %s [path:%s - type:%s - init:%g - min:%g - max:%g - current:%g]",
-                name->s_name, lname->s_name,
-                faust_ui_manager_get_parameter_char(c->p_type),
-                c->p_default, c->p_min, c->p_max, faustflt(x, c->p_zone));
-        if (c->p_midi) {
-          for (size_t i = 0; i < c->p_nmidi; i++) {
-            if (c->p_midi[i].chan >= 0) {
-              if (midi_argc[c->p_midi[i].msg] > 1)
-                logpost(x->f_owner, 3, "parameter: %s [midi:%s %d %d]", name->s_name,
-                        midi_key[c->p_midi[i].msg], c->p_midi[i].num,
-                        c->p_midi[i].chan);
-              else
-                logpost(x->f_owner, 3, "parameter: %s [midi:%s %d]", name->s_name,
-                        midi_key[c->p_midi[i].msg], c->p_midi[i].chan);
-            } else {
-              if (midi_argc[c->p_midi[i].msg] > 1)
-                logpost(x->f_owner, 3, "parameter: %s [midi:%s %d]", name->s_name,
-                        midi_key[c->p_midi[i].msg], c->p_midi[i].num);
-              else
-                logpost(x->f_owner, 3, "parameter: %s [midi:%s]", name->s_name,
-                        midi_key[c->p_midi[i].msg]);
-            }
-          }
-        }
-        if (c->p_osc) {
-          for (size_t i = 0; i < c->p_nosc; i++) {
-            logpost(x->f_owner, 3, "parameter: %s [osc:%s %lg %lg]",
-                    name->s_name,
-                    c->p_osc[i].msg->s_name, c->p_osc[i].a,
-                    c->p_osc[i].b);
-          }
-        }
-      }
-      c = c->p_next;
+  faust_bank_free_slots(b);
+  if (b->names) freebytes(b->names, b->n*sizeof(t_symbol*));
+  b->names = NULL;
+  b->n = 0;
+}
+
+// Carry the presets over to the current control table, matching controls
+// by their long names. Controls which aren't in a preset get their default
+// values.
+static void faust_ui_manager_update_bank(t_faust_ui_manager *x)
+{
+  t_faust_bank *b = &x->f_bank, nb;
+  const t_faust_ctltab *t = &x->f_ctl;
+  size_t i, j, *map = NULL;
+  bool same = b->n == t->n;
+  for (i = 0; same && i < t->n; i++)
+    same = b->names[i] == t->uis[i]->p_longname;
+  if (same) return;
+  // the layout has changed, stop any morph in progress
+  faust_morph_free(&x->f_morph);
+  nb.n = t->n;
+  nb.nslots = b->nslots;
+  nb.names = t->n?getbytes(t->n*sizeof(t_symbol*)):NULL;
+  nb.slots = b->nslots?getbytes(b->nslots*sizeof(FAUSTFLOAT*)):NULL;
+  map = b->n?getbytes(b->n*sizeof(size_t)):NULL;
+  if ((t->n && !nb.names) || (b->nslots && !nb.slots) || (b->n && !map)) {
+    if (nb.names) freebytes(nb.names, t->n*sizeof(t_symbol*));
+    if (nb.slots) freebytes(nb.slots, b->nslots*sizeof(FAUSTFLOAT*));
+    if (map) freebytes(map, b->n*sizeof(size_t));
+    faust_bank_free(b);
+    if (!x->f_quiet) pd_error(x->f_owner, "faustgen2~: memory allocation failed - presets");
+    return;
+  }
+  for (i = 0; i < t->n; i++)
+    nb.names[i] = t->uis[i]->p_longname;
+  for (j = 0; j < b->n; j++) {
+    // t->n means that the control is gone
+    t_faust_ui *c = (t_faust_ui*)faust_symtab_lookup(&x->f_lookup, b->names[j]);
+    map[j] = c && c->p_slot < t->n && t->uis[c->p_slot] == c ? c->p_slot : t->n;
+  }
+  for (size_t k = 0; k < b->nslots; k++) {
+    if (!b->slots[k] || !t->n) continue;
+    nb.slots[k] = getbytes(t->n*sizeof(FAUSTFLOAT));
+    if (!nb.slots[k]) {
+      if (!x->f_quiet) pd_error(x->f_owner, "faustgen2~: memory allocation failed - presets");
+      continue;
     }
+    memcpy(nb.slots[k], t->init, t->n*sizeof(FAUSTFLOAT));
+    for (j = 0; j < b->n; j++)
+      if (map[j] < t->n) nb.slots[k][map[j]] = b->slots[k][j];
+  }
+  if (map) freebytes(map, b->n*sizeof(size_t));
+  faust_bank_free(b);
+  *b = nb;
 }
 
-#define DUMP_MAX_ARGS 100
+int faust_ui_manager_preset_store(t_faust_ui_manager *x, int slot)
+{
+  t_faust_bank *b = &x->f_bank;
+  const t_faust_ctltab *t = &x->f_ctl;
+  if (slot < 0 || !t->n) return -1;
+  if ((size_t)slot >= b->nslots) {
+    FAUSTFLOAT **slots = resizebytes(b->slots, b->nslots*sizeof(FAUSTFLOAT*),
+                                     (slot+1)*sizeof(FAUSTFLOAT*));
+    if (!slots) {
+      pd_error(x->f_owner, "faustgen2~: memory allocation failed - presets");
+      return -1;
+    }
+    memset(slots+b->nslots, 0, (slot+1-b->nslots)*sizeof(FAUSTFLOAT*));
+    b->slots = slots;
+    b->nslots = slot+1;
+  }
+  if (!b->slots[slot]) {
+    b->slots[slot] = getbytes(t->n*sizeof(FAUSTFLOAT));
+    if (!b->slots[slot]) {
+      pd_error(x->f_owner, "faustgen2~: memory allocation failed - presets");
+      return -1;
+    }
+  }
+  x->f_zone->gather(t->zones, NULL, t->n, b->slots[slot]);
+  return 0;
+}
 
-int faust_ui_manager_dump(t_faust_ui_manager const *x, t_symbol *s, t_outlet *out, t_symbol *outsym)
+int faust_ui_manager_preset_recall(t_faust_ui_manager *x, int slot)
 {
-    t_faust_ui *c = x->f_uis;
-    t_atom argv[DUMP_MAX_ARGS];
-    int argc = 0, n = 0;
-    if (outsym && !outsym->s_thing) return 0;
-    while(c)
-    {
-      if (!c->p_voice) {
-        SETSYMBOL(argv+argc, c->p_name); argc++;
-        SETSYMBOL(argv+argc, c->p_longname); argc++;
-        SETSYMBOL(argv+argc, gensym(faust_ui_manager_get_parameter_char(c->p_type))); argc++;
-        SETFLOAT(argv+argc, c->p_default); argc++;
-        SETFLOAT(argv+argc, c->p_min); argc++;
-        SETFLOAT(argv+argc, c->p_max); argc++;
-        SETFLOAT(argv+argc, faustflt(x, c->p_zone)); argc++;
-        if (c->p_midi) {
-          for (size_t i = 0; i < c->p_nmidi && argc+3 < DUMP_MAX_ARGS; i++) {
-            char buf[MAXPDSTRING];
-            snprintf(buf, MAXPDSTRING, "midi:%s",
-                     midi_key[c->p_midi[i].msg]);
-            SETSYMBOL(argv+argc, gensym(buf)); argc++;
-            if (c->p_midi[i].chan >= 0) {
+  const t_faust_bank *b = &x->f_bank;
+  const t_faust_ctltab *t = &x->f_ctl;
+  const FAUSTFLOAT *v;
+  if (slot < 0 || (size_t)slot >= b->nslots || !b->slots[slot] || b->n != t->n)
+    return -1;
+  v = b->slots[slot];
+  faust_morph_free(&x->f_morph);
+  faust_ui_manager_clear_ramps(x);
+  // Clamp the values to the control ranges like faust_ui_set_value does,
+  // since the slot may come from a bank file or an earlier version of the
+  // dsp. Then write all active controls in one go and refresh the gui.
+  for (size_t k = 0; k < t->nactive; k++) {
+    const size_t i = t->active[k];
+    FAUSTFLOAT f = v[i];
+    if (t->type[i] == FAUST_UI_TYPE_BUTTON || t->type[i] == FAUST_UI_TYPE_TOGGLE)
+      f = (FAUSTFLOAT)(f > FLT_EPSILON);
+    else
+      f = f < t->min[i] ? t->min[i] : f > t->max[i] ? t->max[i] : f;
+    t->values[i] = f;
+  }
+  x->f_zone->scatter(t->zones, t->active, t->nactive, t->values);
+  for (size_t k = 0; k < t->nactive; k++) {
+    const size_t i = t->active[k];
+    gui_update(t->values[i], t->uis[i]->p_uirecv);
+  }
+  return 0;
+}
+
+int faust_ui_manager_preset_delete(t_faust_ui_manager *x, int slot)
+{
+  t_faust_bank *b = &x->f_bank;
+  if (slot < 0 || (size_t)slot >= b->nslots || !b->slots[slot])
+    return -1;
+  freebytes(b->slots[slot], b->n*sizeof(FAUSTFLOAT));
+  b->slots[slot] = NULL;
+  return 0;
+}
+
+static void faust_morph_free(t_faust_morph *m)
+{
+  if (m->from) freebytes(m->from, m->n*sizeof(FAUSTFLOAT));
+  if (m->to) freebytes(m->to, m->n*sizeof(FAUSTFLOAT));
+  if (m->v) freebytes(m->v, m->n*sizeof(FAUSTFLOAT));
+  memset(m, 0, sizeof(t_faust_morph));
+}
+
+int faust_ui_manager_preset_morph(t_faust_ui_manager *x, int from, int to,
+                                  double nsamples)
+{
+  const t_faust_bank *b = &x->f_bank;
+  const t_faust_ctltab *t = &x->f_ctl;
+  t_faust_morph *m = &x->f_morph;
+  if (from < 0 || (size_t)from >= b->nslots || !b->slots[from] ||
+      to < 0 || (size_t)to >= b->nslots || !b->slots[to] || b->n != t->n)
+    return -1;
+  if (nsamples < 1.0)
+    return faust_ui_manager_preset_recall(x, to);
+  faust_morph_free(m);
+  m->from = getbytes(t->n*sizeof(FAUSTFLOAT));
+  m->to = getbytes(t->n*sizeof(FAUSTFLOAT));
+  m->v = getbytes(t->n*sizeof(FAUSTFLOAT));
+  if (!m->from || !m->to || !m->v) {
+    if (m->from) freebytes(m->from, t->n*sizeof(FAUSTFLOAT));
+    if (m->to) freebytes(m->to, t->n*sizeof(FAUSTFLOAT));
+    if (m->v) freebytes(m->v, t->n*sizeof(FAUSTFLOAT));
+    memset(m, 0, sizeof(t_faust_morph));
+    pd_error(x->f_owner, "faustgen2~: memory allocation failed - morph");
+    return -1;
+  }
+  // keep copies, so that the presets may change while we're morphing
+  memcpy(m->from, b->slots[from], t->n*sizeof(FAUSTFLOAT));
+  memcpy(m->to, b->slots[to], t->n*sizeof(FAUSTFLOAT));
+  faust_ui_manager_clear_ramps(x);
+  m->n = t->n;
+  m->pos = 0.0;
+  m->inc = 1.0/nsamples;
+  return 0;
+}
+
+int faust_ui_manager_preset_morph_tick(t_faust_ui_manager *x, int nsamples)
+{
+  const t_faust_ctltab *t = &x->f_ctl;
+  t_faust_morph *m = &x->f_morph;
+  const FAUSTFLOAT *a = m->from, *b = m->to;
+  FAUSTFLOAT *v = m->v;
+  FAUSTFLOAT p;
+  size_t i, n = m->n;
+  bool done;
+  if (!n) return 0;
+  if (n != t->n) {
+    faust_morph_free(m);
+    return 0;
+  }
+  m->pos += nsamples*m->inc;
+  done = m->pos >= 1.0;
+  p = done ? 1.0 : m->pos;
+  // Interpolate all values in one go, then fix up the controls which need
+  // it: numbers are quantized to their step sizes and clamped to their
+  // ranges, buttons and toggles switch at the end.
+  for (i = 0; i < n; i++)
+    v[i] = a[i] + p*(b[i]-a[i]);
+  for (size_t k = 0; k < t->nactive; k++) {
+    i = t->active[k];
+    if (t->type[i] == FAUST_UI_TYPE_NUMBER) {
+      if (t->step[i] > 0)
+        v[i] = t->min[i] + t->step[i]*round((v[i]-t->min[i])/t->step[i]);
+      v[i] = v[i] < t->min[i] ? t->min[i] : v[i] > t->max[i] ? t->max[i] : v[i];
+    } else {
+      v[i] = done ? b[i] : a[i];
+    }
+  }
+  x->f_zone->scatter(t->zones, t->active, t->nactive, v);
+  if (done) {
+    // refresh the gui once we're done
+    for (size_t k = 0; k < t->nactive; k++) {
+      i = t->active[k];
+      gui_update(v[i], t->uis[i]->p_uirecv);
+    }
+    faust_morph_free(m);
+  }
+  return 1;
+}
+
+void faust_ui_manager_preset_clear(t_faust_ui_manager *x)
+{
+  faust_bank_free_slots(&x->f_bank);
+}
+
+int faust_ui_manager_preset_list(t_faust_ui_manager const *x, t_atom **argv)
+{
+  const t_faust_bank *b = &x->f_bank;
+  int n = 0;
+  *argv = NULL;
+  for (size_t i = 0; i < b->nslots; i++)
+    if (b->slots[i]) n++;
+  if (n && (*argv = getbytes(n*sizeof(t_atom)))) {
+    n = 0;
+    for (size_t i = 0; i < b->nslots; i++)
+      if (b->slots[i]) SETFLOAT(*argv+n++, i);
+  } else
+    n = 0;
+  return n;
+}
+
+// Bank files are written in native byte order:
+// "FGPB", version, number of controls n, number of stored presets m (all
+// uint32), the n control names (uint32 length + characters), then the m
+// presets (uint32 slot number + n double values).
+#define FAUST_BANK_MAGIC "FGPB"
+#define FAUST_BANK_VERSION 1
+
+static bool bank_write_u32(FILE *fp, uint32_t v)
+{
+  return fwrite(&v, sizeof(v), 1, fp) == 1;
+}
+
+static bool bank_read_u32(FILE *fp, uint32_t *v)
+{
+  return fread(v, sizeof(*v), 1, fp) == 1;
+}
+
+int faust_ui_manager_preset_save(t_faust_ui_manager const *x, const char *path)
+{
+  const t_faust_bank *b = &x->f_bank;
+  FILE *fp = fopen(path, "wb");
+  uint32_t m = 0;
+  bool ok;
+  size_t i;
+  if (!fp) {
+    pd_error(x->f_owner, "faustgen2~: can't open %s", path);
+    return -1;
+  }
+  for (i = 0; i < b->nslots; i++)
+    if (b->slots[i]) m++;
+  ok = fwrite(FAUST_BANK_MAGIC, 4, 1, fp) == 1 &&
+    bank_write_u32(fp, FAUST_BANK_VERSION) &&
+    bank_write_u32(fp, b->n) && bank_write_u32(fp, m);
+  for (i = 0; ok && i < b->n; i++) {
+    const uint32_t l = strlen(b->names[i]->s_name);
+    ok = bank_write_u32(fp, l) && fwrite(b->names[i]->s_name, 1, l, fp) == l;
+  }
+  for (i = 0; ok && i < b->nslots; i++) {
+    if (!b->slots[i]) continue;
+    ok = bank_write_u32(fp, i);
+    for (size_t j = 0; ok && j < b->n; j++) {
+      const double v = b->slots[i][j];
+      ok = fwrite(&v, sizeof(v), 1, fp) == 1;
+    }
+  }
+  if (fclose(fp) || !ok) {
+    pd_error(x->f_owner, "faustgen2~: error writing %s", path);
+    return -1;
+  }
+  return 0;
+}
+
+int faust_ui_manager_preset_load(t_faust_ui_manager *x, const char *path)
+{
+  t_faust_bank nb = { 0, NULL, 0, NULL };
+  FILE *fp = fopen(path, "rb");
+  char magic[4], name[MAXPDSTRING];
+  uint32_t version, n, m, i, j, l, slot;
+  bool ok;
+  if (!fp) {
+    pd_error(x->f_owner, "faustgen2~: can't open %s", path);
+    return -1;
+  }
+  ok = fread(magic, 4, 1, fp) == 1 && memcmp(magic, FAUST_BANK_MAGIC, 4) == 0 &&
+    bank_read_u32(fp, &version) && version == FAUST_BANK_VERSION &&
+    bank_read_u32(fp, &n) && bank_read_u32(fp, &m);
+  if (ok && n) {
+    nb.names = getbytes(n*sizeof(t_symbol*));
+    ok = nb.names != NULL;
+    if (ok) nb.n = n;
+  }
+  for (i = 0; ok && i < n; i++) {
+    ok = bank_read_u32(fp, &l) && l < MAXPDSTRING && fread(name, 1, l, fp) == l;
+    if (ok) {
+      name[l] = 0;
+      nb.names[i] = gensym(name);
+    }
+  }
+  for (i = 0; ok && i < m; i++) {
+    ok = bank_read_u32(fp, &slot) && slot < 0x10000;
+    if (ok && slot >= nb.nslots) {
+      FAUSTFLOAT **slots = resizebytes(nb.slots, nb.nslots*sizeof(FAUSTFLOAT*),
+                                       (slot+1)*sizeof(FAUSTFLOAT*));
+      ok = slots != NULL;
+      if (ok) {
+        memset(slots+nb.nslots, 0, (slot+1-nb.nslots)*sizeof(FAUSTFLOAT*));
+        nb.slots = slots;
+        nb.nslots = slot+1;
+      }
+    }
+    if (ok && n && !nb.slots[slot]) {
+      nb.slots[slot] = getbytes(n*sizeof(FAUSTFLOAT));
+      ok = nb.slots[slot] != NULL;
+    }
+    for (j = 0; ok && j < n; j++) {
+      double v;
+      ok = fread(&v, sizeof(v), 1, fp) == 1;
+      if (ok) nb.slots[slot][j] = v;
+    }
+  }
+  fclose(fp);
+  if (!ok) {
+    faust_bank_free(&nb);
+    pd_error(x->f_owner, "faustgen2~: bad preset bank %s", path);
+    return -1;
+  }
+  faust_bank_free(&x->f_bank);
+  x->f_bank = nb;
+  // map the presets to the current control table
+  faust_ui_manager_update_bank(x);
+  return 0;
+}
+
+// STATE PERSISTENCE
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+// The state is saved in the patch as '#A state n name1 ... namen blob...',
+// followed by '#A statepreset slot blob...' for each stored preset. The blobs
+// hold the values as doubles, split into STATE_WORDS 16 bit words (least
+// significant first) which are stored as float atoms. Pd saves floats with 6
+// significant digits, which is enough for 16 bits but not for 24. Unlike
+// encoded symbols, these don't fill up Pd's symbol table.
+#define STATE_WORDS 4
+
+static void state_add_blob(t_binbuf *b, const FAUSTFLOAT *v, size_t n)
+{
+  t_atom a[STATE_WORDS];
+  for (size_t i = 0; i < n; i++) {
+    double d = v[i];
+    uint64_t u;
+    memcpy(&u, &d, sizeof(u));
+    for (int j = 0; j < STATE_WORDS; j++)
+      SETFLOAT(a+j, (t_float)((u >> (16*j)) & 0xffff));
+    binbuf_add(b, STATE_WORDS, a);
+  }
+}
+
+// Decode n values from the given blob atoms into v. Returns 0 on success.
+static int state_get_blob(int argc, const t_atom *argv, FAUSTFLOAT *v, size_t n)
+{
+  if (argc < 0 || (size_t)argc != STATE_WORDS*n) return -1;
+  for (size_t i = 0; i < n; i++) {
+    uint64_t u = 0;
+    double d;
+    for (int j = 0; j < STATE_WORDS; j++, argv++) {
+      t_float f;
+      if (argv->a_type != A_FLOAT) return -1;
+      f = argv->a_w.w_float;
+      if (f < 0 || f > 0xffff || f != (int)f) return -1;
+      u |= (uint64_t)f << (16*j);
+    }
+    memcpy(&d, &u, sizeof(d));
+    v[i] = d;
+  }
+  return 0;
+}
+
+void faust_ui_manager_save_state(t_faust_ui_manager const *x, t_binbuf *b)
+{
+  const t_faust_ctltab *t = &x->f_ctl;
+  const t_faust_bank *k = &x->f_bank;
+  if (!t->n) return;
+  binbuf_addv(b, "ssi", gensym("#A"), gensym("state"), (int)t->n);
+  for (size_t i = 0; i < t->n; i++)
+    binbuf_addv(b, "s", t->uis[i]->p_longname);
+  x->f_zone->gather(t->zones, NULL, t->n, t->values);
+  state_add_blob(b, t->values, t->n);
+  binbuf_addsemi(b);
+  if (k->n != t->n) return;
+  for (size_t i = 0; i < k->nslots; i++) {
+    if (!k->slots[i]) continue;
+    binbuf_addv(b, "ssi", gensym("#A"), gensym("statepreset"), (int)i);
+    state_add_blob(b, k->slots[i], k->n);
+    binbuf_addsemi(b);
+  }
+}
+
+int faust_ui_manager_load_state(t_faust_ui_manager *x, int argc, t_atom const *argv)
+{
+  const t_faust_ctltab *t = &x->f_ctl;
+  FAUSTFLOAT *v;
+  size_t n, i;
+  faust_ui_manager_free_statemap(x);
+  if (argc < 1 || argv[0].a_type != A_FLOAT || argv[0].a_w.w_float < 1 ||
+      (size_t)argv[0].a_w.w_float >= (size_t)argc)
+    return -1;
+  n = argv[0].a_w.w_float;
+  x->f_statemap = getbytes(n*sizeof(size_t));
+  v = getbytes(n*sizeof(FAUSTFLOAT));
+  if (!x->f_statemap || !v) {
+    if (x->f_statemap) freebytes(x->f_statemap, n*sizeof(size_t));
+    if (v) freebytes(v, n*sizeof(FAUSTFLOAT));
+    x->f_statemap = NULL;
+    pd_error(x->f_owner, "faustgen2~: memory allocation failed - state");
+    return -1;
+  }
+  x->f_nstatemap = n;
+  // match the controls by their long names
+  for (i = 0; i < n; i++) {
+    t_faust_ui *c = argv[i+1].a_type == A_SYMBOL ?
+      faust_symtab_lookup(&x->f_lookup, argv[i+1].a_w.w_symbol) : NULL;
+    x->f_statemap[i] = c && c->p_slot < t->n && t->uis[c->p_slot] == c ?
+      c->p_slot : SIZE_MAX;
+  }
+  if (state_get_blob(argc-n-1, argv+n+1, v, n)) {
+    freebytes(v, n*sizeof(FAUSTFLOAT));
+    faust_ui_manager_free_statemap(x);
+    pd_error(x->f_owner, "faustgen2~: bad saved state");
+    return -1;
+  }
+  // restore the active controls in one pass
+  for (i = 0; i < n; i++) {
+    const size_t j = x->f_statemap[i];
+    if (j != SIZE_MAX && t->type[j] != FAUST_UI_TYPE_BARGRAPH &&
+        !t->uis[j]->p_voice) {
+      faust_ui_ramp_cancel(x, t->uis[j]);
+      setfaustflt(x, t->zones[j], v[i]);
+      gui_update(v[i], t->uis[j]->p_uirecv);
+    }
+  }
+  freebytes(v, n*sizeof(FAUSTFLOAT));
+  return 0;
+}
+
+int faust_ui_manager_load_preset(t_faust_ui_manager *x, int argc, t_atom const *argv)
+{
+  const size_t n = x->f_nstatemap;
+  FAUSTFLOAT *v, *p;
+  int slot;
+  if (!x->f_statemap || argc < 1 || argv[0].a_type != A_FLOAT ||
+      argv[0].a_w.w_float < 0)
+    return -1;
+  slot = argv[0].a_w.w_float;
+  v = getbytes(n*sizeof(FAUSTFLOAT));
+  if (!v) {
+    pd_error(x->f_owner, "faustgen2~: memory allocation failed - state");
+    return -1;
+  }
+  if (state_get_blob(argc-1, argv+1, v, n)) {
+    freebytes(v, n*sizeof(FAUSTFLOAT));
+    pd_error(x->f_owner, "faustgen2~: bad saved preset %d", slot);
+    return -1;
+  }
+  // controls which aren't in the saved preset keep their current values
+  if (!faust_ui_manager_preset_store(x, slot)) {
+    p = x->f_bank.slots[slot];
+    for (size_t i = 0; i < n; i++)
+      if (x->f_statemap[i] != SIZE_MAX) p[x->f_statemap[i]] = v[i];
+  }
+  freebytes(v, n*sizeof(FAUSTFLOAT));
+  return 0;
+}
+
+// AUTOMATION
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Automation files are written in native byte order: "FGAL", version, number
+// of controls n (all uint32), the n control names (uint32 length +
+// characters), then the events, each consisting of the time since the
+// previous event in samples (uint32), the control index (uint32), the value
+// and the ramp time in msecs (both double). The last event is an AUTO_END
+// marker which gives the length of the recording; AUTO_SKIP markers fill in
+// delays which don't fit into 32 bits.
+#define FAUST_AUTO_MAGIC "FGAL"
+#define FAUST_AUTO_VERSION 2
+#define AUTO_END  UINT32_MAX
+#define AUTO_SKIP (UINT32_MAX-1)
+
+static void faust_auto_free(t_faust_auto *a)
+{
+  if (a->fp) fclose(a->fp);
+  if (a->names) freebytes(a->names, a->n*sizeof(t_symbol*));
+  if (a->slots) freebytes(a->slots, a->n*sizeof(size_t));
+  if (a->ctls) freebytes(a->ctls, a->nctls*sizeof(size_t));
+  if (a->ring) freebytes(a->ring, AUTO_RING*sizeof(t_faust_auto_event));
+  a->fp = NULL;
+  a->names = NULL;
+  a->slots = a->ctls = NULL;
+  a->ring = NULL;
+  a->n = a->nctls = 0;
+  a->head = a->tail = 0;
+  a->state = AUTO_IDLE;
+}
+
+// Map the control names of the lane to the current control table. Only
+// active controls which aren't voice controls can be automated.
+static void faust_ui_manager_update_auto(t_faust_ui_manager *x)
+{
+  t_faust_auto *a = &x->f_auto;
+  const t_faust_ctltab *t = &x->f_ctl;
+  size_t i;
+  if (a->state == AUTO_IDLE) return;
+  if (a->ctls) freebytes(a->ctls, a->nctls*sizeof(size_t));
+  a->nctls = t->n;
+  a->ctls = t->n ? getbytes(t->n*sizeof(size_t)) : NULL;
+  if (t->n && !a->ctls) {
+    a->nctls = 0;
+    if (!x->f_quiet) pd_error(x->f_owner, "faustgen2~: memory allocation failed - automation");
+  }
+  for (i = 0; i < a->nctls; i++)
+    a->ctls[i] = SIZE_MAX;
+  for (i = 0; i < a->n; i++) {
+    t_faust_ui *c = (t_faust_ui*)faust_symtab_lookup(&x->f_lookup, a->names[i]);
+    a->slots[i] = SIZE_MAX;
+    if (c && c->p_slot < t->n && t->uis[c->p_slot] == c && !c->p_voice &&
+        (c->p_type == FAUST_UI_TYPE_BUTTON || c->p_type == FAUST_UI_TYPE_TOGGLE ||
+         c->p_type == FAUST_UI_TYPE_NUMBER)) {
+      a->slots[i] = c->p_slot;
+      if (c->p_slot < a->nctls) a->ctls[c->p_slot] = i;
+    }
+  }
+}
+
+static bool auto_write_event(FILE *fp, uint32_t delta, uint32_t ctl, double v, double ms)
+{
+  return bank_write_u32(fp, delta) && bank_write_u32(fp, ctl) &&
+    fwrite(&v, sizeof(v), 1, fp) == 1 && fwrite(&ms, sizeof(ms), 1, fp) == 1;
+}
+
+static bool auto_write_delta(FILE *fp, uint64_t delta, uint32_t ctl, double v, double ms)
+{
+  bool ok = true;
+  for (; ok && delta >= AUTO_SKIP; delta -= AUTO_SKIP)
+    ok = auto_write_event(fp, AUTO_SKIP, AUTO_SKIP, 0.0, 0.0);
+  return ok && auto_write_event(fp, delta, ctl, v, ms);
+}
+
+// Record a control change, ramping over the given time (if positive).
+// Messages arriving between dsp blocks are stamped with their logical time
+// relative to the last block, so that changes triggered by clocks keep their
+// timing within the block.
+static void faust_ui_auto_push(t_faust_ui_manager *x, const t_faust_ui *ui, FAUSTFLOAT v, double ms)
+{
+  t_faust_auto *a = &x->f_auto;
+  t_faust_auto_event *e;
+  double off;
+  if (a->state != AUTO_RECORD || ui->p_slot >= a->nctls ||
+      x->f_ctl.uis[ui->p_slot] != ui || a->ctls[ui->p_slot] == SIZE_MAX)
+    return;
+  if (a->head - a->tail >= AUTO_RING) {
+    a->dropped++;
+    return;
+  }
+  off = a->sr > 0.0 ? clock_gettimesince(a->systime)*a->sr/1000.0 : 0.0;
+  if (off < 0.0) off = 0.0;
+  if (off > a->nsamples-1) off = a->nsamples > 0 ? a->nsamples-1 : 0;
+  e = a->ring + (a->head & (AUTO_RING-1));
+  e->time = a->pos + (uint64_t)off;
+  // keep the events in time order
+  if (a->head > a->tail && e->time < a->ring[(a->head-1) & (AUTO_RING-1)].time)
+    e->time = a->ring[(a->head-1) & (AUTO_RING-1)].time;
+  e->ctl = a->ctls[ui->p_slot];
+  e->value = v;
+  e->ms = ms > 0 ? ms : 0;
+  a->head++;
+}
+
+static int faust_ui_manager_auto_open(t_faust_ui_manager *x, int state)
+{
+  t_faust_auto *a = &x->f_auto;
+  a->ring = getbytes(AUTO_RING*sizeof(t_faust_auto_event));
+  a->slots = a->n ? getbytes(a->n*sizeof(size_t)) : NULL;
+  if (!a->ring || (a->n && !a->slots)) {
+    pd_error(x->f_owner, "faustgen2~: memory allocation failed - automation");
+    faust_auto_free(a);
+    return -1;
+  }
+  a->state = state;
+  a->head = a->tail = 0;
+  a->last = a->start = a->pos;
+  a->eof = false;
+  a->dropped = 0;
+  faust_ui_manager_update_auto(x);
+  return 0;
+}
+
+int faust_ui_manager_auto_record(t_faust_ui_manager *x, const char *path)
+{
+  t_faust_auto *a = &x->f_auto;
+  const t_faust_ctltab *t = &x->f_ctl;
+  bool ok;
+  size_t i;
+  faust_ui_manager_auto_stop(x);
+  a->fp = fopen(path, "wb");
+  if (!a->fp) {
+    pd_error(x->f_owner, "faustgen2~: can't open %s", path);
+    return -1;
+  }
+  ok = fwrite(FAUST_AUTO_MAGIC, 4, 1, a->fp) == 1 &&
+    bank_write_u32(a->fp, FAUST_AUTO_VERSION) && bank_write_u32(a->fp, t->n);
+  for (i = 0; ok && i < t->n; i++) {
+    const char *name = t->uis[i]->p_longname->s_name;
+    const uint32_t l = strlen(name);
+    ok = bank_write_u32(a->fp, l) && fwrite(name, 1, l, a->fp) == l;
+  }
+  if (ok && t->n) {
+    a->names = getbytes(t->n*sizeof(t_symbol*));
+    ok = a->names != NULL;
+    if (ok) {
+      a->n = t->n;
+      for (i = 0; i < t->n; i++)
+        a->names[i] = t->uis[i]->p_longname;
+    }
+  }
+  if (!ok) {
+    pd_error(x->f_owner, "faustgen2~: error writing %s", path);
+    faust_auto_free(a);
+    return -1;
+  }
+  return faust_ui_manager_auto_open(x, AUTO_RECORD);
+}
+
+int faust_ui_manager_auto_play(t_faust_ui_manager *x, const char *path, int loop)
+{
+  t_faust_auto *a = &x->f_auto;
+  char magic[4], name[MAXPDSTRING];
+  uint32_t version, n, i, l;
+  bool ok;
+  faust_ui_manager_auto_stop(x);
+  a->fp = fopen(path, "rb");
+  if (!a->fp) {
+    pd_error(x->f_owner, "faustgen2~: can't open %s", path);
+    return -1;
+  }
+  ok = fread(magic, 4, 1, a->fp) == 1 && memcmp(magic, FAUST_AUTO_MAGIC, 4) == 0 &&
+    bank_read_u32(a->fp, &version) && version == FAUST_AUTO_VERSION &&
+    bank_read_u32(a->fp, &n) && n < AUTO_SKIP;
+  if (ok && n) {
+    a->names = getbytes(n*sizeof(t_symbol*));
+    ok = a->names != NULL;
+    if (ok) a->n = n;
+  }
+  for (i = 0; ok && i < n; i++) {
+    ok = bank_read_u32(a->fp, &l) && l < MAXPDSTRING && fread(name, 1, l, a->fp) == l;
+    if (ok) {
+      name[l] = 0;
+      a->names[i] = gensym(name);
+    }
+  }
+  if (ok) a->data = ftell(a->fp);
+  if (!ok || a->data < 0) {
+    pd_error(x->f_owner, "faustgen2~: bad automation file %s", path);
+    faust_auto_free(a);
+    return -1;
+  }
+  a->loop = loop != 0;
+  if (faust_ui_manager_auto_open(x, AUTO_PLAY)) return -1;
+  faust_ui_manager_auto_flush(x);
+  return 0;
+}
+
+void faust_ui_manager_auto_stop(t_faust_ui_manager *x)
+{
+  t_faust_auto *a = &x->f_auto;
+  if (a->state == AUTO_RECORD) {
+    faust_ui_manager_auto_flush(x);
+    // mark the end of the recording
+    if (!auto_write_delta(a->fp, a->pos > a->last ? a->pos - a->last : 0,
+                          AUTO_END, 0.0, 0.0) ||
+        fflush(a->fp))
+      pd_error(x->f_owner, "faustgen2~: error writing automation file");
+    if (a->dropped)
+      pd_error(x->f_owner, "faustgen2~: automation: %lu events dropped",
+               (unsigned long)a->dropped);
+  }
+  faust_auto_free(a);
+}
+
+int faust_ui_manager_auto_state(t_faust_ui_manager const *x)
+{
+  return x->f_auto.state;
+}
+
+int faust_ui_manager_auto_flush(t_faust_ui_manager *x)
+{
+  t_faust_auto *a = &x->f_auto;
+  if (a->state == AUTO_RECORD) {
+    // write out the recorded events
+    bool ok = true;
+    for (; ok && a->tail != a->head; a->tail++) {
+      const t_faust_auto_event *e = a->ring + (a->tail & (AUTO_RING-1));
+      ok = auto_write_delta(a->fp, e->time - a->last, e->ctl, e->value, e->ms);
+      a->last = e->time;
+    }
+    if (!ok) {
+      pd_error(x->f_owner, "faustgen2~: error writing automation file");
+      faust_auto_free(a);
+      return 0;
+    }
+    return 1;
+  } else if (a->state == AUTO_PLAY) {
+    // read ahead as far as the ring buffer permits
+    while (!a->eof && a->head - a->tail < AUTO_RING) {
+      uint32_t delta, ctl;
+      double v, ms;
+      if (!bank_read_u32(a->fp, &delta) || !bank_read_u32(a->fp, &ctl) ||
+          fread(&v, sizeof(v), 1, a->fp) != 1 || fread(&ms, sizeof(ms), 1, a->fp) != 1) {
+        // truncated file, stop here
+        a->eof = true;
+      } else if (ctl == AUTO_END) {
+        a->last += delta;
+        if (a->loop && a->last > a->start &&
+            fseek(a->fp, a->data, SEEK_SET) == 0) {
+          // start over
+          a->start = a->last;
+        } else {
+          a->eof = true;
+        }
+      } else if (ctl == AUTO_SKIP) {
+        a->last += delta;
+      } else if (ctl < a->n) {
+        t_faust_auto_event *e = a->ring + (a->head & (AUTO_RING-1));
+        a->last += delta;
+        e->time = a->last;
+        e->ctl = ctl;
+        e->value = v;
+        e->ms = ms > 0 ? ms : 0;
+        a->head++;
+      }
+    }
+    // done when all events have been played and the end of the recording
+    // has been reached
+    if (a->eof && a->tail == a->head && a->pos >= a->last) {
+      faust_auto_free(a);
+      return 0;
+    }
+    return 1;
+  }
+  return 0;
+}
+
+// offset of an event in the current dsp block (late events go first)
+static int auto_offset(const t_faust_auto *a, const t_faust_auto_event *e)
+{
+  return e->time > a->pos ? (e->time - a->pos > INT_MAX ? INT_MAX : (int)(e->time - a->pos)) : 0;
+}
+
+int faust_ui_manager_auto_next(t_faust_ui_manager const *x, int from, int nsamples)
+{
+  const t_faust_auto *a = &x->f_auto;
+  if (a->state != AUTO_PLAY) return nsamples;
+  for (size_t k = a->tail; k != a->head; k++) {
+    const int off = auto_offset(a, a->ring + (k & (AUTO_RING-1)));
+    if (off > from) return off < nsamples ? off : nsamples;
+  }
+  return nsamples;
+}
+
+void faust_ui_manager_auto_apply(t_faust_ui_manager *x, t_faust_ui_manager const *src,
+                                 int from, int to)
+{
+  // This requires that both managers belong to instances of the same dsp,
+  // so that the control tables are laid out in the same way.
+  const t_faust_auto *a = &src->f_auto;
+  const t_faust_ctltab *t = &x->f_ctl;
+  if (a->state != AUTO_PLAY) return;
+  for (size_t k = a->tail; k != a->head; k++) {
+    const t_faust_auto_event *e = a->ring + (k & (AUTO_RING-1));
+    const int off = auto_offset(a, e);
+    size_t i;
+    if (off < from) continue;
+    if (off >= to) break;
+    i = a->slots[e->ctl];
+    if (i >= t->n) continue;
+    if (e->ms > 0 && t->type[i] == FAUST_UI_TYPE_NUMBER) {
+      // recorded ramp (ramp message or [smooth:ms])
+      faust_ui_ramp(x, t->uis[i], e->value, e->ms);
+    } else if (t->type[i] == FAUST_UI_TYPE_NUMBER) {
+      const FAUSTFLOAT v = e->value;
+      faust_ui_ramp_cancel(x, t->uis[i]);
+      setfaustflt(x, t->zones[i], v < t->min[i] ? t->min[i] : v > t->max[i] ? t->max[i] : v);
+    } else {
+      faust_ui_ramp_cancel(x, t->uis[i]);
+      setfaustflt(x, t->zones[i], e->value);
+    }
+  }
+}
+
+void faust_ui_manager_auto_tick(t_faust_ui_manager *x, int nsamples, double sr)
+{
+  t_faust_auto *a = &x->f_auto;
+  if (a->state == AUTO_PLAY) {
+    // discard the events of this block
+    while (a->tail != a->head &&
+           auto_offset(a, a->ring + (a->tail & (AUTO_RING-1))) < nsamples)
+      a->tail++;
+  }
+  a->pos += nsamples;
+  a->nsamples = nsamples;
+  a->systime = clock_getlogicaltime();
+  a->sr = sr;
+}
+
+void faust_ui_manager_restore_default(t_faust_ui_manager *x)
+{
+    const t_faust_ctltab *t = &x->f_ctl;
+    faust_ui_manager_all_notes_off(x);
+    faust_ui_manager_clear_ramps(x);
+    for(size_t i = 0; i < t->n; i++)
+    {
+        set_zone(x, t->zones[i], t->init[i], t->uis[i]->p_uirecv);
+    }
+}
+
+static const char* faust_ui_manager_get_parameter_char(int const type)
+{
+    if(type == FAUST_UI_TYPE_BUTTON)
+        return "button";
+    else if(type == FAUST_UI_TYPE_TOGGLE)
+        return "toggle";
+    else if(type == FAUST_UI_TYPE_NUMBER)
+        return "number";
+    else
+        return "bargraph";
+}
+
+void faust_ui_manager_print(t_faust_ui_manager const *x, char const log)
+{
+    t_faust_ui *c = x->f_uis;
+    while(c)
+    {
+      if (!c->p_voice) {
+        const t_symbol *name = c->p_name, *lname = c->p_longname;
+        logpost(x->f_owner, 2+log, "parameter: %s [path:%s - type:%s - init:%g - min:%g - max:%g - current:%g]",
+                name->s_name, lname->s_name,
+                faust_ui_manager_get_parameter_char(c->p_type),
+                c->p_default, c->p_min, c->p_max, faustflt(x, c->p_zone));
+        if (c->p_midi) {
+          for (size_t i = 0; i < c->p_nmidi; i++) {
+            if (c->p_midi[i].chan >= 0) {
+              if (midi_argc[c->p_midi[i].msg] > 1)
+                logpost(x->f_owner, 3, "parameter: %s [midi:%s %d %d]", name->s_name,
+                        midi_key[c->p_midi[i].msg], c->p_midi[i].num,
+                        c->p_midi[i].chan);
+              else
+                logpost(x->f_owner, 3, "parameter: %s [midi:%s %d]", name->s_name,
+                        midi_key[c->p_midi[i].msg], c->p_midi[i].chan);
+            } else {
+              if (midi_argc[c->p_midi[i].msg] > 1)
+                logpost(x->f_owner, 3, "parameter: %s [midi:%s %d]", name->s_name,
+                        midi_key[c->p_midi[i].msg], c->p_midi[i].num);
+              else
+                logpost(x->f_owner, 3, "parameter: %s [midi:%s]", name->s_name,
+                        midi_key[c->p_midi[i].msg]);
+            }
+          }
+        }
+        if (c->p_osc) {
+          for (size_t i = 0; i < c->p_nosc; i++) {
+            logpost(x->f_owner, 3, "parameter: %s [osc:%s %lg %lg]",
+                    name->s_name,
+                    c->p_osc[i].msg->s_name, c->p_osc[i].a,
+                    c->p_osc[i].b);
+          }
+        }
+      }
+      c = c->p_next;
+    }
+}
+
+#define DUMP_MAX_ARGS 100
+
+int faust_ui_manager_dump(t_faust_ui_manager const *x, t_symbol *s, t_outlet *out, t_symbol *outsym)
+{
+    t_faust_ui *c = x->f_uis;
+    t_atom argv[DUMP_MAX_ARGS];
+    int argc = 0, n = 0;
+    if (outsym && !outsym->s_thing) return 0;
+    while(c)
+    {
+      if (!c->p_voice) {
+        SETSYMBOL(argv+argc, c->p_name); argc++;
+        SETSYMBOL(argv+argc, c->p_longname); argc++;
+        SETSYMBOL(argv+argc, gensym(faust_ui_manager_get_parameter_char(c->p_type))); argc++;
+        SETFLOAT(argv+argc, c->p_default); argc++;
+        SETFLOAT(argv+argc, c->p_min); argc++;
+        SETFLOAT(argv+argc, c->p_max); argc++;
+        SETFLOAT(argv+argc, faustflt(x, c->p_zone)); argc++;
+        if (c->p_midi) {
+          for (size_t i = 0; i < c->p_nmidi && argc+3 < DUMP_MAX_ARGS; i++) {
+            char buf[MAXPDSTRING];
+            snprintf(buf, MAXPDSTRING, "midi:%s",
+                     midi_key[c->p_midi[i].msg]);
+            SETSYMBOL(argv+argc, gensym(buf)); argc++;
+            if (c->p_midi[i].chan >= 0) {
               if (midi_argc[c->p_midi[i].msg] > 1) {
                 SETFLOAT(argv+argc, c->p_midi[i].num); argc++;
                 SETFLOAT(argv+argc, c->p_midi[i].chan); argc++;
@@ -1786,40 +4078,68 @@ int faust_ui_manager_dump(t_faust_ui_manager const *x, t_symbol *s, t_outlet *ou
     return n;
 }
 
-void faust_ui_manager_set_tuning(t_faust_ui_manager *x, t_float tuning[12])
+void faust_ui_manager_set_tuning(t_faust_ui_manager *x, t_faust_tuning *tuning)
 {
-  if (!x->f_tuning)
-    x->f_tuning = getbytes(12*sizeof(t_float));
-  if (x->f_tuning) {
-    for (int i = 0; i < 12; i++)
-      x->f_tuning[i] = tuning[i];
-  } else {
-    pd_error(x->f_owner, "faustgen2~: memory allocation failed - tuning");
+  if (tuning && tuning == x->f_tuning) {
+    // already in use (e.g., the same cached tuning), drop the extra reference
+    faust_tuning_free(tuning);
+    return;
   }
+  if (x->f_tuning)
+    faust_tuning_free(x->f_tuning);
+  x->f_tuning = tuning;
 }
 
-t_float *faust_ui_manager_get_tuning(const t_faust_ui_manager *x)
+t_faust_tuning *faust_ui_manager_get_tuning(const t_faust_ui_manager *x)
 {
   return x->f_tuning;
 }
 
 void faust_ui_manager_clear_tuning(t_faust_ui_manager *x)
 {
-  if (x->f_tuning) {
-    freebytes(x->f_tuning, 12*sizeof(t_float));
-    x->f_tuning = NULL;
+  faust_ui_manager_set_tuning(x, NULL);
+}
+
+void faust_ui_manager_release_sounds(t_faust_ui_manager *x, void const* dspinstance)
+{
+  if (dspinstance != x->f_dsp) return;
+  clock_unset(x->f_sound_clock);
+  faust_sound_list_free(x->f_sounds, x->f_nsounds);
+  x->f_sounds = NULL;
+  x->f_nsounds = 0;
+  x->f_dsp = NULL;
+}
+
+int faust_ui_manager_mts(t_faust_ui_manager *x, int argc, t_atom const *argv)
+{
+  t_faust_tuning *tuning = x->f_tuning;
+  int ret;
+  if (!x->f_midi) return -1;
+  // shared tunings are immutable, retune a private copy instead
+  if ((!tuning || faust_tuning_is_shared(tuning)) &&
+      !(tuning = faust_tuning_copy(x->f_owner, x->f_tuning)))
+    return -1;
+  ret = faust_tuning_mts(tuning, argc, argv);
+  if (ret < 0) {
+    if (tuning != x->f_tuning) faust_tuning_free(tuning);
+    return ret;
   }
+  if (tuning != x->f_tuning)
+    faust_ui_manager_set_tuning(x, tuning);
+  // real-time messages also retune the sounding notes
+  if (ret && x->f_voices) voices_retune(x);
+  return ret;
 }
 
 static int translate_to_midi(FAUSTFLOAT z, FAUSTFLOAT p_min, FAUSTFLOAT p_max,
-                             int min, int max)
+                             int p_scale, int min, int max)
 {
   if (p_min == p_max)
     // assert(z == p_min)
     return min;
   else {
     // normalize and scale
-    z = (z-p_min)/(p_max-p_min)*(max-min);
+    z = scale_to_unit(z, p_min, p_max, p_scale)*(max-min);
     // round to integer
     int val = round(z);
     // min should always be zero here, but to be on the safe side...
@@ -1832,7 +4152,7 @@ static int translate_to_midi(FAUSTFLOAT z, FAUSTFLOAT p_min, FAUSTFLOAT p_max,
 }
 
 static int midi_defaultval(FAUSTFLOAT z, FAUSTFLOAT p_min, FAUSTFLOAT p_max,
-                           int p_type, int msg)
+                           int p_type, int p_scale, int msg)
 {
   if (p_type == FAUST_UI_TYPE_BARGRAPH)
     switch (msg) {
@@ -1842,9 +4162,9 @@ static int midi_defaultval(FAUSTFLOAT z, FAUSTFLOAT p_min, FAUSTFLOAT p_max,
     case MIDI_STOP:
       return 1;
     case MIDI_PITCHWHEEL:
-      return translate_to_midi(z, p_min, p_max, 0, 16384);
+      return translate_to_midi(z, p_min, p_max, p_scale, 0, 16384);
     default:
-      return translate_to_midi(z, p_min, p_max, 0, 128);
+      return translate_to_midi(z, p_min, p_max, p_scale, 0, 128);
     }
   else
     return -1;
@@ -1853,77 +4173,82 @@ static int midi_defaultval(FAUSTFLOAT z, FAUSTFLOAT p_min, FAUSTFLOAT p_max,
 void faust_ui_manager_midiout(t_faust_ui_manager const *x, int midichan,
                               t_symbol *midirecv, t_outlet *out)
 {
-  faust_ui_midi_init();
   if (!x->f_midi || (!midirecv && !out)) return; // nothing to do
   // Run through all the passive UI elements with MIDI bindings.
-  t_faust_ui *c = x->f_uis;
-  while (c) {
-    if (c->p_type == FAUST_UI_TYPE_BARGRAPH) {
-      for (size_t j = 0; j < c->p_nmidi; j++) {
-        int i = c->p_midi[j].msg;
-        int num = -1, chan = -1, val = 0, oldval = c->p_midi[j].val;
-        t_symbol *s = midi_sym[i];
-        int argc = midi_argc[i];
-        t_atom argv[3];
-        switch (i) {
-        case MIDI_START:
-          // val means output a start message
-          val = faustflt(x, c->p_zone) > c->p_min;
-          if (!val) s = NULL;
-          break;
-        case MIDI_STOP:
-          // !val means output a stop message
-          val = faustflt(x, c->p_zone) > c->p_min;
-          if (val) s = NULL;
-          break;
-        case MIDI_CLOCK:
-          // change in val means output a clock message
-          val = faustflt(x, c->p_zone) > c->p_min;
-          break;
-        case MIDI_PITCHWHEEL:
-          val = translate_to_midi(faustflt(x, c->p_zone), c->p_min, c->p_max, 0, 16384);
-          // voice message, add channel
-          argc++;
-          chan = c->p_midi[j].chan;
-          break;
-        default:
-          if (argc == 1) {
-            val = translate_to_midi(faustflt(x, c->p_zone), c->p_min, c->p_max, 0, 128);
-            // Pd counts program changes starting at 1
-            if (i == MIDI_PGM) val++;
-          } else {
-            val = translate_to_midi(faustflt(x, c->p_zone), c->p_min, c->p_max, 0, 128);
-            num = c->p_midi[j].num;
-          }
-          // voice message, add channel
-          argc++;
-          chan = c->p_midi[j].chan;
-          break;
+  const t_faust_ctltab *t = &x->f_ctl;
+  x->f_zone->gather(t->zones, t->midiout, t->nmidiout, t->values);
+  // Only the controls whose values changed can produce any output.
+  if (!faust_ctltab_diff(t->values, t->midishadow, t->midithr, t->nmidiout, t->dirty))
+    return;
+  for (size_t k = 0; k < t->nmidiout; k++) {
+    if (!(t->dirty[k/32] & (1u << (k%32)))) continue;
+    const size_t l = t->midiout[k];
+    t_faust_ui *c = t->uis[l];
+    const FAUSTFLOAT z = t->values[k];
+    const FAUSTFLOAT p_min = t->min[l], p_max = t->max[l];
+    for (size_t j = 0; j < c->p_nmidi; j++) {
+      int i = c->p_midi[j].msg;
+      int num = -1, chan = -1, val = 0, oldval = c->p_midi[j].val;
+      t_symbol *s = midi_sym[i];
+      int argc = midi_argc[i];
+      t_atom argv[3];
+      switch (i) {
+      case MIDI_START:
+        // val means output a start message
+        val = z > p_min;
+        if (!val) s = NULL;
+        break;
+      case MIDI_STOP:
+        // !val means output a stop message
+        val = z > p_min;
+        if (val) s = NULL;
+        break;
+      case MIDI_CLOCK:
+        // change in val means output a clock message
+        val = z > p_min;
+        break;
+      case MIDI_PITCHWHEEL:
+        val = translate_to_midi(z, p_min, p_max, c->p_scale, 0, 16384);
+        // voice message, add channel
+        argc++;
+        chan = c->p_midi[j].chan;
+        break;
+      default:
+        if (argc == 1) {
+          val = translate_to_midi(z, p_min, p_max, c->p_scale, 0, 128);
+          // Pd counts program changes starting at 1
+          if (i == MIDI_PGM) val++;
+        } else {
+          val = translate_to_midi(z, p_min, p_max, c->p_scale, 0, 128);
+          num = c->p_midi[j].num;
         }
-        // only output changed values
-        if (s && val != oldval) {
-          c->p_midi[j].val = val;
-          // Note messages have their arguments the other way round.
-          if (i == MIDI_KEY || i == MIDI_KEYON || i == MIDI_KEYOFF) {
-            int temp = num;
-            num = val; val = temp;
-          }
-          if (midi_argc[i] > 0) SETFLOAT(argv+0, val);
-          if (midi_argc[i] > 1) SETFLOAT(argv+1, num);
-          if (midi_argc[i] < argc) {
-            // voice message, add channel (either the object's default MIDI
-            // channel, or 0 by default)
-            if (chan < 0) chan = midichan>=0?midichan:0;
-            // Pd MIDI channels are 1-based
-            SETFLOAT(argv+(argc-1), chan+1);
-          }
-          if (out) outlet_anything(out, s, argc, argv);
-          if (midirecv && midirecv->s_thing)
-            typedmess(midirecv->s_thing, s, argc, argv);
+        // voice message, add channel
+        argc++;
+        chan = c->p_midi[j].chan;
+        break;
+      }
+      // only output changed values
+      if (s && val != oldval) {
+        c->p_midi[j].val = val;
+        // Note messages have their arguments the other way round.
+        if (i == MIDI_KEY || i == MIDI_KEYON || i == MIDI_KEYOFF) {
+          int temp = num;
+          num = val; val = temp;
+        }
+        if (midi_argc[i] > 0) SETFLOAT(argv+0, val);
+        if (midi_argc[i] > 1) SETFLOAT(argv+1, num);
+        if (midi_argc[i] < argc) {
+          // voice message, add channel (either the object's default MIDI
+          // channel, or 0 by default)
+          if (chan < 0) chan = midichan>=0?midichan:0;
+          // Pd MIDI channels are 1-based
+          SETFLOAT(argv+(argc-1), chan+1);
         }
+        if (out) outlet_anything(out, s, argc, argv);
+        if (midirecv && midirecv->s_thing)
+          typedmess(midirecv->s_thing, s, argc, argv);
       }
     }
-    c = c->p_next;
   }
 }
 
@@ -1956,65 +4281,464 @@ static double translate_to_osc(FAUSTFLOAT z, FAUSTFLOAT p_min, FAUSTFLOAT p_max,
       if (val < min) val = min;
       if (val > max) val = max;
     } else {
-      if (val > min) val = min;
-      if (val < max) val = max;
+      if (val > min) val = min;
+      if (val < max) val = max;
+    }
+    return val;
+  }
+}
+
+static int osc_defaultval(FAUSTFLOAT z, FAUSTFLOAT p_min, FAUSTFLOAT p_max,
+                          int p_type, double a, double b)
+{
+  if (p_type == FAUST_UI_TYPE_BARGRAPH)
+    return translate_to_osc(z, p_min, p_max, p_type, a, b);
+  else
+    return -1;
+}
+
+void faust_ui_manager_oscout(t_faust_ui_manager const *x,
+                             t_symbol *oscrecv, t_outlet *out)
+{
+  if (!x->f_osc || (!oscrecv && !out)) return; // nothing to do
+  // Run through all the passive UI elements with OSC bindings.
+  const t_faust_ctltab *t = &x->f_ctl;
+  x->f_zone->gather(t->zones, t->oscout, t->noscout, t->values);
+  // Only the controls whose values changed can produce any output.
+  if (!faust_ctltab_diff(t->values, t->oscshadow, t->oscthr, t->noscout, t->dirty))
+    return;
+  for (size_t k = 0; k < t->noscout; k++) {
+    if (!(t->dirty[k/32] & (1u << (k%32)))) continue;
+    const size_t l = t->oscout[k];
+    t_faust_ui *c = t->uis[l];
+    const FAUSTFLOAT z = t->values[k];
+    for (size_t j = 0; j < c->p_nosc; j++) {
+      t_symbol *s = c->p_osc[j].msg;
+      double val = 0.0, oldval = c->p_osc[j].val;
+      t_atom argv[1];
+      val = translate_to_osc(z, t->min[l], t->max[l],
+                             FAUST_UI_TYPE_BARGRAPH, c->p_osc[j].a, c->p_osc[j].b);
+      // only output changed values
+      if (val != oldval) {
+        c->p_osc[j].val = val;
+        SETFLOAT(argv+0, val);
+        if (out) outlet_anything(out, s, 1, argv);
+        if (oscrecv && oscrecv->s_thing)
+          typedmess(oscrecv->s_thing, s, 1, argv);
+      }
+    }
+  }
+}
+
+#ifdef HAVE_SHM
+static void faust_shm_unmap(t_faust_shm *m)
+{
+  if (m->base) munmap(m->base, m->size);
+  if (m->snap) freebytes(m->snap, m->n*sizeof(double));
+  if (m->changed) freebytes(m->changed, m->n*sizeof(size_t));
+  if (m->next) freebytes(m->next, m->n*sizeof(double));
+  m->base = NULL; m->values = NULL; m->snap = NULL; m->changed = NULL; m->next = NULL;
+  m->size = m->n = m->nchanged = 0;
+}
+
+static void faust_shm_path(const t_symbol *name, char *buf, size_t len)
+{
+  // POSIX shm names start with a slash and contain no other slashes
+  char *t;
+  snprintf(buf, len, "/faustgen2-%s", name->s_name);
+  for (t = buf+1; *t; t++)
+    if (*t == '/') *t = '_';
+}
+
+// Lay out the block for the current control table. This is called when the
+// block is opened and after each compilation.
+static void faust_ui_manager_update_shm(t_faust_ui_manager *x)
+{
+  t_faust_shm *m = &x->f_shm;
+  const t_faust_ctltab *t = &x->f_ctl;
+  const size_t n = t->n;
+  const size_t size = sizeof(t_faust_shm_header) +
+    n*(sizeof(t_faust_shm_control)+sizeof(double));
+  uint32_t seq = 0, layout = 0;
+  t_faust_shm_header *h;
+  t_faust_shm_control *ctl;
+  char path[MAXPDSTRING];
+  void *base;
+  int fd;
+  if (!m->name) return;
+  if (m->base) {
+    h = (t_faust_shm_header*)m->base;
+    seq = (h->seq+2) & ~1u;
+    layout = h->layout+1;
+  }
+  faust_shm_unmap(m);
+  faust_shm_path(m->name, path, MAXPDSTRING);
+  fd = shm_open(path, O_CREAT|O_RDWR, 0600);
+  if (fd < 0) {
+    pd_error(x->f_owner, "faustgen2~: can't open shared memory block %s", path);
+    m->name = NULL;
+    return;
+  }
+  base = ftruncate(fd, size) < 0 ? MAP_FAILED :
+    mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    pd_error(x->f_owner, "faustgen2~: can't map shared memory block %s", path);
+    shm_unlink(path);
+    m->name = NULL;
+    return;
+  }
+  m->snap = n?getbytes(n*sizeof(double)):NULL;
+  m->changed = n?getbytes(n*sizeof(size_t)):NULL;
+  m->next = n?getbytes(n*sizeof(double)):NULL;
+  m->base = base; m->size = size; m->n = n;
+  if (n && (!m->snap || !m->changed || !m->next)) {
+    pd_error(x->f_owner, "faustgen2~: memory allocation failed - shm");
+    faust_shm_unmap(m);
+    shm_unlink(path);
+    m->name = NULL;
+    return;
+  }
+  h = (t_faust_shm_header*)base;
+  ctl = (t_faust_shm_control*)(h+1);
+  m->values = (double*)(ctl+n);
+  memset(base, 0, size);
+  memcpy(h->magic, FAUST_SHM_MAGIC, sizeof(h->magic));
+  h->version = FAUST_SHM_VERSION;
+  h->n = n;
+  h->layout = layout;
+  for (size_t i = 0; i < n; i++) {
+    snprintf(ctl[i].name, FAUST_SHM_NAMELEN, "%s", t->uis[i]->p_longname->s_name);
+    ctl[i].type = t->type[i];
+    ctl[i].min = t->min[i];
+    ctl[i].max = t->max[i];
+    ctl[i].init = t->init[i];
+    m->values[i] = m->snap[i] = faustflt(x, t->zones[i]);
+  }
+  __atomic_store_n(&h->seq, seq, __ATOMIC_RELEASE);
+  m->seq = seq;
+}
+
+int faust_ui_manager_shm_open(t_faust_ui_manager *x, t_symbol *name)
+{
+  faust_ui_manager_shm_close(x);
+  x->f_shm.name = name;
+  faust_ui_manager_update_shm(x);
+  return x->f_shm.name ? 0 : -1;
+}
+
+void faust_ui_manager_shm_close(t_faust_ui_manager *x)
+{
+  t_faust_shm *m = &x->f_shm;
+  if (m->name) {
+    char path[MAXPDSTRING];
+    faust_shm_path(m->name, path, MAXPDSTRING);
+    faust_shm_unmap(m);
+    shm_unlink(path);
+    m->name = NULL;
+  }
+}
+
+// ag: Write a value from the shared-memory block to control i. This runs in
+// the dsp tick, so we only update the zone here (canceling a ramp in
+// progress, and bypassing [smooth] in that case) and leave the gui update to
+// faust_ui_manager_gui_update, by marking the control in guidirty.
+static void faust_ui_shm_set(t_faust_ui_manager *x, size_t i, double f)
+{
+  const t_faust_ctltab *t = &x->f_ctl;
+  t_faust_ui *ui = t->uis[i];
+  FAUSTFLOAT v;
+  // voice controls are managed by the polyphony code
+  if (ui->p_voice) return;
+  if (ui->p_type == FAUST_UI_TYPE_BUTTON || ui->p_type == FAUST_UI_TYPE_TOGGLE)
+    v = (FAUSTFLOAT)(f > FLT_EPSILON);
+  else if (ui->p_type == FAUST_UI_TYPE_NUMBER)
+    v = f < ui->p_min ? ui->p_min : f > ui->p_max ? ui->p_max : (FAUSTFLOAT)f;
+  else
+    return;
+  faust_ui_ramp_cancel(x, ui);
+  faust_ui_auto_push(x, ui, v, 0);
+  setfaustflt(x, t->zones[i], v);
+  if (ui->p_uirecv) t->guidirty[i/32] |= 1u << (i%32);
+}
+
+size_t faust_ui_manager_shm_poll(t_faust_ui_manager *x)
+{
+  t_faust_shm *m = &x->f_shm;
+  const t_faust_ctltab *t = &x->f_ctl;
+  const t_faust_shm_header *h = (const t_faust_shm_header*)m->base;
+  uint32_t seq;
+  if (!h || m->n != t->n) return 0;
+  seq = __atomic_load_n(&h->seq, __ATOMIC_ACQUIRE);
+  // Nothing new, or a writer is busy; in the latter case we simply try again
+  // in the next block rather than spinning in the audio thread.
+  if (seq == m->seq || (seq & 1)) return 0;
+  m->nchanged = 0;
+  for (size_t i = 0; i < m->n; i++) {
+    const double v = m->values[i];
+    if (v != m->snap[i]) {
+      m->next[m->nchanged] = v;
+      m->changed[m->nchanged++] = i;
+    }
+  }
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  if (__atomic_load_n(&h->seq, __ATOMIC_RELAXED) != seq) {
+    // torn read, try again next time
+    m->nchanged = 0;
+    return 0;
+  }
+  m->seq = seq;
+  for (size_t k = 0; k < m->nchanged; k++) {
+    const size_t i = m->changed[k];
+    m->snap[i] = m->next[k];
+    faust_ui_shm_set(x, i, m->snap[i]);
+  }
+  return m->nchanged;
+}
+
+void faust_ui_manager_shm_apply(t_faust_ui_manager *x, t_faust_ui_manager const *src)
+{
+  // This requires that both managers belong to instances of the same dsp,
+  // so that the control tables are laid out in the same way.
+  const t_faust_shm *m = &src->f_shm;
+  const t_faust_ctltab *t = &x->f_ctl;
+  for (size_t k = 0; k < m->nchanged; k++) {
+    const size_t i = m->changed[k];
+    if (i < t->n)
+      faust_ui_shm_set(x, i, m->snap[i]);
+  }
+}
+#else
+static void faust_ui_manager_update_shm(t_faust_ui_manager *x)
+{
+}
+
+int faust_ui_manager_shm_open(t_faust_ui_manager *x, t_symbol *name)
+{
+  pd_error(x->f_owner, "faustgen2~: shared memory is not supported on this platform");
+  return -1;
+}
+
+void faust_ui_manager_shm_close(t_faust_ui_manager *x)
+{
+}
+
+size_t faust_ui_manager_shm_poll(t_faust_ui_manager *x)
+{
+  return 0;
+}
+
+void faust_ui_manager_shm_apply(t_faust_ui_manager *x, t_faust_ui_manager const *src)
+{
+}
+#endif
+
+t_symbol *faust_ui_manager_shm_name(t_faust_ui_manager const *x)
+{
+  return x->f_shm.name;
+}
+
+static void faust_signames_set(t_faust_ui_manager *x, t_faust_signames *s,
+                               int argc, t_atom const *argv)
+{
+  faust_signames_free(s);
+  if (argc <= 0) return;
+  s->names = getbytes(argc*sizeof(t_symbol*));
+  if (!s->names) {
+    pd_error(x->f_owner, "faustgen2~: memory allocation failed - signal names");
+    return;
+  }
+  s->size = argc;
+  for (int i = 0; i < argc; i++) {
+    if (argv[i].a_type == A_SYMBOL)
+      s->names[s->n++] = argv[i].a_w.w_symbol;
+    else
+      pd_error(x->f_owner, "faustgen2~: bad control name (expected symbol)");
+  }
+}
+
+// Collect the table slots of the active (passive) controls which have
+// [pd:signal] meta data or are named in s, in control table order. Returns
+// NULL if there are none.
+static size_t *faust_ui_manager_signal_slots(t_faust_ui_manager *x,
+                                             const t_faust_signames *s,
+                                             bool passive, size_t *n)
+{
+  const t_faust_ctltab *t = &x->f_ctl;
+  size_t i, *slots = NULL;
+  char *mark;
+  *n = 0;
+  if (!t->n) return NULL;
+  mark = getbytes(t->n);
+  if (!mark) {
+    if (!x->f_quiet) pd_error(x->f_owner, "faustgen2~: memory allocation failed - signal controls");
+    return NULL;
+  }
+  for (i = 0; i < s->n; i++) {
+    t_faust_ui *c = faust_ui_manager_get(x, s->names[i]);
+    if (c && (c->p_type == FAUST_UI_TYPE_BARGRAPH) == passive)
+      mark[c->p_slot] = 1;
+    else if (!x->f_quiet)
+      pd_error(x->f_owner, "faustgen2~: no %s control named '%s' for signal %s",
+               passive?"passive":"active", s->names[i]->s_name,
+               passive?"output":"input");
+  }
+  for (i = 0; i < t->n; i++) {
+    const t_faust_ui *c = t->uis[i];
+    mark[i] = (mark[i] || c->p_signal) && !c->p_voice &&
+      (c->p_type == FAUST_UI_TYPE_BARGRAPH) == passive;
+    if (mark[i]) (*n)++;
+  }
+  if (*n) {
+    slots = getbytes(*n*sizeof(size_t));
+    if (slots) {
+      size_t k = 0;
+      for (i = 0; i < t->n; i++)
+        if (mark[i]) slots[k++] = i;
+    } else {
+      *n = 0;
+      if (!x->f_quiet) pd_error(x->f_owner, "faustgen2~: memory allocation failed - signal controls");
     }
-    return val;
   }
+  freebytes(mark, t->n);
+  return slots;
 }
 
-static int osc_defaultval(FAUSTFLOAT z, FAUSTFLOAT p_min, FAUSTFLOAT p_max,
-                          int p_type, double a, double b)
+static void faust_ui_manager_free_signals(t_faust_ui_manager *x)
 {
-  if (p_type == FAUST_UI_TYPE_BARGRAPH)
-    return translate_to_osc(z, p_min, p_max, p_type, a, b);
-  else
-    return -1;
+  if (x->f_sigins) freebytes(x->f_sigins, x->f_nsigins*sizeof(size_t));
+  if (x->f_sigvals) freebytes(x->f_sigvals, x->f_nsigins*sizeof(FAUSTFLOAT));
+  if (x->f_sigouts) freebytes(x->f_sigouts, x->f_nsigouts*sizeof(size_t));
+  x->f_sigins = x->f_sigouts = NULL;
+  x->f_sigvals = NULL;
+  x->f_nsigins = x->f_nsigouts = 0;
 }
 
-void faust_ui_manager_oscout(t_faust_ui_manager const *x,
-                             t_symbol *oscrecv, t_outlet *out)
+static void faust_ui_manager_update_signals(t_faust_ui_manager *x)
 {
-  if (!x->f_osc || (!oscrecv && !out)) return; // nothing to do
-  // Run through all the passive UI elements with OSC bindings.
-  t_faust_ui *c = x->f_uis;
-  while (c) {
-    if (c->p_type == FAUST_UI_TYPE_BARGRAPH) {
-      for (size_t j = 0; j < c->p_nosc; j++) {
-        t_symbol *s = c->p_osc[j].msg;
-        double val = 0.0, oldval = c->p_osc[j].val;
-        t_atom argv[1];
-        val = translate_to_osc(faustflt(x, c->p_zone), c->p_min, c->p_max,
-                               c->p_type, c->p_osc[j].a, c->p_osc[j].b);
-        // only output changed values
-        if (val != oldval) {
-          c->p_osc[j].val = val;
-          SETFLOAT(argv+0, val);
-          if (out) outlet_anything(out, s, 1, argv);
-          if (oscrecv && oscrecv->s_thing)
-            typedmess(oscrecv->s_thing, s, 1, argv);
-        }
-      }
+  size_t n;
+  faust_ui_manager_free_signals(x);
+  x->f_sigins = faust_ui_manager_signal_slots(x, &x->f_signames_in, false, &n);
+  if (x->f_sigins) {
+    x->f_sigvals = getbytes(n*sizeof(FAUSTFLOAT));
+    if (x->f_sigvals) {
+      x->f_nsigins = n;
+      for (size_t k = 0; k < n; k++)
+        x->f_sigvals[k] = faustflt(x, x->f_ctl.zones[x->f_sigins[k]]);
+    } else {
+      freebytes(x->f_sigins, n*sizeof(size_t));
+      x->f_sigins = NULL;
+      if (!x->f_quiet) pd_error(x->f_owner, "faustgen2~: memory allocation failed - signal inputs");
+    }
+  }
+  x->f_sigouts = faust_ui_manager_signal_slots(x, &x->f_signames_out, true, &n);
+  x->f_nsigouts = n;
+}
+
+void faust_ui_manager_set_signal_inputs(t_faust_ui_manager *x, int argc, t_atom const *argv)
+{
+  faust_signames_set(x, &x->f_signames_in, argc, argv);
+  faust_ui_manager_update_signals(x);
+}
+
+void faust_ui_manager_set_signal_outputs(t_faust_ui_manager *x, int argc, t_atom const *argv)
+{
+  faust_signames_set(x, &x->f_signames_out, argc, argv);
+  faust_ui_manager_update_signals(x);
+}
+
+size_t faust_ui_manager_get_nsignal_outputs(t_faust_ui_manager const *x)
+{
+  return x->f_nsigouts;
+}
+
+void faust_ui_manager_signal_out(t_faust_ui_manager const *x, t_sample **sigs, int n)
+{
+  // Fill the signals with the current values of the passive controls.
+  const t_faust_ctltab *t = &x->f_ctl;
+  for (size_t k = 0; k < x->f_nsigouts; k++) {
+    const t_sample v = (t_sample)faustflt(x, t->zones[x->f_sigouts[k]]);
+    t_sample *out = sigs[k];
+    for (int j = 0; j < n; j++) out[j] = v;
+  }
+}
+
+size_t faust_ui_manager_get_nsignal_inputs(t_faust_ui_manager const *x)
+{
+  return x->f_nsigins;
+}
+
+void faust_ui_manager_signal_in(t_faust_ui_manager *x, t_sample *const *sigs, int n)
+{
+  // Feed the block averages of the signals into the zones. The values are
+  // clamped to the control ranges as usual, but we don't bother updating
+  // the GUI here.
+  const t_faust_ctltab *t = &x->f_ctl;
+  const double scale = n > 0 ? 1.0/n : 0.0;
+  for (size_t k = 0; k < x->f_nsigins; k++) {
+    const size_t i = x->f_sigins[k];
+    const t_sample *in = sigs[k];
+    double sum = 0.0;
+    FAUSTFLOAT v;
+    for (int j = 0; j < n; j++) sum += in[j];
+    v = (FAUSTFLOAT)(sum*scale);
+    if (t->type[i] == FAUST_UI_TYPE_NUMBER)
+      v = v < t->min[i] ? t->min[i] : v > t->max[i] ? t->max[i] : v;
+    else
+      v = (FAUSTFLOAT)(v > FLT_EPSILON);
+    x->f_sigvals[k] = v;
+    faust_ui_ramp_cancel(x, t->uis[i]);
+    setfaustflt(x, t->zones[i], v);
+  }
+}
+
+void faust_ui_manager_signal_apply(t_faust_ui_manager *x, t_faust_ui_manager const *src)
+{
+  // This requires that both managers belong to instances of the same dsp,
+  // so that the control tables are laid out in the same way.
+  const t_faust_ctltab *t = &x->f_ctl;
+  for (size_t k = 0; k < src->f_nsigins; k++) {
+    const size_t i = src->f_sigins[k];
+    if (i < t->n) {
+      faust_ui_ramp_cancel(x, t->uis[i]);
+      setfaustflt(x, t->zones[i], src->f_sigvals[k]);
     }
-    c = c->p_next;
   }
 }
 
+void faust_ui_manager_set_delta(t_faust_ui_manager *x, double gui,
+                                double midi, double osc)
+{
+  x->f_gui_delta = gui;
+  x->f_midi_delta = midi;
+  x->f_osc_delta = osc;
+  faust_ui_manager_update_thresholds(x);
+}
+
 void faust_ui_manager_gui_update(t_faust_ui_manager const *x)
 {
   // Run through all the passive UI elements.
-  t_faust_ui *c = x->f_uis;
-  while (c) {
-    if (c->p_type == FAUST_UI_TYPE_BARGRAPH &&
-        c->p_uisym && c->p_uisym->s_thing) {
-      // only output changed values
-      if (faustflt(x, c->p_zone) != c->p_uival) {
-        FAUSTFLOAT val = faustflt(x, c->p_zone);
-        gui_update(val, c->p_uirecv);
-        c->p_uival = val;
-      }
+  const t_faust_ctltab *t = &x->f_ctl;
+  // Active controls which were changed behind the gui's back (shared memory)
+  // are flagged in guidirty.
+  for (size_t w = 0; w < DIRTY_WORDS(t->n); w++) {
+    uint32_t bits = t->guidirty[w];
+    if (!bits) continue;
+    t->guidirty[w] = 0;
+    for (size_t i = w*32; bits; bits >>= 1, i++) {
+      if (bits & 1)
+        gui_update(faustflt(x, t->zones[i]), t->uis[i]->p_uirecv);
     }
-    c = c->p_next;
+  }
+  x->f_zone->gather(t->zones, t->passive, t->npassive, t->values);
+  // only output changed values
+  if (!faust_ctltab_diff(t->values, t->guishadow, t->guithr, t->npassive, t->dirty))
+    return;
+  for (size_t k = 0; k < t->npassive; k++) {
+    if (!(t->dirty[k/32] & (1u << (k%32)))) continue;
+    t_faust_ui *c = t->uis[t->passive[k]];
+    if (c->p_uisym && c->p_uisym->s_thing)
+      gui_update(t->values[k], c->p_uirecv);
   }
 }
 
@@ -2025,6 +4749,233 @@ static t_symbol *make_sym(t_symbol *dsp_name, t_symbol *longname)
   return gensym(name);
 }
 
+// Formatting data for the GUI.
+static const int black = -1; // foreground color for all GUI elements
+static const int white = -0x40000; // background color of active controls
+static const int gray  = -0x38e39; // background color of passive controls
+// Spacing of number boxes and horizontal sliders. You may have to adjust
+// this if your Pd version differs from the usual defaults, or if you change
+// the font sizes below.
+static const int nentry_x = 75; // nentry_y = 30;
+static const int hslider_x = 150, hslider_y = 30;
+// GUI font sizes. fn1 sets the font size of the slider labels, fn2 that of
+// the number boxes. Common font sizes are 10 and 12.
+static const int fn1 = 10, fn2 = 10;
+
+// Create an object in the GUI subpatch. New objects are always appended to
+// the end of the subpatch, so we keep track of the last object there in
+// order to find the object we just created.
+static t_gobj *gui_obj(t_glist *gl, t_gobj **last, int argc, t_atom *argv)
+{
+  t_gobj *y;
+  typedmess((t_pd*)gl, gensym("obj"), argc, argv);
+  y = *last ? (*last)->g_next : gl->gl_list;
+  if (y) {
+    while (y->g_next) y = y->g_next;
+    *last = y;
+  }
+  return y;
+}
+
+static t_gobj *gui_last(t_glist *gl)
+{
+  t_gobj *y = gl->gl_list;
+  if (y) while (y->g_next) y = y->g_next;
+  return y;
+}
+
+// Create the GUI objects of a control at the given position, recording them
+// in the given item.
+static void gui_create(t_faust_ui_manager *x, t_glist *gl, t_gobj **last,
+                       t_faust_ui *c, t_symbol *s, int y,
+                       t_faust_gui_item *item)
+{
+  int argc = 0;
+  t_atom argv[50];
+  item->nobjs = 0;
+  switch (c->p_type) {
+  case FAUST_UI_TYPE_BUTTON:
+  case FAUST_UI_TYPE_TOGGLE:
+    // We render both buttons and toggles as Pd toggles, since Pd bangs
+    // don't provide the on/off switching functionality that we need.
+    SETFLOAT(argv+argc, 10); argc++;
+    SETFLOAT(argv+argc, y); argc++;
+    SETSYMBOL(argv+argc, gensym("tgl")); argc++;
+    SETFLOAT(argv+argc, 15); argc++;
+    SETFLOAT(argv+argc, 0); argc++;
+    SETSYMBOL(argv+argc, s); argc++;
+    SETSYMBOL(argv+argc, s); argc++;
+    SETSYMBOL(argv+argc, c->p_name); argc++;
+    SETFLOAT(argv+argc, 17); argc++;
+    SETFLOAT(argv+argc, 7); argc++;
+    SETFLOAT(argv+argc, 0); argc++;
+    SETFLOAT(argv+argc, fn1); argc++;
+    SETFLOAT(argv+argc, white); argc++;
+    SETFLOAT(argv+argc, black); argc++;
+    SETFLOAT(argv+argc, black); argc++;
+    SETFLOAT(argv+argc, 0); argc++;
+    SETFLOAT(argv+argc, 1); argc++;
+    item->objs[item->nobjs++] = gui_obj(gl, last, argc, argv);
+    argc = 0;
+    break;
+  case FAUST_UI_TYPE_NUMBER:
+  case FAUST_UI_TYPE_BARGRAPH:
+    // These are both rendered as horizontal sliders (the bargraphs get a
+    // different background color, though, to distinguish it as a passive
+    // control).
+    SETFLOAT(argv+argc, 10); argc++;
+    SETFLOAT(argv+argc, y); argc++;
+    SETSYMBOL(argv+argc, gensym("hsl")); argc++;
+    SETFLOAT(argv+argc, 128); argc++;
+    SETFLOAT(argv+argc, 15); argc++;
+    SETFLOAT(argv+argc, c->p_min); argc++;
+    SETFLOAT(argv+argc, c->p_max); argc++;
+    SETFLOAT(argv+argc, 0); argc++;
+    SETFLOAT(argv+argc, 0); argc++;
+    SETSYMBOL(argv+argc, s); argc++;
+    SETSYMBOL(argv+argc, s); argc++;
+    SETSYMBOL(argv+argc, c->p_name); argc++;
+    SETFLOAT(argv+argc, -2); argc++;
+    SETFLOAT(argv+argc, -6); argc++;
+    SETFLOAT(argv+argc, 0); argc++;
+    SETFLOAT(argv+argc, fn1); argc++;
+    SETFLOAT(argv+argc, c->p_type==FAUST_UI_TYPE_BARGRAPH?gray:white); argc++;
+    SETFLOAT(argv+argc, black); argc++;
+    SETFLOAT(argv+argc, black); argc++;
+    SETFLOAT(argv+argc, 0); argc++;
+    SETFLOAT(argv+argc, 1); argc++;
+    item->objs[item->nobjs++] = gui_obj(gl, last, argc, argv);
+    argc = 0;
+    SETFLOAT(argv+argc, 10+hslider_x); argc++;
+    SETFLOAT(argv+argc, y); argc++;
+    SETSYMBOL(argv+argc, gensym("nbx")); argc++;
+    SETFLOAT(argv+argc, 5); argc++;
+    SETFLOAT(argv+argc, 14); argc++;
+    SETFLOAT(argv+argc, c->p_min); argc++;
+    SETFLOAT(argv+argc, c->p_max); argc++;
+    SETFLOAT(argv+argc, 0); argc++;
+    SETFLOAT(argv+argc, 0); argc++;
+    SETSYMBOL(argv+argc, s); argc++;
+    SETSYMBOL(argv+argc, s); argc++;
+    SETSYMBOL(argv+argc, gensym("empty")); argc++;
+    SETFLOAT(argv+argc, 0); argc++;
+    SETFLOAT(argv+argc, -6); argc++;
+    SETFLOAT(argv+argc, 0); argc++;
+    SETFLOAT(argv+argc, fn2); argc++;
+    SETFLOAT(argv+argc, c->p_type==FAUST_UI_TYPE_BARGRAPH?gray:white); argc++;
+    SETFLOAT(argv+argc, black); argc++;
+    SETFLOAT(argv+argc, black); argc++;
+    SETFLOAT(argv+argc, 256); argc++;
+    item->objs[item->nobjs++] = gui_obj(gl, last, argc, argv);
+    argc = 0;
+    break;
+  default:
+    // this can't happen
+    pd_error(x->f_owner, "faustgen2~: invalid UI type - gui");
+    break;
+  }
+  item->lname = c->p_longname;
+  item->name  = c->p_name;
+  item->type  = c->p_type;
+  item->min   = c->p_min;
+  item->max   = c->p_max;
+  item->y     = y;
+}
+
+// Create the special panic, init and active controls.
+static t_gobj *gui_special(t_glist *gl, t_gobj **last, t_symbol *s, int which,
+                           int wd)
+{
+  int argc = 0;
+  t_atom argv[50];
+  // The panic, init and active controls are positioned relative to the
+  // right border of the GOP area, the page controls at the left.
+  static const int offs[N_GUI_SPECIAL] = { 58, 38, 18, 0, 0 };
+  static const int pos[N_GUI_SPECIAL] = { 0, 0, 0, 10, 30 };
+  SETFLOAT(argv+argc, which<GUI_PREV?wd-offs[which]:pos[which]); argc++;
+  SETFLOAT(argv+argc, 3); argc++;
+  if (which != GUI_ACTIVE) {
+    SETSYMBOL(argv+argc, gensym("bng")); argc++;
+    SETFLOAT(argv+argc, 15); argc++;
+    SETFLOAT(argv+argc, 250); argc++;
+    SETFLOAT(argv+argc, 50); argc++;
+    SETFLOAT(argv+argc, 1); argc++;
+  } else {
+    SETSYMBOL(argv+argc, gensym("tgl")); argc++;
+    SETFLOAT(argv+argc, 15); argc++;
+    SETFLOAT(argv+argc, 1); argc++;
+  }
+  SETSYMBOL(argv+argc, s); argc++;
+  SETSYMBOL(argv+argc, s); argc++;
+  SETSYMBOL(argv+argc, gensym("empty")); argc++;
+  SETFLOAT(argv+argc, 0); argc++;
+  SETFLOAT(argv+argc, -6); argc++;
+  SETFLOAT(argv+argc, 0); argc++;
+  SETFLOAT(argv+argc, fn1); argc++;
+  SETFLOAT(argv+argc, which!=GUI_PANIC?white:gray); argc++;
+  SETFLOAT(argv+argc, black); argc++;
+  SETFLOAT(argv+argc, black); argc++;
+  if (which == GUI_ACTIVE) {
+    SETFLOAT(argv+argc, 1); argc++;
+    SETFLOAT(argv+argc, 1); argc++;
+  }
+  return gui_obj(gl, last, argc, argv);
+}
+
+static void gui_rec_free(t_faust_gui_rec *r)
+{
+  if (r->items) freebytes(r->items, r->n*sizeof(t_faust_gui_item));
+  r->items = NULL;
+  r->n = 0;
+}
+
+static int gobj_cmp(const void *a, const void *b)
+{
+  uintptr_t p = (uintptr_t)*(t_gobj*const*)a, q = (uintptr_t)*(t_gobj*const*)b;
+  return p < q ? -1 : p > q ? 1 : 0;
+}
+
+// Check that the subpatch still contains exactly the objects we created
+// there. If it doesn't (e.g., because the user edited the subpatch), we
+// have to regenerate the GUI from scratch.
+static bool gui_rec_valid(const t_faust_gui_rec *r, t_glist *gl,
+                          t_symbol *unique_name)
+{
+  size_t n = 0, m = 0, i;
+  t_gobj *y, **v, **w;
+  bool ok;
+  if (r->canvas != gl || r->unique_name != unique_name) return false;
+  for (i = 0; i < r->n; i++) n += r->items[i].nobjs;
+  for (i = 0; i < N_GUI_SPECIAL; i++) if (r->special[i]) n++;
+  for (y = gl->gl_list; y; y = y->g_next) m++;
+  if (m != n) return false;
+  if (!n) return true;
+  v = getbytes(n*sizeof(t_gobj*));
+  w = getbytes(n*sizeof(t_gobj*));
+  if (!v || !w) {
+    if (v) freebytes(v, n*sizeof(t_gobj*));
+    if (w) freebytes(w, n*sizeof(t_gobj*));
+    return false;
+  }
+  for (m = 0, y = gl->gl_list; y; y = y->g_next) v[m++] = y;
+  for (m = 0, i = 0; i < r->n; i++)
+    for (int j = 0; j < r->items[i].nobjs; j++)
+      w[m++] = r->items[i].objs[j];
+  for (i = 0; i < N_GUI_SPECIAL; i++) if (r->special[i]) w[m++] = r->special[i];
+  qsort(v, n, sizeof(t_gobj*), gobj_cmp);
+  qsort(w, n, sizeof(t_gobj*), gobj_cmp);
+  ok = memcmp(v, w, n*sizeof(t_gobj*)) == 0;
+  freebytes(v, n*sizeof(t_gobj*));
+  freebytes(w, n*sizeof(t_gobj*));
+  return ok;
+}
+
+// Generate the GUI in the instance subpatch. If we generated the GUI there
+// before and the subpatch wasn't touched in the meantime, we only update the
+// objects of the controls which were added, removed or modified, keeping
+// (and, if needed, moving) the objects of unchanged controls. This makes a
+// big difference in recompiling large dsps while live coding, since creating
+// and redrawing GUI objects is slow.
 void faust_ui_manager_gui(t_faust_ui_manager *x,
                           t_symbol *unique_name, t_symbol *instance_name)
 {
@@ -2032,53 +4983,118 @@ void faust_ui_manager_gui(t_faust_ui_manager *x,
   char ui_name[MAXPDSTRING];
   snprintf(ui_name, MAXPDSTRING, "pd-%s", instance_name->s_name);
   t_symbol *ui = gensym(ui_name);
-  if (!ui->s_thing) return;
-  // Formatting data for the GUI.
-  const int black = -1; // foreground color for all GUI elements
-  const int white = -0x40000; // background color of active controls
-  const int gray  = -0x38e39; // background color of passive controls
-  // Spacing of number boxes and horizontal sliders. You may have to adjust
-  // this if your Pd version differs from the usual defaults, or if you change
-  // the font sizes below.
-  const int nentry_x = 75; // nentry_y = 30;
-  const int hslider_x = 150, hslider_y = 30;
-  // GUI font sizes. fn1 sets the font size of the slider labels, fn2 that of
-  // the number boxes. Common font sizes are 10 and 12.
-  const int fn1 = 10, fn2 = 10;
+  t_glist *gl = (t_glist*)pd_findbyclass(ui, canvas_class);
+  if (!gl) return;
+  // The sentinel has done its job, get rid of it so that it doesn't get in
+  // the way of the incremental update.
+  faust_ui_manager_gui_unwatch(x);
+  t_faust_gui_rec *r = &x->f_gui;
+  bool incremental = r->items && gui_rec_valid(r, gl, unique_name);
+  t_faust_gui_item *items = NULL;
+  t_faust_symtab old;
+  size_t n = 0, i, j, first = 0, npages = 1;
+  t_gobj *last;
   // Run through all UI elements which aren't voice controls. First determine
   // the width and height of the GOP area.
   int wd = 10+hslider_x+nentry_x, ht = hslider_y, y = 0;
   t_faust_ui *c = x->f_uis;
   while (c) {
-    if (!c->p_voice) ht += hslider_y;
+    if (!c->p_voice) n++;
     c = c->p_next;
   }
-  // Initialize the subpatch and create the GOP area.
-  int argc = 0;
-  t_atom argv[50];
-  typedmess(ui->s_thing, gensym("clear"), 0, NULL);
-  SETFLOAT(argv+argc, 0); argc++;
-  SETFLOAT(argv+argc, -1); argc++;
-  SETFLOAT(argv+argc, 1); argc++;
-  SETFLOAT(argv+argc, 1); argc++;
-  SETFLOAT(argv+argc, wd); argc++;
-  SETFLOAT(argv+argc, ht); argc++;
-  SETFLOAT(argv+argc, 1); argc++;
-  SETFLOAT(argv+argc, 0); argc++;
-  SETFLOAT(argv+argc, 0); argc++;
-  typedmess(ui->s_thing, gensym("coords"), argc, argv);
-  argc = 0;
+  // If paging is enabled, we only show the controls on the current page.
+  if (r->page_size > 0 && n > (size_t)r->page_size) {
+    npages = (n+r->page_size-1)/r->page_size;
+    if (r->page < 0) r->page = 0;
+    if ((size_t)r->page >= npages) r->page = npages-1;
+    first = (size_t)r->page*r->page_size;
+    n -= first;
+    if (n > (size_t)r->page_size) n = r->page_size;
+  } else
+    r->page = 0;
+  ht += n*hslider_y;
+  if (n) {
+    items = getzbytes(n*sizeof(t_faust_gui_item));
+    if (!items) {
+      pd_error(x->f_owner, "faustgen2~: memory allocation failed - gui");
+      return;
+    }
+  }
+  old.h_size = 0; old.h_keys = NULL; old.h_vals = NULL;
+  if (incremental && !faust_symtab_init(&old, r->n))
+    incremental = false;
+  if (incremental) {
+    // Match the new controls against the old ones (by long name), and
+    // delete the objects of the old controls which are gone or changed
+    // their type.
+    for (i = 0; i < r->n; i++)
+      faust_symtab_insert(&old, r->items[i].lname, &r->items[i]);
+    for (c = x->f_uis, i = 0, j = 0; c && i < n; c = c->p_next) {
+      if (c->p_voice || j++ < first) continue;
+      t_faust_gui_item *it = faust_symtab_lookup(&old, c->p_longname);
+      // Buttons and toggles are rendered the same, but bargraphs have a
+      // different color than sliders, so these need to be recreated.
+      if (it && it->nobjs &&
+          (it->type == c->p_type ||
+           (it->type <= FAUST_UI_TYPE_TOGGLE && c->p_type <= FAUST_UI_TYPE_TOGGLE)) &&
+          it->name == c->p_name) {
+        items[i] = *it;
+        it->nobjs = 0; // mark as taken
+      }
+      i++;
+    }
+    for (i = 0; i < r->n; i++)
+      for (int j = 0; j < r->items[i].nobjs; j++)
+        glist_delete(gl, r->items[i].objs[j]);
+    if (r->special[GUI_PANIC] && !x->f_voices) {
+      glist_delete(gl, r->special[GUI_PANIC]);
+      r->special[GUI_PANIC] = NULL;
+    }
+    if (r->special[GUI_PREV] && npages <= 1) {
+      glist_delete(gl, r->special[GUI_PREV]);
+      glist_delete(gl, r->special[GUI_NEXT]);
+      r->special[GUI_PREV] = r->special[GUI_NEXT] = NULL;
+    }
+  } else {
+    // Initialize the subpatch.
+    typedmess(ui->s_thing, gensym("clear"), 0, NULL);
+    for (i = 0; i < N_GUI_SPECIAL; i++)
+      r->special[i] = NULL;
+  }
+  faust_symtab_free(&old);
+  gui_rec_free(r);
+  r->canvas = gl;
+  r->unique_name = unique_name;
+  r->instance_name = instance_name;
+  // (Re)create the GOP area.
+  if (!incremental || r->ht != ht) {
+    int argc = 0;
+    t_atom argv[9];
+    SETFLOAT(argv+argc, 0); argc++;
+    SETFLOAT(argv+argc, -1); argc++;
+    SETFLOAT(argv+argc, 1); argc++;
+    SETFLOAT(argv+argc, 1); argc++;
+    SETFLOAT(argv+argc, wd); argc++;
+    SETFLOAT(argv+argc, ht); argc++;
+    SETFLOAT(argv+argc, 1); argc++;
+    SETFLOAT(argv+argc, 0); argc++;
+    SETFLOAT(argv+argc, 0); argc++;
+    typedmess(ui->s_thing, gensym("coords"), argc, argv);
+    r->ht = ht;
+  }
   // Run through all UI elements again, this time generating the actual
   // contents of the GUI patch.
-  c = x->f_uis;
-  while (c) {
+  last = gui_last(gl);
+  for (c = x->f_uis, i = 0, j = 0; c; c = c->p_next) {
     if (c->p_voice) {
       // skip voice controls
-      c = c->p_next;
       continue;
     }
     t_symbol *s = make_sym(unique_name, c->p_longname);
     c->p_uisym = s;
+    // make sure that the next gui update picks up passive controls
+    if (c->p_type == FAUST_UI_TYPE_BARGRAPH && c->p_pslot < x->f_ctl.npassive)
+      x->f_ctl.guishadow[c->p_pslot] = NAN;
     if (c->p_uirecv) {
       // No need to recreate any existing receiver, just make sure that the
       // data is up-to-date.
@@ -2086,129 +5102,49 @@ void faust_ui_manager_gui(t_faust_ui_manager *x,
       c->p_uirecv->lname = c->p_longname;
     } else
       c->p_uirecv = faust_ui_receive_new(x, s, c->p_longname, 0);
+    // Controls on other pages only get their receivers.
+    if (j++ < first || i >= n) continue;
     y += hslider_y;
-    switch (c->p_type) {
-    case FAUST_UI_TYPE_BUTTON:
-    case FAUST_UI_TYPE_TOGGLE:
-      // We render both buttons and toggles as Pd toggles, since Pd bangs
-      // don't provide the on/off switching functionality that we need.
-      SETFLOAT(argv+argc, 10); argc++;
-      SETFLOAT(argv+argc, y); argc++;
-      SETSYMBOL(argv+argc, gensym("tgl")); argc++;
-      SETFLOAT(argv+argc, 15); argc++;
-      SETFLOAT(argv+argc, 0); argc++;
-      SETSYMBOL(argv+argc, s); argc++;
-      SETSYMBOL(argv+argc, s); argc++;
-      SETSYMBOL(argv+argc, c->p_name); argc++;
-      SETFLOAT(argv+argc, 17); argc++;
-      SETFLOAT(argv+argc, 7); argc++;
-      SETFLOAT(argv+argc, 0); argc++;
-      SETFLOAT(argv+argc, fn1); argc++;
-      SETFLOAT(argv+argc, white); argc++;
-      SETFLOAT(argv+argc, black); argc++;
-      SETFLOAT(argv+argc, black); argc++;
-      SETFLOAT(argv+argc, 0); argc++;
-      SETFLOAT(argv+argc, 1); argc++;
-      typedmess(ui->s_thing, gensym("obj"), argc, argv);
-      argc = 0;
-      if (s->s_thing) {
-        FAUSTFLOAT val = faustflt(x, c->p_zone);
-        gui_update(val, c->p_uirecv);
-        c->p_uival = val;
-      } else {
-        // this shouldn't happen
-        pd_error(x->f_owner, "faustgen2~: can't initialize %s - gui", s->s_name);
-      }
-      break;
-    case FAUST_UI_TYPE_NUMBER:
-    case FAUST_UI_TYPE_BARGRAPH:
-      // These are both rendered as horizontal sliders (the bargraphs get a
-      // different background color, though, to distinguish it as a passive
-      // control).
-      SETFLOAT(argv+argc, 10); argc++;
-      SETFLOAT(argv+argc, y); argc++;
-      SETSYMBOL(argv+argc, gensym("hsl")); argc++;
-      SETFLOAT(argv+argc, 128); argc++;
-      SETFLOAT(argv+argc, 15); argc++;
-      SETFLOAT(argv+argc, c->p_min); argc++;
-      SETFLOAT(argv+argc, c->p_max); argc++;
-      SETFLOAT(argv+argc, 0); argc++;
-      SETFLOAT(argv+argc, 0); argc++;
-      SETSYMBOL(argv+argc, s); argc++;
-      SETSYMBOL(argv+argc, s); argc++;
-      SETSYMBOL(argv+argc, c->p_name); argc++;
-      SETFLOAT(argv+argc, -2); argc++;
-      SETFLOAT(argv+argc, -6); argc++;
-      SETFLOAT(argv+argc, 0); argc++;
-      SETFLOAT(argv+argc, fn1); argc++;
-      SETFLOAT(argv+argc, c->p_type==FAUST_UI_TYPE_BARGRAPH?gray:white); argc++;
-      SETFLOAT(argv+argc, black); argc++;
-      SETFLOAT(argv+argc, black); argc++;
-      SETFLOAT(argv+argc, 0); argc++;
-      SETFLOAT(argv+argc, 1); argc++;
-      typedmess(ui->s_thing, gensym("obj"), argc, argv);
-      argc = 0;
-      SETFLOAT(argv+argc, 10+hslider_x); argc++;
-      SETFLOAT(argv+argc, y); argc++;
-      SETSYMBOL(argv+argc, gensym("nbx")); argc++;
-      SETFLOAT(argv+argc, 5); argc++;
-      SETFLOAT(argv+argc, 14); argc++;
-      SETFLOAT(argv+argc, c->p_min); argc++;
-      SETFLOAT(argv+argc, c->p_max); argc++;
-      SETFLOAT(argv+argc, 0); argc++;
-      SETFLOAT(argv+argc, 0); argc++;
-      SETSYMBOL(argv+argc, s); argc++;
-      SETSYMBOL(argv+argc, s); argc++;
-      SETSYMBOL(argv+argc, gensym("empty")); argc++;
-      SETFLOAT(argv+argc, 0); argc++;
-      SETFLOAT(argv+argc, -6); argc++;
-      SETFLOAT(argv+argc, 0); argc++;
-      SETFLOAT(argv+argc, fn2); argc++;
-      SETFLOAT(argv+argc, c->p_type==FAUST_UI_TYPE_BARGRAPH?gray:white); argc++;
-      SETFLOAT(argv+argc, black); argc++;
-      SETFLOAT(argv+argc, black); argc++;
-      SETFLOAT(argv+argc, 256); argc++;
-      typedmess(ui->s_thing, gensym("obj"), argc, argv);
-      if (s->s_thing) {
-        FAUSTFLOAT val = faustflt(x, c->p_zone);
-        gui_update(val, c->p_uirecv);
-        c->p_uival = val;
-      } else {
-        // this shouldn't happen
-        pd_error(x->f_owner, "faustgen2~: can't initialize %s - gui", s->s_name);
+    if (items[i].nobjs) {
+      // existing objects, move them into place and update their ranges
+      t_faust_gui_item *it = &items[i];
+      for (int j = 0; j < it->nobjs; j++) {
+        if (it->y != y)
+          gobj_displace(it->objs[j], gl, 0, y - it->y);
+        if (c->p_type >= FAUST_UI_TYPE_NUMBER &&
+            (it->min != c->p_min || it->max != c->p_max)) {
+          t_atom av[2];
+          SETFLOAT(av, c->p_min);
+          SETFLOAT(av+1, c->p_max);
+          pd_typedmess(&it->objs[j]->g_pd, gensym("range"), 2, av);
+        }
       }
-      argc = 0;
-      break;
-    default:
-      // this can't happen
-      pd_error(x->f_owner, "faustgen2~: invalid UI type - gui");
-      break;
+      it->min = c->p_min;
+      it->max = c->p_max;
+      it->type = c->p_type;
+      it->y = y;
+    } else {
+      gui_create(x, gl, &last, c, s, y, &items[i]);
     }
-    c = c->p_next;
+    if (s->s_thing) {
+      FAUSTFLOAT val = faustflt(x, c->p_zone);
+      gui_update(val, c->p_uirecv);
+      if (c->p_type == FAUST_UI_TYPE_BARGRAPH && c->p_pslot < x->f_ctl.npassive)
+        x->f_ctl.guishadow[c->p_pslot] = val;
+    } else {
+      // this shouldn't happen
+      pd_error(x->f_owner, "faustgen2~: can't initialize %s - gui", s->s_name);
+    }
+    i++;
   }
+  r->items = items;
+  r->n = n;
   // Add the special panic, init and active controls.
   t_symbol *s;
   if (x->f_voices) {
     s = make_sym(unique_name, gensym("panic"));
-    SETFLOAT(argv+argc, wd-58); argc++;
-    SETFLOAT(argv+argc, 3); argc++;
-    SETSYMBOL(argv+argc, gensym("bng")); argc++;
-    SETFLOAT(argv+argc, 15); argc++;
-    SETFLOAT(argv+argc, 250); argc++;
-    SETFLOAT(argv+argc, 50); argc++;
-    SETFLOAT(argv+argc, 1); argc++;
-    SETSYMBOL(argv+argc, s); argc++;
-    SETSYMBOL(argv+argc, s); argc++;
-    SETSYMBOL(argv+argc, gensym("empty")); argc++;
-    SETFLOAT(argv+argc, 0); argc++;
-    SETFLOAT(argv+argc, -6); argc++;
-    SETFLOAT(argv+argc, 0); argc++;
-    SETFLOAT(argv+argc, fn1); argc++;
-    SETFLOAT(argv+argc, gray); argc++;
-    SETFLOAT(argv+argc, black); argc++;
-    SETFLOAT(argv+argc, black); argc++;
-    typedmess(ui->s_thing, gensym("obj"), argc, argv);
-    argc = 0;
+    if (!r->special[GUI_PANIC])
+      r->special[GUI_PANIC] = gui_special(gl, &last, s, GUI_PANIC, wd);
     if (x->f_panic_recv) {
       x->f_panic_recv->uisym = s;
       x->f_panic_recv->lname = NULL;
@@ -2216,55 +5152,131 @@ void faust_ui_manager_gui(t_faust_ui_manager *x,
       x->f_panic_recv = faust_ui_receive_new(x, s, NULL, 3);
   }
   s = make_sym(unique_name, gensym("init"));
-  SETFLOAT(argv+argc, wd-38); argc++;
-  SETFLOAT(argv+argc, 3); argc++;
-  SETSYMBOL(argv+argc, gensym("bng")); argc++;
-  SETFLOAT(argv+argc, 15); argc++;
-  SETFLOAT(argv+argc, 250); argc++;
-  SETFLOAT(argv+argc, 50); argc++;
-  SETFLOAT(argv+argc, 1); argc++;
-  SETSYMBOL(argv+argc, s); argc++;
-  SETSYMBOL(argv+argc, s); argc++;
-  SETSYMBOL(argv+argc, gensym("empty")); argc++;
-  SETFLOAT(argv+argc, 0); argc++;
-  SETFLOAT(argv+argc, -6); argc++;
-  SETFLOAT(argv+argc, 0); argc++;
-  SETFLOAT(argv+argc, fn1); argc++;
-  SETFLOAT(argv+argc, white); argc++;
-  SETFLOAT(argv+argc, black); argc++;
-  SETFLOAT(argv+argc, black); argc++;
-  typedmess(ui->s_thing, gensym("obj"), argc, argv);
-  argc = 0;
+  if (!r->special[GUI_INIT])
+    r->special[GUI_INIT] = gui_special(gl, &last, s, GUI_INIT, wd);
   if (x->f_init_recv) {
     x->f_init_recv->uisym = s;
     x->f_init_recv->lname = NULL;
   } else
     x->f_init_recv = faust_ui_receive_new(x, s, NULL, 2);
   s = make_sym(unique_name, gensym("active"));
-  SETFLOAT(argv+argc, wd-18); argc++;
-  SETFLOAT(argv+argc, 3); argc++;
-  SETSYMBOL(argv+argc, gensym("tgl")); argc++;
-  SETFLOAT(argv+argc, 15); argc++;
-  SETFLOAT(argv+argc, 1); argc++;
-  SETSYMBOL(argv+argc, s); argc++;
-  SETSYMBOL(argv+argc, s); argc++;
-  SETSYMBOL(argv+argc, gensym("empty")); argc++;
-  SETFLOAT(argv+argc, 0); argc++;
-  SETFLOAT(argv+argc, -6); argc++;
-  SETFLOAT(argv+argc, 0); argc++;
-  SETFLOAT(argv+argc, fn1); argc++;
-  SETFLOAT(argv+argc, white); argc++;
-  SETFLOAT(argv+argc, black); argc++;
-  SETFLOAT(argv+argc, black); argc++;
-  SETFLOAT(argv+argc, 1); argc++;
-  SETFLOAT(argv+argc, 1); argc++;
-  typedmess(ui->s_thing, gensym("obj"), argc, argv);
-  argc = 0;
+  if (!r->special[GUI_ACTIVE])
+    r->special[GUI_ACTIVE] = gui_special(gl, &last, s, GUI_ACTIVE, wd);
   if (x->f_active_recv) {
     x->f_active_recv->uisym = s;
     x->f_active_recv->lname = NULL;
   } else
     x->f_active_recv = faust_ui_receive_new(x, s, NULL, 1);
+  if (npages > 1) {
+    s = make_sym(unique_name, gensym("prevpage"));
+    if (!r->special[GUI_PREV])
+      r->special[GUI_PREV] = gui_special(gl, &last, s, GUI_PREV, wd);
+    if (x->f_prev_recv) {
+      x->f_prev_recv->uisym = s;
+    } else
+      x->f_prev_recv = faust_ui_receive_new(x, s, NULL, 4);
+    s = make_sym(unique_name, gensym("nextpage"));
+    if (!r->special[GUI_NEXT])
+      r->special[GUI_NEXT] = gui_special(gl, &last, s, GUI_NEXT, wd);
+    if (x->f_next_recv) {
+      x->f_next_recv->uisym = s;
+    } else
+      x->f_next_recv = faust_ui_receive_new(x, s, NULL, 5);
+  }
+}
+
+void faust_ui_manager_gui_set_page_size(t_faust_ui_manager *x, int n)
+{
+  if (x->f_gui.page_size != n) {
+    x->f_gui.page_size = n > 0 ? n : 0;
+    x->f_gui.page = 0;
+  }
+}
+
+// Flip pages in the GUI (delta = -1 or 1). This is invoked from the page
+// buttons, which are part of the GUI that we're about to rebuild, so the
+// actual work is deferred to a clock callback.
+static void faust_ui_manager_gui_page(t_faust_ui_manager *x, int delta)
+{
+  x->f_page_delta += delta;
+  clock_delay(x->f_page_clock, 0);
+}
+
+static void faust_ui_manager_page_tick(t_faust_ui_manager *x)
+{
+  t_faust_gui_rec *r = &x->f_gui;
+  int delta = x->f_page_delta;
+  x->f_page_delta = 0;
+  if (delta && r->page_size > 0 && r->unique_name && r->instance_name) {
+    r->page += delta;
+    faust_ui_manager_gui(x, r->unique_name, r->instance_name);
+  }
+}
+
+int faust_ui_manager_gui_mapped(t_symbol *instance_name)
+{
+  char ui_name[MAXPDSTRING];
+  snprintf(ui_name, MAXPDSTRING, "pd-%s", instance_name->s_name);
+  t_glist *gl = (t_glist*)pd_findbyclass(gensym(ui_name), canvas_class);
+  return gl && glist_isvisible(gl);
+}
+
+// The sentinel has no appearance and isn't saved with the patch. Pd calls
+// its vis method when the subpatch gets mapped (opened, or drawn on the
+// parent if it is a graph-on-parent), which is our cue to generate the GUI.
+// That can't be done right away since Pd is iterating over the subpatch at
+// this point, so we just schedule the owner's clock.
+static void faust_gui_sentinel_getrect(t_gobj *z, t_glist *gl,
+                                       int *x1, int *y1, int *x2, int *y2)
+{
+  // an empty box at the top left corner, so that it passes as visible on
+  // the parent of a graph-on-parent subpatch
+  *x1 = *x2 = glist_xtopixels(gl, gl->gl_x1);
+  *y1 = *y2 = glist_ytopixels(gl, gl->gl_y1);
+}
+
+static void faust_gui_sentinel_vis(t_gobj *z, t_glist *gl, int vis)
+{
+  t_faust_gui_sentinel *y = (t_faust_gui_sentinel*)z;
+  if (vis && y->clock) clock_delay(y->clock, 0);
+}
+
+static void faust_gui_sentinel_free(t_faust_gui_sentinel *y)
+{
+  // the subpatch may go away before we do
+  if (y->owner) y->owner->f_sentinel = NULL;
+}
+
+// Lazy GUI: Put a sentinel into the instance subpatch which triggers the
+// given clock once the subpatch becomes visible.
+void faust_ui_manager_gui_watch(t_faust_ui_manager *x, t_symbol *instance_name,
+                                t_clock *clock)
+{
+  char ui_name[MAXPDSTRING];
+  snprintf(ui_name, MAXPDSTRING, "pd-%s", instance_name->s_name);
+  t_glist *gl = (t_glist*)pd_findbyclass(gensym(ui_name), canvas_class);
+  if (x->f_sentinel && x->f_sentinel->canvas == gl) {
+    x->f_sentinel->clock = clock;
+    return;
+  }
+  faust_ui_manager_gui_unwatch(x);
+  if (!gl) return;
+  t_faust_gui_sentinel *y = (t_faust_gui_sentinel*)pd_new(faust_gui_sentinel_class);
+  y->owner = x;
+  y->canvas = gl;
+  y->clock = clock;
+  glist_add(gl, &y->g);
+  x->f_sentinel = y;
+}
+
+static void faust_ui_manager_gui_unwatch(t_faust_ui_manager *x)
+{
+  t_faust_gui_sentinel *y = x->f_sentinel;
+  if (y) {
+    y->owner = NULL;
+    x->f_sentinel = NULL;
+    glist_delete(y->canvas, &y->g);
+  }
 }
 
 // Stripped-down version of the above which just creates the receivers without
@@ -2281,6 +5293,9 @@ void faust_ui_manager_gui2(t_faust_ui_manager *x,
     }
     t_symbol *s = make_sym(unique_name, c->p_longname);
     c->p_uisym = s;
+    // make sure that the next gui update picks up passive controls
+    if (c->p_type == FAUST_UI_TYPE_BARGRAPH && c->p_pslot < x->f_ctl.npassive)
+      x->f_ctl.guishadow[c->p_pslot] = NAN;
     if (c->p_uirecv) {
       // No need to recreate any existing receiver, just make sure that the
       // data is up-to-date.
@@ -2317,7 +5332,7 @@ void faust_ui_manager_gui2(t_faust_ui_manager *x,
 // Receive a value from the GUI.
 static void faust_ui_receive(t_faust_ui_proxy *r, t_floatarg v)
 {
-  if (r->type) {
+  if (r->type == 1) {
     // Special active receiver, we need to pass this on to our grandparent
     // faustgen2~ object.
     t_object *ob = r->owner->f_owner;
@@ -2333,7 +5348,13 @@ static void faust_ui_receive(t_faust_ui_proxy *r, t_floatarg v)
     t_faust_ui* c = faust_ui_manager_get(r->owner, r->lname);
     if (c) {
       //logpost(r->owner->f_owner, 3, "%s = %g", r->uisym->s_name, v);
-      setfaustflt(r->owner, c->p_zone, v);
+      if (c->p_type == FAUST_UI_TYPE_NUMBER && c->p_smooth > 0 && !c->p_voice) {
+        // [smooth:ms] ramp to the new value
+        faust_ui_ramp(r->owner, c, v, c->p_smooth);
+      } else {
+        faust_ui_ramp_cancel(r->owner, c);
+        setfaustflt(r->owner, c->p_zone, v);
+      }
     }
   }
 }
@@ -2345,4 +5366,9 @@ static void faust_bang_receive(t_faust_ui_proxy *r)
     faust_ui_manager_restore_default(r->owner);
   else if (r->type == 3)
     faust_ui_manager_all_notes_off(r->owner);
+  // page controls
+  else if (r->type == 4)
+    faust_ui_manager_gui_page(r->owner, -1);
+  else if (r->type == 5)
+    faust_ui_manager_gui_page(r->owner, 1);
 }
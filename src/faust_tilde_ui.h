@@ -8,6 +8,7 @@
 #define FAUST_TILDE_UI_H
 
 #include <m_pd.h>
+#include "faust_tilde_tuning.h"
 
 struct _faust_ui_manager;
 typedef struct _faust_ui_manager t_faust_ui_manager;
@@ -19,7 +20,7 @@ typedef struct _faust_ui_manager t_faust_ui_manager;
 typedef uint64_t t_channelmask;
 #define ALL_CHANNELS ((t_channelmask)(-1UL))
 
-t_faust_ui_manager* faust_ui_manager_new(t_object* owner);
+t_faust_ui_manager* faust_ui_manager_new(t_object* owner, t_canvas* canvas);
 
 void faust_ui_manager_init(t_faust_ui_manager *x, void* dspinstance, int isdbl, char quiet);
 
@@ -33,8 +34,22 @@ char faust_ui_manager_get_polyphony(t_faust_ui_manager *x, char *midi, int *npol
 
 char faust_ui_manager_set_value(t_faust_ui_manager *x, t_symbol const *name, t_float const f);
 
+// Set the parameters name<start>, name<start+1>, ... from a list of values.
+// Returns the number of values set before the first one that couldn't be
+// set, or -1 if there's no such family of parameters.
+int faust_ui_manager_set_list(t_faust_ui_manager *x, t_symbol const *name, int start, int argc, t_atom const *argv);
+
 char faust_ui_manager_get_value(t_faust_ui_manager const *x, t_symbol const *name, t_float* f);
 
+// Ramp a numeric control to a new value over the given time in msecs. Numeric
+// controls with [smooth:ms] meta data always ramp to new values. The ramps
+// are advanced by faust_ui_manager_ramp_tick (given the elapsed time in
+// msecs) once per dsp block, which returns 1 if any ramps were active.
+char faust_ui_manager_ramp(t_faust_ui_manager *x, t_symbol const *name, t_float f, double ms);
+int faust_ui_manager_ramp_tick(t_faust_ui_manager *x, double ms);
+// Cancel all ramps in progress.
+void faust_ui_manager_clear_ramps(t_faust_ui_manager *x);
+
 int faust_ui_manager_get_midi(t_faust_ui_manager *x, t_symbol const *s, int argc, t_atom* argv, t_channelmask midichanmsk);
 const t_symbol *faust_ui_manager_get_osc(t_faust_ui_manager *x, t_symbol const *s, int argc, t_atom* argv, t_symbol *oscrecv, t_outlet *out);
 
@@ -44,27 +59,134 @@ void faust_ui_manager_save_states(t_faust_ui_manager *x);
 
 void faust_ui_manager_restore_states(t_faust_ui_manager *x);
 
+void faust_ui_manager_copy_states(t_faust_ui_manager *x, t_faust_ui_manager const *src);
+
 void faust_ui_manager_restore_default(t_faust_ui_manager *x);
 
+// Preset bank: store, recall and delete the values of all controls by slot
+// number (>= 0); recall only sets the active controls. These return -1 if
+// the slot is invalid or empty. Banks can be saved to and loaded from a
+// binary file; the presets are carried over to a recompiled dsp, matching
+// the controls by name. faust_ui_manager_preset_list returns the numbers of
+// the stored presets in a newly allocated atom list.
+int faust_ui_manager_preset_store(t_faust_ui_manager *x, int slot);
+int faust_ui_manager_preset_recall(t_faust_ui_manager *x, int slot);
+int faust_ui_manager_preset_delete(t_faust_ui_manager *x, int slot);
+void faust_ui_manager_preset_clear(t_faust_ui_manager *x);
+int faust_ui_manager_preset_list(t_faust_ui_manager const *x, t_atom **argv);
+int faust_ui_manager_preset_save(t_faust_ui_manager const *x, const char *path);
+int faust_ui_manager_preset_load(t_faust_ui_manager *x, const char *path);
+// Morph from one preset to another over the given number of samples. The
+// interpolation is done in faust_ui_manager_preset_morph_tick, called once
+// per dsp block, which returns 1 if the zones were changed.
+int faust_ui_manager_preset_morph(t_faust_ui_manager *x, int from, int to,
+                                  double nsamples);
+int faust_ui_manager_preset_morph_tick(t_faust_ui_manager *x, int nsamples);
+
+// Automation lane: faust_ui_manager_auto_record records the changes of the
+// active controls made through messages, MIDI and OSC to the given file,
+// along with their ramp times, faust_ui_manager_auto_play plays them back.
+// The file is written or read ahead by faust_ui_manager_auto_flush, to be
+// called periodically from the message thread, which returns 0 when recording
+// or playback has stopped. During playback, faust_ui_manager_auto_next gives
+// the offset of the next event after the given one in the current dsp block
+// (nsamples if none), and faust_ui_manager_auto_apply applies the events
+// between two offsets to the given manager (which may be another instance of
+// the same dsp, for old-style polyphony). faust_ui_manager_auto_tick advances
+// the lane by one dsp block. faust_ui_manager_auto_state returns 0 (stopped),
+// 1 (recording) or 2 (playing).
+int faust_ui_manager_auto_record(t_faust_ui_manager *x, const char *path);
+int faust_ui_manager_auto_play(t_faust_ui_manager *x, const char *path, int loop);
+void faust_ui_manager_auto_stop(t_faust_ui_manager *x);
+int faust_ui_manager_auto_state(t_faust_ui_manager const *x);
+int faust_ui_manager_auto_flush(t_faust_ui_manager *x);
+int faust_ui_manager_auto_next(t_faust_ui_manager const *x, int from, int nsamples);
+void faust_ui_manager_auto_apply(t_faust_ui_manager *x, t_faust_ui_manager const *src,
+                                 int from, int to);
+void faust_ui_manager_auto_tick(t_faust_ui_manager *x, int nsamples, double sr);
+
+// Save the control values and the stored presets as '#A state' and
+// '#A statepreset' messages in a patch file, and load them back. The
+// values are matched to the controls by their long names.
+void faust_ui_manager_save_state(t_faust_ui_manager const *x, t_binbuf *b);
+int faust_ui_manager_load_state(t_faust_ui_manager *x, int argc, t_atom const *argv);
+int faust_ui_manager_load_preset(t_faust_ui_manager *x, int argc, t_atom const *argv);
+
 void faust_ui_manager_print(t_faust_ui_manager const *x, char const log);
 
 int faust_ui_manager_dump(t_faust_ui_manager const *x, t_symbol *s, t_outlet *out, t_symbol *outsym);
 
-void faust_ui_manager_set_tuning(t_faust_ui_manager *x, t_float tuning[12]);
-t_float *faust_ui_manager_get_tuning(t_faust_ui_manager const *x);
+// The tuning used by the voice controls (NULL = 12-tet). The ui manager takes
+// over the reference to the tuning passed to faust_ui_manager_set_tuning and
+// releases the previous one; if it's the tuning already in use, the passed
+// reference is released instead.
+void faust_ui_manager_set_tuning(t_faust_ui_manager *x, t_faust_tuning *tuning);
+t_faust_tuning *faust_ui_manager_get_tuning(t_faust_ui_manager const *x);
 void faust_ui_manager_clear_tuning(t_faust_ui_manager *x);
+// Apply an MTS sysex message to the tuning (see faust_tuning_mts), which is
+// created as needed. Returns -1 if the message was ignored.
+int faust_ui_manager_mts(t_faust_ui_manager *x, int argc, t_atom const *argv);
+
+// Release the soundfiles of the given dsp instance, which is about to be
+// deleted; this does nothing if the ui manager has moved on to another one.
+void faust_ui_manager_release_sounds(t_faust_ui_manager *x, void const* dspinstance);
 
 void faust_ui_manager_midiout(t_faust_ui_manager const *x, int midichan,
                               t_symbol *midirecv, t_outlet *out);
 void faust_ui_manager_oscout(t_faust_ui_manager const *x,
                              t_symbol *oscrecv, t_outlet *out);
 
+// Minimum changes of passive controls (as a fraction of the control range)
+// before they are sent to the gui, MIDI and OSC outputs; 0 = any change.
+void faust_ui_manager_set_delta(t_faust_ui_manager *x, double gui,
+                                double midi, double osc);
+
 void faust_ui_manager_gui_update(t_faust_ui_manager const *x);
 
+// Shared-memory parameter block (POSIX shm, named /faustgen2-<name>), laid out
+// from the control table, through which other processes can set the values
+// of the active controls. The block is rebuilt after each compilation.
+// faust_ui_manager_shm_poll picks up the changed values and returns their
+// number; faust_ui_manager_shm_apply then copies them to another instance
+// of the same dsp (old-style polyphony).
+int faust_ui_manager_shm_open(t_faust_ui_manager *x, t_symbol *name);
+void faust_ui_manager_shm_close(t_faust_ui_manager *x);
+t_symbol *faust_ui_manager_shm_name(t_faust_ui_manager const *x);
+size_t faust_ui_manager_shm_poll(t_faust_ui_manager *x);
+void faust_ui_manager_shm_apply(t_faust_ui_manager *x, t_faust_ui_manager const *src);
+
+// Active controls driven by signal inlets: those with [pd:signal] meta data
+// and those named with faust_ui_manager_set_signal_inputs (these names are
+// kept across compilations). faust_ui_manager_signal_in feeds the block
+// averages of the given signals (one per control) into the zones;
+// faust_ui_manager_signal_apply then copies these values to another instance
+// of the same dsp (old-style polyphony).
+void faust_ui_manager_set_signal_inputs(t_faust_ui_manager *x, int argc, t_atom const *argv);
+size_t faust_ui_manager_get_nsignal_inputs(t_faust_ui_manager const *x);
+void faust_ui_manager_signal_in(t_faust_ui_manager *x, t_sample *const *sigs, int n);
+void faust_ui_manager_signal_apply(t_faust_ui_manager *x, t_faust_ui_manager const *src);
+
+// Passive controls fed to signal outlets: those with [pd:signal] meta data
+// and those named with faust_ui_manager_set_signal_outputs.
+// faust_ui_manager_signal_out fills the given signals (one per control) with
+// the current zone values.
+void faust_ui_manager_set_signal_outputs(t_faust_ui_manager *x, int argc, t_atom const *argv);
+size_t faust_ui_manager_get_nsignal_outputs(t_faust_ui_manager const *x);
+void faust_ui_manager_signal_out(t_faust_ui_manager const *x, t_sample **sigs, int n);
+
 void faust_ui_manager_gui(t_faust_ui_manager *x,
                           t_symbol *unique_name, t_symbol *instance_name);
 void faust_ui_manager_gui2(t_faust_ui_manager *x,
                            t_symbol *unique_name, t_symbol *instance_name);
+// Maximum number of controls per page in the GUI (0 = no paging). Takes
+// effect the next time the GUI is generated.
+void faust_ui_manager_gui_set_page_size(t_faust_ui_manager *x, int n);
+// Check whether the GUI subpatch of the given instance is visible.
+int faust_ui_manager_gui_mapped(t_symbol *instance_name);
+// Lazy GUI: have the given clock triggered once the GUI subpatch of the given
+// instance becomes visible. This is cancelled by the next faust_ui_manager_gui.
+void faust_ui_manager_gui_watch(t_faust_ui_manager *x, t_symbol *instance_name,
+                                t_clock *clock);
 
 void faust_ui_receive_setup(void);
 
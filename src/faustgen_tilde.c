@@ -46,16 +46,33 @@ int sys_trytoopenone(const char *dir, const char *name, const char* ext,
 // The actual cpu usage may vary with different Pd flavors, the number of
 // passive controls, and your hardware, though. You may want to try values of
 // 100 and even more if the GUI update slows down your system too much. Note
-// that in any case this value only affects the generated GUIs, MIDI output is
-// still generated for each dsp cycle whenever the corresponding controls
-// change their values.
+// that in any case this value only affects the generated GUIs (and OSC
+// output), MIDI output is still generated for each dsp cycle by default
+// whenever the corresponding controls change their values.
 const double gui_update_time = 40;
 
+// ag: These are just the defaults, the update rates of the different kinds
+// of passive control output can be changed on a per-object basis with the
+// guirate, oscrate and midirate messages, which also let you specify a
+// minimum change (as a fraction of the control range) below which output is
+// suppressed, to reduce GUI and network traffic with dense meter displays.
+enum { UPDATE_GUI, UPDATE_OSC, UPDATE_MIDI, N_UPDATE };
+static const char *update_sym_s[N_UPDATE] = { "guirate", "oscrate", "midirate" };
+// the corresponding selectors, interned in faustgen2_tilde_setup
+static t_symbol *update_sym[N_UPDATE];
+
 // keep track of voice controls
 typedef struct _faust_voice {
   int num; // current note playing, if any
+  int chan; // and its MIDI channel (-1 if none)
   FAUSTFLOATX *freq, *gain, *gate;
   struct _faust_voice *next_free, *next_used;
+  // cpu budget bookkeeping (see voice_budget below)
+  bool active;  // voice is in the used list
+  bool dormant; // voice has fallen silent and isn't computed any more
+  double level; // peak output level of the last dsp cycle
+  double start; // logical time of the last note-on
+  double stop;  // logical time of the last note-off
 } t_faust_voice;
 
 typedef struct _faust_key {
@@ -74,6 +91,8 @@ typedef struct _faustgen_tilde
     
     double**            f_signal_matrix_double;
     double*             f_signal_aligned_double;
+    // signal pointers of a partial dsp block, see faustgen_tilde_compute
+    void**              f_signal_segment;
     
     t_faust_ui_manager* f_ui_manager;
     t_faust_io_manager* f_io_manager;
@@ -88,6 +107,7 @@ typedef struct _faustgen_tilde
     t_symbol*           f_activesym;
 
     bool                f_isdouble;
+    FAUSTFLOAT          (*f_setzone)(FAUSTFLOATX *z, FAUSTFLOAT v);
     bool                f_midiout;
     int                 f_midichan;
     t_channelmask       f_midichanmsk;
@@ -96,28 +116,81 @@ typedef struct _faustgen_tilde
     t_symbol*           f_oscrecv;
     t_symbol*           f_instance_name;
     t_symbol*           f_unique_name;
-    double              f_next_tick;
+    // update rates (msecs, 0 = each dsp cycle), minimum deltas and next
+    // update times of the passive controls, see faustgen_tilde_passive_out
+    double              f_update_rate[N_UPDATE];
+    double              f_update_delta[N_UPDATE];
+    double              f_update_next[N_UPDATE];
     t_canvas*           f_canvas;
 
+    // save the control values and presets in the patch
+    bool                f_persist;
+    // saved state messages which arrived while there was no dsp instance,
+    // applied after the next successful compilation
+    t_binbuf*           f_pending;
+
+    // automation lane file i/o
+    t_clock*            f_auto_clock;
+
+    // lazy GUI generation and paging
+    bool                f_lazygui;
+    int                 f_guipage;
+    t_clock*            f_gui_clock;
+
     // old-style polyphony
     int                  f_npoly;
+    // elastic voice pool: f_minpoly is the number of voices given by the
+    // nvoices meta data, f_maxpoly the allocated capacity, f_polylimit the
+    // hard ceiling (0 = fixed number of voices)
+    int                  f_minpoly, f_maxpoly, f_polylimit;
+    double               f_idle_time;
+    t_clock*             f_grow_clock;
+    t_clock*             f_shrink_clock;
     bool                 f_midiin;
     llvm_dsp**           f_dsps;
     t_faust_ui_manager** f_uis;
     t_faust_voice *f_voices, *f_free, *f_used;
     t_faust_key *f_keys;
+
+    // cpu budget (measured in fractions of the dsp cycle, see below)
+    double              f_sr;
+    double              f_load;
+    double              f_voice_load;
+    struct _faustgen_tilde* f_next;
 } t_faustgen_tilde;
 
+// ag: Process-wide cpu budget for old-style polyphony. Each object measures
+// the time spent in its perform routine, as a fraction of the duration of a
+// dsp cycle, and (with cloned voices) how much of that a single voice costs.
+// If the budget is set, voices which have been released and have fallen
+// silent go dormant and aren't computed any more. A note-on which would wake
+// up a dormant voice and thereby push the total load of all faustgen2~
+// objects over the budget then first silences the least important voices
+// (released voices before sounding ones, the quietest first) in *any* object
+// until the new voice fits in. This only works with cloned voices, since
+// the voices of new-style polyphony are all computed in a single dsp
+// instance; such objects still count towards the total load, though.
+static struct {
+  double budget; // fraction of the dsp cycle (0 = no budget)
+  t_faustgen_tilde *objs; // all faustgen2~ objects
+} voice_budget = { 0.0, NULL };
+
+// peak level below which a released voice is considered silent (-100 dB)
+#define VOICE_SILENCE 1e-5
+// smoothing coefficient for the load measurements
+#define VOICE_LOAD_SMOOTH 0.1
+
 static void faust_free_voices(t_faustgen_tilde *x)
 {
   if (x->f_voices) {
-    freebytes(x->f_voices, x->f_npoly*sizeof(t_faust_voice));
+    freebytes(x->f_voices, x->f_maxpoly*sizeof(t_faust_voice));
     while (x->f_keys) {
       t_faust_key *next = x->f_keys->next;
       freebytes(x->f_keys, sizeof(t_faust_key));
       x->f_keys = next;
     }
     x->f_voices = x->f_free = x->f_used = NULL;
+    x->f_maxpoly = 0;
   }
 }
 
@@ -131,17 +204,22 @@ static void faust_new_voices(t_faustgen_tilde *x, int npoly)
     pd_error(x, "faustgen2~: memory allocation failed - voice controls");
     return;
   }
+  x->f_maxpoly = npoly;
   // Initialize the free and used lists.
   x->f_free = x->f_voices;
   x->f_used = NULL;
   for (int i = 0; i < npoly; i++) {
     // these will be initialized later
     x->f_voices[i].freq = x->f_voices[i].gain = x->f_voices[i].gate = NULL;
+    x->f_voices[i].active = x->f_voices[i].dormant = false;
+    x->f_voices[i].level = 0.0;
+    x->f_voices[i].start = x->f_voices[i].stop = 0.0;
     if (i+1 < npoly)
       x->f_voices[i].next_free = x->f_voices+i+1;
     else
       x->f_voices[i].next_free = NULL;
     x->f_voices[i].next_used = NULL;
+    x->f_voices[i].chan = -1;
   }
 }
 
@@ -152,23 +230,104 @@ static t_class *faustgen_tilde_class;
 #define VOICE_STEALING 1
 #define MONOPHONIC 1
 
-// simple MTS-like tuning facility (octave-based tunings only for now)
-static t_float note2cps(t_faustgen_tilde *x, int num)
+// note frequencies are looked up in the tuning tables (see faust_tilde_tuning.h)
+static t_float note2cps(t_faustgen_tilde *x, int num, int chan)
 {
-  t_float f = num;
-  // tuning offset in cents
-  t_float *tuning = faust_ui_manager_get_tuning(x->f_ui_manager);
-  if (tuning) f += tuning[num%12]/100.0;
-  // Pd's mtof() function does the rest
-  return mtof(f);
+  return faust_tuning_freq(faust_ui_manager_get_tuning(x->f_ui_manager), chan, num);
 }
 
-static FAUSTFLOAT setfaustflt(t_faustgen_tilde *x, FAUSTFLOATX *z, FAUSTFLOAT v)
+// ag: Voice zones are set through a function pointer selected at compile
+// time, so that the voice allocator doesn't need to check the precision of
+// the dsp on each access.
+static FAUSTFLOAT setfaustflt_float(FAUSTFLOATX *z, FAUSTFLOAT v)
 {
-  if (x->f_isdouble)
-    return (*(double*)z = v);
-  else
-    return (*(float*)z = v);
+  return (*(float*)z = v);
+}
+
+static FAUSTFLOAT setfaustflt_double(FAUSTFLOATX *z, FAUSTFLOAT v)
+{
+  return (*(double*)z = v);
+}
+
+static inline FAUSTFLOAT setfaustflt(t_faustgen_tilde *x, FAUSTFLOATX *z, FAUSTFLOAT v)
+{
+  return x->f_setzone(z, v);
+}
+
+// Voices are silenced in this order: released voices first, then the
+// quietest ones, then the oldest ones.
+static bool voice_less_important(t_faust_voice *v, t_faust_voice *w)
+{
+  if (v->active != w->active) return !v->active;
+  if (v->level != w->level) return v->level < w->level;
+  return v->start < w->start;
+}
+
+// Cut off a voice immediately and put it to sleep.
+static void voice_silence(t_faustgen_tilde *x, t_faust_voice *v)
+{
+  if (v->active) {
+    // move the voice from the used to the end of the free list
+    t_faust_voice *u = x->f_used, *p = NULL;
+    while (u && u != v) {
+      p = u;
+      u = u->next_used;
+    }
+    if (u) {
+      if (p)
+        p->next_used = u->next_used;
+      else
+        x->f_used = u->next_used;
+      u->next_free = u->next_used = NULL;
+      if (x->f_free) {
+        p = x->f_free;
+        while (p->next_free) p = p->next_free;
+        p->next_free = u;
+      } else {
+        x->f_free = u;
+      }
+    }
+  }
+  if (v->gate) setfaustflt(x, v->gate, 0.0);
+  // Clear the dsp state, so that the voice starts from scratch when it wakes
+  // up again.
+  instanceClearCDSPInstance(x->f_dsps[v - x->f_voices]);
+  v->active = false;
+  v->dormant = true;
+  v->level = 0.0;
+  v->stop = clock_getlogicaltime();
+}
+
+// Make room for a dormant voice of x which is about to be woken up.
+static void voice_budget_admit(t_faustgen_tilde *x)
+{
+  t_faustgen_tilde *y;
+  double load = 0.0;
+  // we can't do anything until we have a measurement
+  if (x->f_voice_load <= 0.0) return;
+  for (y = voice_budget.objs; y; y = y->f_next)
+    load += y->f_load;
+  while (load + x->f_voice_load > voice_budget.budget) {
+    t_faustgen_tilde *vy = NULL;
+    t_faust_voice *victim = NULL;
+    for (y = voice_budget.objs; y; y = y->f_next) {
+      if (!y->f_dsps || y->f_npoly <= 1 || y->f_voice_load <= 0.0) continue;
+      for (int k = 0; k < y->f_npoly; k++) {
+        t_faust_voice *v = y->f_voices+k;
+        if (v->dormant) continue;
+        if (!victim || voice_less_important(v, victim)) {
+          victim = v;
+          vy = y;
+        }
+      }
+    }
+    // nothing left to steal, let the note through anyway
+    if (!victim) return;
+    voice_silence(vy, victim);
+    // update the estimates until we get the next measurement
+    load -= vy->f_voice_load;
+    vy->f_load -= vy->f_voice_load;
+  }
 }
 
 static void voices_noteon(t_faustgen_tilde *x, int num, int val, int chan)
@@ -189,7 +348,8 @@ static void voices_noteon(t_faustgen_tilde *x, int num, int val, int chan)
     }
     t_faust_voice *v = x->f_voices;
     //post("monophonic: %d", v-x->f_voices);
-    if (v->freq) setfaustflt(x, v->freq, note2cps(x, num));
+    v->chan = chan;
+    if (v->freq) setfaustflt(x, v->freq, note2cps(x, num, chan));
     if (v->gain) setfaustflt(x, v->gain, ((double)val)/127.0);
     if (v->gate) setfaustflt(x, v->gate, 1.0);
     return;
@@ -205,6 +365,7 @@ static void voices_noteon(t_faustgen_tilde *x, int num, int val, int chan)
     x->f_used = u->next_used;
     x->f_free = u;
     u->next_used = u->next_free = NULL;
+    u->active = false;
   }
 #endif
   if (x->f_free) {
@@ -212,6 +373,9 @@ static void voices_noteon(t_faustgen_tilde *x, int num, int val, int chan)
     // controls to kick off the new voice.
     t_faust_voice *v = x->f_free;
     //post("free: %d", v-x->f_voices);
+    if (v->dormant && voice_budget.budget > 0.0)
+      // the voice is about to be woken up, make room in the cpu budget
+      voice_budget_admit(x);
     x->f_free = x->f_free->next_free;
     v->next_free = v->next_used = NULL;
     if (x->f_used) {
@@ -222,13 +386,35 @@ static void voices_noteon(t_faustgen_tilde *x, int num, int val, int chan)
       x->f_used = v;
     }
     v->num = num;
+    v->chan = chan;
+    v->active = true;
+    v->dormant = false;
+    v->start = clock_getlogicaltime();
     // Simply bypass all checking of control ranges and steps for now. We
-    // might want to do something more comprehensive later. Also, having MTS
-    // support would be nice. :)
-    if (v->freq) setfaustflt(x, v->freq, note2cps(x, num));
+    // might want to do something more comprehensive later.
+    if (v->freq) setfaustflt(x, v->freq, note2cps(x, num, chan));
     if (v->gain) setfaustflt(x, v->gain, ((double)val)/127.0);
     if (v->gate) setfaustflt(x, v->gate, 1.0);
   }
+  if (x->f_npoly < x->f_polylimit && (!x->f_free || !x->f_free->next_free))
+    // We're running out of voices, clone another one. This is done in a
+    // clock callback, so that it doesn't hold up the current message.
+    clock_delay(x->f_grow_clock, 0);
+}
+
+// Update the frequencies of the sounding voices after a tuning change.
+static void voices_retune(t_faustgen_tilde *x)
+{
+#if MONOPHONIC
+  if (x->f_npoly == 1) {
+    t_faust_voice *v = x->f_voices;
+    if (x->f_keys && v->freq)
+      setfaustflt(x, v->freq, note2cps(x, x->f_keys->num, v->chan));
+    return;
+  }
+#endif
+  for (t_faust_voice *v = x->f_used; v; v = v->next_used)
+    if (v->freq) setfaustflt(x, v->freq, note2cps(x, v->num, v->chan));
 }
 
 static void voices_noteoff(t_faustgen_tilde *x, int num, int chan)
@@ -254,7 +440,8 @@ static void voices_noteoff(t_faustgen_tilde *x, int num, int chan)
           if (p) {
             // legato (change to the previous frequency); note that if you
             // want portamento, you'll have to do this in the Faust source
-            if (v->freq) setfaustflt(x, v->freq, note2cps(x, p->num));
+            v->chan = chan;
+            if (v->freq) setfaustflt(x, v->freq, note2cps(x, p->num, chan));
           } else {
             // note off
             if (v->gate) setfaustflt(x, v->gate, 0.0);
@@ -277,6 +464,8 @@ static void voices_noteoff(t_faustgen_tilde *x, int num, int chan)
     else
       x->f_used = u->next_used;
     u->next_free = u->next_used = NULL;
+    u->active = false;
+    u->stop = clock_getlogicaltime();
     // Move this voice to the end of the free list and update the gate
     // control to release the voice.
     if (x->f_free) {
@@ -306,6 +495,8 @@ static void voices_all_notes_off(t_faustgen_tilde *x)
 #endif
   for (t_faust_voice *u = x->f_used; u; u = u->next_free) {
     if (u->gate) setfaustflt(x, u->gate, 0.0);
+    u->active = false;
+    u->stop = clock_getlogicaltime();
     u->next_free = u->next_used;
     u->next_used = NULL;
   }
@@ -321,6 +512,129 @@ static void voices_all_notes_off(t_faustgen_tilde *x)
 }
 
 
+// Elastic voice pool. If a voice limit is set (maxvoices), additional voices
+// are cloned on demand when the free voices run out, up to the given limit.
+// Extra voices which have been idle for f_idle_time msecs are removed again,
+// but we never go below the number of voices given in the nvoices meta data.
+
+static bool faust_resize_voices(t_faustgen_tilde *x, int maxpoly)
+{
+  t_faust_voice *voices;
+  llvm_dsp **dsps = realloc(x->f_dsps, maxpoly*sizeof(llvm_dsp*));
+  if (dsps) x->f_dsps = dsps;
+  t_faust_ui_manager **uis = realloc(x->f_uis, maxpoly*sizeof(t_faust_ui_manager*));
+  if (uis) x->f_uis = uis;
+  voices = getzbytes(maxpoly*sizeof(t_faust_voice));
+  if (!dsps || !uis || !voices) {
+    if (voices) freebytes(voices, maxpoly*sizeof(t_faust_voice));
+    pd_error(x, "faustgen2~: memory allocation failed - voice controls");
+    return false;
+  }
+  // The free and used lists point into the voice table, so we need to
+  // relocate these pointers.
+#define relocate(v) ((v) ? voices + ((v) - x->f_voices) : NULL)
+  for (int k = 0; k < x->f_npoly; k++) {
+    voices[k] = x->f_voices[k];
+    voices[k].next_free = relocate(x->f_voices[k].next_free);
+    voices[k].next_used = relocate(x->f_voices[k].next_used);
+  }
+  x->f_free = relocate(x->f_free);
+  x->f_used = relocate(x->f_used);
+#undef relocate
+  freebytes(x->f_voices, x->f_maxpoly*sizeof(t_faust_voice));
+  x->f_voices = voices;
+  x->f_maxpoly = maxpoly;
+  return true;
+}
+
+static void faustgen_tilde_grow_voices(t_faustgen_tilde *x)
+{
+  int k = x->f_npoly, npoly;
+  char midi;
+  FAUSTFLOATX *freq = NULL, *gain = NULL, *gate = NULL;
+  if (!x->f_dsps || k >= x->f_polylimit) return;
+  if (k >= x->f_maxpoly &&
+      !faust_resize_voices(x, 2*k < x->f_polylimit ? 2*k : x->f_polylimit))
+    return;
+  llvm_dsp *dsp = cloneCDSPInstance(x->f_dsp_instance);
+  if (!dsp) {
+    pd_error(x, "faustgen2~: memory allocation failed - instance");
+    return;
+  }
+  if (x->f_sr > 0.0) initCDSPInstance(dsp, x->f_sr);
+  t_faust_ui_manager *ui = faust_ui_manager_new((t_object*)x, x->f_canvas);
+  if (!ui) {
+    deleteCDSPInstance(dsp);
+    pd_error(x, "faustgen2~: memory allocation failed - ui manager");
+    return;
+  }
+  faust_ui_manager_init(ui, dsp, x->f_isdouble, true);
+  faust_ui_manager_get_polyphony(ui, &midi, &npoly, &freq, &gain, &gate);
+  // pick up the current control values of the first instance
+  faust_ui_manager_copy_states(ui, x->f_ui_manager);
+  if (x->f_unique_name && x->f_instance_name)
+    faust_ui_manager_gui2(ui, x->f_unique_name, x->f_instance_name);
+  t_faust_voice *v = x->f_voices+k;
+  memset(v, 0, sizeof(t_faust_voice));
+  v->freq = freq;
+  v->gain = gain;
+  v->gate = gate;
+  // the new voice goes to the front of the free list, so that it's used next
+  v->next_free = x->f_free;
+  x->f_free = v;
+  x->f_dsps[k] = dsp;
+  x->f_uis[k] = ui;
+  x->f_npoly++;
+  logpost(x, 3, "faustgen2~: %d voices", x->f_npoly);
+  clock_delay(x->f_shrink_clock, x->f_idle_time);
+}
+
+static void faust_remove_voice(t_faustgen_tilde *x, int k)
+{
+  int const n = x->f_npoly-1;
+  t_faust_voice *v = x->f_voices+k, *w = x->f_voices+n, *u, *p = NULL;
+  // remove the voice from the free list
+  for (u = x->f_free; u && u != v; u = u->next_free) p = u;
+  if (!u) return; // this can't happen
+  if (p)
+    p->next_free = v->next_free;
+  else
+    x->f_free = v->next_free;
+  deleteCDSPInstance(x->f_dsps[k]);
+  faust_ui_manager_free(x->f_uis[k]);
+  if (k < n) {
+    // move the last voice into the vacated slot
+    for (u = x->f_voices; u < w; u++) {
+      if (u->next_free == w) u->next_free = v;
+      if (u->next_used == w) u->next_used = v;
+    }
+    if (x->f_free == w) x->f_free = v;
+    if (x->f_used == w) x->f_used = v;
+    *v = *w;
+    x->f_dsps[k] = x->f_dsps[n];
+    x->f_uis[k] = x->f_uis[n];
+  }
+  x->f_npoly = n;
+}
+
+static void faustgen_tilde_shrink_voices(t_faustgen_tilde *x)
+{
+  int const npoly = x->f_npoly;
+  if (!x->f_dsps) return;
+  // We never remove the first voice, which is the main dsp instance.
+  for (int k = x->f_npoly-1; k > 0 && x->f_npoly > x->f_minpoly; k--) {
+    t_faust_voice *v = x->f_voices+k;
+    if (!v->active && (v->dormant || v->level < VOICE_SILENCE) &&
+        clock_gettimesince(v->stop) >= x->f_idle_time)
+      faust_remove_voice(x, k);
+  }
+  if (x->f_npoly < npoly)
+    logpost(x, 3, "faustgen2~: %d voices", x->f_npoly);
+  if (x->f_npoly > x->f_minpoly)
+    clock_delay(x->f_shrink_clock, x->f_idle_time);
+}
+
+
 //////////////////////////////////////////////////////////////////////////////////////////////////
 //                                          FAUST INTERFACE                                     //
 //////////////////////////////////////////////////////////////////////////////////////////////////
@@ -329,12 +643,14 @@ static void faustgen_tilde_delete_instance(t_faustgen_tilde *x)
 {
   if (x->f_dsps) {
     for (int i = 0; i < x->f_npoly; i++) {
+      faust_ui_manager_release_sounds(x->f_uis[i], x->f_dsps[i]);
       deleteCDSPInstance(x->f_dsps[i]);
     }
     free(x->f_dsps);
     x->f_dsps = NULL;
     faust_free_voices(x);
   } else if (x->f_dsp_instance) {
+    faust_ui_manager_release_sounds(x->f_ui_manager, x->f_dsp_instance);
     deleteCDSPInstance(x->f_dsp_instance);
   }
   x->f_dsp_instance = NULL;
@@ -350,6 +666,57 @@ static void faustgen_tilde_delete_factory(t_faustgen_tilde *x)
     x->f_dsp_factory = NULL;
 }
 
+// ag: Create the Pd GUI in the instance subpatch, and install receivers on
+// the other instances. In lazy mode (lazygui), the (comparatively expensive)
+// GUI objects are only created once the subpatch becomes visible, until
+// then we just install the receivers and have the ui manager watch the
+// subpatch. force overrides this, creating the GUI right away.
+static void faustgen_tilde_make_gui(t_faustgen_tilde *x, bool force)
+{
+  if (!x->f_unique_name || !x->f_instance_name) return;
+  faust_ui_manager_gui_set_page_size(x->f_ui_manager, x->f_guipage);
+  if (force || !x->f_lazygui ||
+      faust_ui_manager_gui_mapped(x->f_instance_name)) {
+    clock_unset(x->f_gui_clock);
+    faust_ui_manager_gui(x->f_ui_manager,
+                         x->f_unique_name, x->f_instance_name);
+  } else {
+    faust_ui_manager_gui2(x->f_ui_manager,
+                          x->f_unique_name, x->f_instance_name);
+    faust_ui_manager_gui_watch(x->f_ui_manager, x->f_instance_name,
+                               x->f_gui_clock);
+  }
+  if (x->f_uis) {
+    // also install receivers on the other instances
+    for (int i = 1; i < x->f_npoly; i++)
+      faust_ui_manager_gui2(x->f_uis[i],
+                            x->f_unique_name, x->f_instance_name);
+  }
+}
+
+// ag: The lazy GUI subpatch has been mapped, generate the GUI.
+static void faustgen_tilde_gui_tick(t_faustgen_tilde *x)
+{
+  if (!x->f_dsp_instance || !x->f_unique_name || !x->f_instance_name) return;
+  faust_ui_manager_gui(x->f_ui_manager,
+                       x->f_unique_name, x->f_instance_name);
+}
+
+// ag: Apply the pending state messages, see faustgen_tilde_state.
+static void faustgen_tilde_load_pending(t_faustgen_tilde *x)
+{
+  int n = binbuf_getnatom(x->f_pending), i = 0;
+  t_atom *v = binbuf_getvec(x->f_pending);
+  while (i < n) {
+    int j = i;
+    while (j < n && v[j].a_type != A_SEMI) j++;
+    if (j > i && v[i].a_type == A_SYMBOL)
+      pd_typedmess(&x->f_obj.ob_pd, v[i].a_w.w_symbol, j-i-1, v+i+1);
+    i = j+1;
+  }
+  binbuf_clear(x->f_pending);
+}
+
 static void faustgen_tilde_compile(t_faustgen_tilde *x)
 {
     char const* filepath;
@@ -387,9 +754,12 @@ static void faustgen_tilde_compile(t_faustgen_tilde *x)
             const int noutputs = getNumOutputsCDSPInstance(instance);
             const bool isdbl = faust_opt_has_double_precision(x->f_opt_manager);
             x->f_isdouble = isdbl;
+            x->f_setzone = isdbl ? setfaustflt_double : setfaustflt_float;
             logpost(x, 3, "faustgen2~ %s (%d/%d)", x->f_dsp_name->s_name, ninputs, noutputs);
             faust_ui_manager_init(x->f_ui_manager, instance, isdbl, false);
-            faust_io_manager_init(x->f_io_manager, ninputs, noutputs);
+            faust_io_manager_init(x->f_io_manager, ninputs, noutputs,
+                                  faust_ui_manager_get_nsignal_inputs(x->f_ui_manager),
+                                  faust_ui_manager_get_nsignal_outputs(x->f_ui_manager));
             
             faustgen_tilde_delete_instance(x);
             faustgen_tilde_delete_factory(x);
@@ -430,7 +800,7 @@ static void faustgen_tilde_compile(t_faustgen_tilde *x)
                 // polyphony. But alas, there's currently no way of doing
                 // that, so instead we resort to creating a new ui from
                 // scratch.
-                x->f_uis[i] = faust_ui_manager_new((t_object*)x);
+                x->f_uis[i] = faust_ui_manager_new((t_object*)x, x->f_canvas);
                 faust_ui_manager_init(x->f_uis[i], x->f_dsps[i], isdbl, true);
                 char _midi; int _npoly;
                 bool ret =
@@ -441,21 +811,13 @@ static void faustgen_tilde_compile(t_faustgen_tilde *x)
                 x->f_voices[i].gain = gain;
                 x->f_voices[i].gate = gate;
               }
-              x->f_npoly = npoly;
+              x->f_npoly = x->f_minpoly = npoly;
               x->f_midiin = midi;
             }
 
-            if (x->f_unique_name && x->f_instance_name) {
-              // recreate the Pd GUI
-              faust_ui_manager_gui(x->f_ui_manager,
-                                   x->f_unique_name, x->f_instance_name);
-              if (x->f_uis) {
-                // also install receivers on the other instances
-                for (int i = 1; i < x->f_npoly; i++)
-                  faust_ui_manager_gui2(x->f_uis[i],
-                                        x->f_unique_name, x->f_instance_name);
-              }
-            }
+            // recreate the Pd GUI
+            faustgen_tilde_make_gui(x, false);
+            faustgen_tilde_load_pending(x);
 
             canvas_resume_dsp(dspstate);
             return;
@@ -679,164 +1041,116 @@ static void faustgen_tilde_dump(t_faustgen_tilde *x, t_symbol *outsym)
     }
 }
 
-static bool is_blank(const char *s)
+// ag: Find a file along Pd's search path, with an optional default extension.
+static bool find_file(t_faustgen_tilde *x, const char *name, const char *ext,
+                      char *path)
 {
-  while (isblank(*s)) s++;
-  return *s == 0;
+  char realdir[MAXPDSTRING], *realname = NULL;
+  const char *dot = strrchr(name, '.');
+  if (dot && !strchr(dot, '/'))
+    // extension already supplied, no default extension
+    ext = "";
+  int fd = canvas_open(x->f_canvas, name, ext, realdir,
+                       &realname, MAXPDSTRING, 0);
+  if (fd < 0) {
+    pd_error(x, "faustgen2~: can't find %s%s", name, ext);
+    return false;
+  }
+  sys_close(fd);
+  snprintf(path, MAXPDSTRING, "%s/%s", realdir, realname);
+  return true;
+}
+
+static bool is_kbm(const char *name)
+{
+  const char *dot = strrchr(name, '.');
+  return dot && strcmp(dot, ".kbm") == 0;
 }
 
 static void faustgen_tilde_tuning(t_faustgen_tilde *x, t_symbol* s, int argc, t_atom* argv)
 {
+  t_faust_tuning *tuning = faust_ui_manager_get_tuning(x->f_ui_manager);
   if (argc <= 0) {
-    // output the current tuning on the control outlet
-    int ac;
-    t_atom av[12];
-    t_float *tuning = faust_ui_manager_get_tuning(x->f_ui_manager);
+    // output the current tuning on the control outlet: the 12 offsets in
+    // cents of an octave-based 12-tone tuning, otherwise the scale degrees
+    // in cents
     t_outlet *out = faust_io_manager_get_extra_output(x->f_io_manager);
-    if (tuning) {
-      ac = 12;
-      for (int i = 0; i < ac; i++)
-        SETFLOAT(av+i, tuning[i]);
-    } else {
-      ac = 1;
+    t_float offsets[12];
+    if (!tuning) {
+      t_atom av;
       // indicates the default (12-tet)
-      SETSYMBOL(av, gensym("default"));
+      SETSYMBOL(&av, gensym("default"));
+      outlet_anything(out, s, 1, &av);
+    } else if (!faust_tuning_get_offsets(tuning, offsets)) {
+      t_atom av[12];
+      for (int i = 0; i < 12; i++)
+        SETFLOAT(av+i, offsets[i]);
+      outlet_anything(out, s, 12, av);
+    } else {
+      size_t n = faust_tuning_get_size(tuning);
+      t_atom *av = getbytes((n+1)*sizeof(t_atom));
+      if (av) {
+        SETSYMBOL(av, gensym("scale"));
+        faust_tuning_get_scale(tuning, av+1);
+        outlet_anything(out, s, n+1, av);
+        freebytes(av, (n+1)*sizeof(t_atom));
+      }
     }
-    outlet_anything(out, s, ac, av);
     return;
-  } else if (argv[0].a_type == A_SYMBOL &&
-             (argc == 1 || (argc == 2 && argv[1].a_type == A_FLOAT))) {
-    const char *name = argv[0].a_w.w_symbol->s_name, *ext = strrchr(name, '.');
-    int base = argc>1?argv[1].a_w.w_float:0;
-    if (ext && !strchr(ext, '/'))
-      // extension already supplied, no default extension
-      ext = "";
-    else
-      ext = ".scl";
-    if (base < 0 || base > 11) {
-      pd_error(x, "faustgen2~: wrong 2nd argument to Scala tuning (expected reference tone 0..11)");
-      return;
-    }
-    if (strcmp(name, "default") == 0)
-      // reset to the default (12-tet)
-      faust_ui_manager_clear_tuning(x->f_ui_manager);
-    else {
-      // load tuning from a Scala file
-      // (http://www.huygens-fokker.org/scala/scl_format.html)
-      char realdir[MAXPDSTRING], *realname = NULL;
-      int fd = canvas_open(x->f_canvas, name, ext, realdir,
-                           &realname, MAXPDSTRING, 0);
-      if (fd < 0) {
-        pd_error(x, "faustgen2~: can't find %s.scl", name);
-        return;
-      }
-      sys_close(fd);
-      char absname[MAXPDSTRING];
-      memset(absname, 0, MAXPDSTRING);
-      snprintf(absname, MAXPDSTRING, "%s/%s", realdir, realname);
-      FILE *fp = fopen(absname, "r");
-      if (!fp) {
-        pd_error(x, "faustgen2~: can't open %s", realname);
-        return;
-      }
-      size_t lines = 0, state = 0;
-      char buf[MAXPDSTRING];
-      int n, p, q, pos;
-      t_float tuning[12];
-      float c;
-      while (state < 3 && fgets(buf, MAXPDSTRING, fp)) {
-        lines++;
-        // remove the trailing newline
-        size_t l = strlen(buf);
-        if (buf[l-1] == '\n') buf[l-1] = 0;
-        // ignore empty and comment lines (comments begin with '!')
-        if (*buf && *buf != '!') {
-          switch (state) {
-          case 0:
-            // description
-            logpost(x, 3, "%s", buf);
-            state++;
-            break;
-          case 1:
-            // scale size, we expect 12 for an octave-based tuning
-            if (sscanf(buf, "%d", &n) != 1) {
-              pd_error(x, "faustgen2~: %s:%lu: expected scale size", realname, lines);
-              return;
-            } else if (n != 12) {
-              pd_error(x, "faustgen2~: %s:%lu: not an octave-based tuning", realname, lines);
-              return;
-            }
-            n = 0;
-            tuning[0] = 0.0; // implicit
-            state++;
-            break;
-          case 2:
-            // parsing the scale
-            ++n;
-            if (sscanf(buf, "%d/%d%n", &p, &q, &pos) == 2 &&
-                       is_blank(buf+pos)) {
-              // ratio, convert to cent
-              if (p > 0 && q > 0) {
-                c = 1200.0*log((t_float)p/(t_float)q)/log(2.0);
-              } else {
-                pd_error(x, "faustgen2~: %s:%lu: invalid ratio", realname, lines);
-                return;
-              }
-            } else if (sscanf(buf, "%g%n", &c, &pos) == 1 && is_blank(buf+pos)) {
-              // According to the Scala format, the value we read must contain
-              // a period, otherwise it is to be interpreted as a ratio with
-              // denominator 1.
-              // cf. http://www.huygens-fokker.org/scala/scl_format.html
-              if (!strchr(buf, '.')) {
-                c = 1200.0*log(c)/log(2.0);
-              }
-            } else {
-              pd_error(x, "faustgen2~: %s:%lu: expected ratio or cent value", realname, lines);
-              return;
-            }
-            c -= n*100.0;
-            if (// check for tuning offsets which are wildly out of range
-                c < -100.0 || c > 100.0 ||
-                // also, the 12th scale point (which isn't part of the tuning
-                // table) should be a reasonably exact octave
-                (n == 12 && fabs(c) > 1e-8)) {
-              pd_error(x, "faustgen2~: %s:%lu: tuning offset out of range", realname, lines);
-              return;
-            }
-            if (n < 12)
-              tuning[n] = c;
-            else
-              // we're done, bail out, ignore any trailing junk for now
-              state++;
-            break;
-          }
-        }
-      }
-      fclose(fp);
-      if (base) {
-        // shift the scale so that the reference tone is at 0 cent
-        t_float r = tuning[base];
-        for (int i = 0; i < 12; i++)
-          tuning[i] -= r;
+  }
+  if (argc == 1 && argv[0].a_type == A_SYMBOL &&
+      strcmp(argv[0].a_w.w_symbol->s_name, "default") == 0) {
+    // reset to the default (12-tet)
+    faust_ui_manager_clear_tuning(x->f_ui_manager);
+    return;
+  }
+  if (argv[0].a_type == A_SYMBOL &&
+      (argc == 1 || (argc == 2 && (argv[1].a_type == A_FLOAT ||
+                                   argv[1].a_type == A_SYMBOL)))) {
+    // Scala scale (.scl), optionally followed by a reference tone or a
+    // keyboard mapping (.kbm); or a keyboard mapping for the current scale.
+    // Tunings loaded from files are shared with other objects, see
+    // faust_tuning_load.
+    const char *name = argv[0].a_w.w_symbol->s_name;
+    char path[MAXPDSTRING], kbm[MAXPDSTRING];
+    t_faust_tuning *t = NULL;
+    if (argc == 1 && is_kbm(name)) {
+      const char *scl = tuning ? faust_tuning_get_path(tuning) : NULL;
+      if (!find_file(x, name, "", kbm)) return;
+      if (scl) {
+        t = faust_tuning_load(&x->f_obj, scl, 0, kbm);
+      } else if ((t = faust_tuning_copy(&x->f_obj, tuning)) &&
+                 faust_tuning_read_mapping(t, kbm)) {
+        faust_tuning_free(t);
+        t = NULL;
       }
-      faust_ui_manager_set_tuning(x->f_ui_manager, tuning);
+    } else if (argc == 1 || argv[1].a_type == A_FLOAT) {
+      int base = argc>1?argv[1].a_w.w_float:0;
+      if (find_file(x, name, ".scl", path))
+        t = faust_tuning_load(&x->f_obj, path, base, NULL);
+    } else {
+      if (find_file(x, name, ".scl", path) &&
+          find_file(x, argv[1].a_w.w_symbol->s_name, ".kbm", kbm))
+        t = faust_tuning_load(&x->f_obj, path, 0, kbm);
     }
-    return;
+    if (t) faust_ui_manager_set_tuning(x->f_ui_manager, t);
   } else if (argc == 12) {
     // expect 12 tuning offset values in cents
-    bool ok = true;
-    t_float tuning[12];
-    for (int i = 0; i < argc && ok; i++) {
-      if ((ok = (argv[i].a_type == A_FLOAT))) {
-        tuning[i] = argv[i].a_w.w_float;
+    t_float offsets[12];
+    for (int i = 0; i < argc; i++) {
+      if (argv[i].a_type != A_FLOAT) {
+        pd_error(x, "faustgen2~: wrong arguments to tuning (expected Scala filename [reference tone or keyboard mapping], keyboard mapping, or 12 tuning offsets in cent)");
+        return;
       }
+      offsets[i] = argv[i].a_w.w_float;
     }
-    if (ok) {
-      faust_ui_manager_set_tuning(x->f_ui_manager, tuning);
-      return;
-    }
+    tuning = faust_tuning_new(&x->f_obj);
+    if (!tuning) return;
+    faust_tuning_set_offsets(tuning, offsets);
+    faust_ui_manager_set_tuning(x->f_ui_manager, tuning);
+  } else {
+    pd_error(x, "faustgen2~: wrong arguments to tuning (expected Scala filename [reference tone or keyboard mapping], keyboard mapping, or 12 tuning offsets in cent)");
   }
-  pd_error(x, "faustgen2~: wrong arguments to tuning (expected Scala filename or 12 tuning offsets in cent)");
 }
 
 static void faustgen_tilde_allnotesoff(t_faustgen_tilde *x)
@@ -859,17 +1173,412 @@ static void faustgen_tilde_defaults(t_faustgen_tilde *x)
   }
 }
 
+// ag: In old-style polyphony, copy the control values of the first instance
+// to the other ones after a preset recall, morph or saved state. Their ramps
+// are canceled as well, so that they don't drift away from the new values.
+static void faustgen_tilde_sync_voices(t_faustgen_tilde *x)
+{
+  if (!x->f_dsps) return;
+  for (int i = 1; i < x->f_npoly; i++) {
+    faust_ui_manager_clear_ramps(x->f_uis[i]);
+    faust_ui_manager_copy_states(x->f_uis[i], x->f_ui_manager);
+  }
+}
+
+static void faustgen_tilde_preset(t_faustgen_tilde *x, t_symbol* s, int argc, t_atom* argv)
+{
+  const char *cmd;
+  if (!x->f_dsp_instance) return;
+  if (argc <= 0) {
+    // list the stored presets
+    t_outlet *out = faust_io_manager_get_extra_output(x->f_io_manager);
+    t_atom *av;
+    int n = faust_ui_manager_preset_list(x->f_ui_manager, &av);
+    outlet_anything(out, s, n, av);
+    if (av) freebytes(av, n*sizeof(t_atom));
+    return;
+  }
+  cmd = argv[0].a_type == A_SYMBOL ? argv[0].a_w.w_symbol->s_name : "";
+  if (strcmp(cmd, "clear") == 0 && argc == 1) {
+    faust_ui_manager_preset_clear(x->f_ui_manager);
+  } else if ((strcmp(cmd, "store") == 0 || strcmp(cmd, "recall") == 0 ||
+              strcmp(cmd, "delete") == 0) &&
+             argc == 2 && argv[1].a_type == A_FLOAT) {
+    int slot = argv[1].a_w.w_float;
+    if (strcmp(cmd, "store") == 0) {
+      if (faust_ui_manager_preset_store(x->f_ui_manager, slot))
+        pd_error(x, "faustgen2~: can't store preset %d", slot);
+    } else if (strcmp(cmd, "recall") == 0) {
+      if (faust_ui_manager_preset_recall(x->f_ui_manager, slot)) {
+        pd_error(x, "faustgen2~: no preset %d", slot);
+      } else {
+        faustgen_tilde_sync_voices(x);
+      }
+    } else {
+      if (faust_ui_manager_preset_delete(x->f_ui_manager, slot))
+        pd_error(x, "faustgen2~: no preset %d", slot);
+    }
+  } else if (strcmp(cmd, "morph") == 0 && argc == 4 &&
+             argv[1].a_type == A_FLOAT && argv[2].a_type == A_FLOAT &&
+             argv[3].a_type == A_FLOAT) {
+    // morph from one preset to another over the given time in msecs; the
+    // interpolation is done in the perform routine
+    int from = argv[1].a_w.w_float, to = argv[2].a_w.w_float;
+    double const ms = argv[3].a_w.w_float;
+    if (faust_ui_manager_preset_morph(x->f_ui_manager, from, to,
+                                      ms > 0 ? ms*x->f_sr/1000.0 : 0.0)) {
+      pd_error(x, "faustgen2~: can't morph from preset %d to %d", from, to);
+    } else {
+      faustgen_tilde_sync_voices(x);
+    }
+  } else if (strcmp(cmd, "save") == 0 && argc == 2 && argv[1].a_type == A_SYMBOL) {
+    char path[MAXPDSTRING];
+    canvas_makefilename(x->f_canvas, argv[1].a_w.w_symbol->s_name,
+                        path, MAXPDSTRING);
+    faust_ui_manager_preset_save(x->f_ui_manager, path);
+  } else if (strcmp(cmd, "load") == 0 && argc == 2 && argv[1].a_type == A_SYMBOL) {
+    const char *name = argv[1].a_w.w_symbol->s_name;
+    char realdir[MAXPDSTRING], *realname = NULL, path[MAXPDSTRING];
+    int fd = canvas_open(x->f_canvas, name, "", realdir,
+                         &realname, MAXPDSTRING, 1);
+    if (fd < 0) {
+      pd_error(x, "faustgen2~: can't find %s", name);
+      return;
+    }
+    sys_close(fd);
+    snprintf(path, MAXPDSTRING, "%s/%s", realdir, realname);
+    faust_ui_manager_preset_load(x->f_ui_manager, path);
+  } else {
+    pd_error(x, "faustgen2~: wrong arguments to preset (expected store/recall/delete n, morph n m time, clear, save/load filename)");
+  }
+}
+
+// ag: ramp name value time: ramp a control to a new value over the given
+// time in msecs. In old-style polyphony all instances get the same ramp.
+static void faustgen_tilde_ramp(t_faustgen_tilde *x, t_symbol* s, int argc, t_atom* argv)
+{
+  t_symbol *name;
+  t_float f;
+  double ms;
+  if (!x->f_dsp_instance) return;
+  if (argc != 3 || argv[0].a_type != A_SYMBOL ||
+      argv[1].a_type != A_FLOAT || argv[2].a_type != A_FLOAT) {
+    pd_error(x, "faustgen2~: wrong arguments to ramp (expected name value time)");
+    return;
+  }
+  name = argv[0].a_w.w_symbol;
+  f = argv[1].a_w.w_float;
+  ms = argv[2].a_w.w_float;
+  if (faust_ui_manager_ramp(x->f_ui_manager, name, f, ms)) {
+    pd_error(x, "faustgen2~: parameter '%s' not defined", name->s_name);
+    return;
+  }
+  for (int i = 1; i < x->f_npoly; i++)
+    faust_ui_manager_ramp(x->f_uis[i], name, f, ms);
+}
+
+static void faustgen_tilde_persist(t_faustgen_tilde *x, t_symbol* s, int argc, t_atom* argv)
+{
+  if (argc <= 0) {
+    t_atom av;
+    t_outlet *out = faust_io_manager_get_extra_output(x->f_io_manager);
+    SETFLOAT(&av, x->f_persist);
+    outlet_anything(out, s, 1, &av);
+  } else if (argv[0].a_type == A_FLOAT) {
+    x->f_persist = argv[0].a_w.w_float != 0;
+  } else {
+    pd_error(x, "faustgen2~: wrong argument to persist (expected 0 or 1)");
+  }
+}
+
+// ag: Save the object along with its state, if persist is on. The object
+// itself is saved the same way as Pd does it; the state follows as '#A'
+// messages, which are delivered to the object right after it has been
+// recreated when the patch is loaded.
+static void faustgen_tilde_save(t_gobj *z, t_binbuf *b)
+{
+  t_faustgen_tilde *x = (t_faustgen_tilde *)z;
+  binbuf_addv(b, "ssii", gensym("#X"), gensym("obj"),
+              (int)x->f_obj.te_xpix, (int)x->f_obj.te_ypix);
+  binbuf_addbinbuf(b, x->f_obj.te_binbuf);
+  if (x->f_obj.te_width)
+    binbuf_addv(b, ",si", gensym("f"), (int)x->f_obj.te_width);
+  binbuf_addv(b, ";");
+  if (!x->f_persist) return;
+  if (x->f_dsp_instance) {
+    faust_ui_manager_save_state(x->f_ui_manager, b);
+  } else {
+    // we never got to apply the saved state, so keep it as is
+    int n = binbuf_getnatom(x->f_pending), i = 0;
+    t_atom *v = binbuf_getvec(x->f_pending);
+    while (i < n) {
+      int j = i;
+      while (j < n && v[j].a_type != A_SEMI) j++;
+      binbuf_addv(b, "s", gensym("#A"));
+      binbuf_add(b, j-i, v+i);
+      binbuf_addsemi(b);
+      i = j+1;
+    }
+  }
+}
+
+// ag: Without a dsp instance (e.g., if the dsp failed to compile when the
+// patch was loaded), the state messages are kept until the next successful
+// compilation, so that the state isn't lost.
+static void faustgen_tilde_keep_state(t_faustgen_tilde *x, t_symbol* s, int argc, t_atom* argv)
+{
+  binbuf_addv(x->f_pending, "s", s);
+  binbuf_add(x->f_pending, argc, argv);
+  binbuf_addsemi(x->f_pending);
+}
+
+static void faustgen_tilde_state(t_faustgen_tilde *x, t_symbol* s, int argc, t_atom* argv)
+{
+  // a saved state implies that we keep saving it
+  x->f_persist = true;
+  if (!x->f_dsp_instance) {
+    faustgen_tilde_keep_state(x, s, argc, argv);
+  } else if (!faust_ui_manager_load_state(x->f_ui_manager, argc, argv)) {
+    faustgen_tilde_sync_voices(x);
+  }
+}
+
+static void faustgen_tilde_statepreset(t_faustgen_tilde *x, t_symbol* s, int argc, t_atom* argv)
+{
+  if (!x->f_dsp_instance) {
+    faustgen_tilde_keep_state(x, s, argc, argv);
+  } else {
+    faust_ui_manager_load_preset(x->f_ui_manager, argc, argv);
+  }
+}
+
+// ag: Automation lane: the file is written or read ahead by a clock in the
+// message thread, the events themselves are processed in the perform routine.
+#define AUTO_POLL 50
+
+static void faustgen_tilde_auto_poll(t_faustgen_tilde *x)
+{
+  if (faust_ui_manager_auto_flush(x->f_ui_manager)) {
+    clock_delay(x->f_auto_clock, AUTO_POLL);
+  } else {
+    // playback has finished
+    t_outlet *out = faust_io_manager_get_extra_output(x->f_io_manager);
+    t_atom av;
+    SETSYMBOL(&av, gensym("stop"));
+    outlet_anything(out, gensym("automate"), 1, &av);
+  }
+}
+
+static void faustgen_tilde_automate(t_faustgen_tilde *x, t_symbol* s, int argc, t_atom* argv)
+{
+  static const char *state_s[] = { "stop", "record", "play" };
+  const char *cmd;
+  if (!x->f_dsp_instance) return;
+  if (argc <= 0) {
+    t_outlet *out = faust_io_manager_get_extra_output(x->f_io_manager);
+    t_atom av;
+    SETSYMBOL(&av, gensym(state_s[faust_ui_manager_auto_state(x->f_ui_manager)]));
+    outlet_anything(out, s, 1, &av);
+    return;
+  }
+  cmd = argv[0].a_type == A_SYMBOL ? argv[0].a_w.w_symbol->s_name : "";
+  if (strcmp(cmd, "stop") == 0 && argc == 1) {
+    clock_unset(x->f_auto_clock);
+    faust_ui_manager_auto_stop(x->f_ui_manager);
+  } else if (strcmp(cmd, "record") == 0 && argc == 2 && argv[1].a_type == A_SYMBOL) {
+    char path[MAXPDSTRING];
+    canvas_makefilename(x->f_canvas, argv[1].a_w.w_symbol->s_name,
+                        path, MAXPDSTRING);
+    if (!faust_ui_manager_auto_record(x->f_ui_manager, path))
+      clock_delay(x->f_auto_clock, AUTO_POLL);
+  } else if (strcmp(cmd, "play") == 0 && argc >= 2 && argc <= 3 &&
+             argv[1].a_type == A_SYMBOL &&
+             (argc == 2 || argv[2].a_type == A_FLOAT)) {
+    // optional second argument: loop flag
+    const char *name = argv[1].a_w.w_symbol->s_name;
+    char realdir[MAXPDSTRING], *realname = NULL, path[MAXPDSTRING];
+    int fd = canvas_open(x->f_canvas, name, "", realdir,
+                         &realname, MAXPDSTRING, 1);
+    if (fd < 0) {
+      pd_error(x, "faustgen2~: can't find %s", name);
+      return;
+    }
+    sys_close(fd);
+    snprintf(path, MAXPDSTRING, "%s/%s", realdir, realname);
+    if (!faust_ui_manager_auto_play(x->f_ui_manager, path,
+                                    argc > 2 && argv[2].a_w.w_float != 0))
+      clock_delay(x->f_auto_clock, AUTO_POLL);
+  } else {
+    pd_error(x, "faustgen2~: wrong arguments to automate (expected record filename, play filename [loop], stop)");
+  }
+}
+
 static void faustgen_tilde_gui(t_faustgen_tilde *x)
 {
   if(x->f_dsp_instance) {
-    faust_ui_manager_gui(x->f_ui_manager,
-                         x->f_unique_name, x->f_instance_name);
-    if (x->f_uis) {
-      // also install receivers on the other instances
-      for (int i = 1; i < x->f_npoly; i++)
-        faust_ui_manager_gui2(x->f_uis[i],
-                              x->f_unique_name, x->f_instance_name);
+    faustgen_tilde_make_gui(x, true);
+  }
+}
+
+static void faustgen_tilde_update_iolets(t_faustgen_tilde *x)
+{
+  if (x->f_dsp_instance) {
+    int dspstate = canvas_suspend_dsp();
+    faust_io_manager_init(x->f_io_manager,
+                          getNumInputsCDSPInstance(x->f_dsp_instance),
+                          getNumOutputsCDSPInstance(x->f_dsp_instance),
+                          faust_ui_manager_get_nsignal_inputs(x->f_ui_manager),
+                          faust_ui_manager_get_nsignal_outputs(x->f_ui_manager));
+    canvas_resume_dsp(dspstate);
+  }
+}
+
+static void faustgen_tilde_siginlets(t_faustgen_tilde *x, t_symbol* s, int argc, t_atom* argv)
+{
+  // set the controls to be driven by signal inlets (no arguments: none
+  // except those with [pd:signal] meta data), and update the inlets
+  faust_ui_manager_set_signal_inputs(x->f_ui_manager, argc, argv);
+  faustgen_tilde_update_iolets(x);
+}
+
+static void faustgen_tilde_sigoutlets(t_faustgen_tilde *x, t_symbol* s, int argc, t_atom* argv)
+{
+  // same for the passive controls to be output as signals
+  faust_ui_manager_set_signal_outputs(x->f_ui_manager, argc, argv);
+  faustgen_tilde_update_iolets(x);
+}
+
+static void faustgen_tilde_shm(t_faustgen_tilde *x, t_symbol* s, int argc, t_atom* argv)
+{
+  if (argc <= 0) {
+    t_atom av;
+    t_outlet *out = faust_io_manager_get_extra_output(x->f_io_manager);
+    t_symbol *name = faust_ui_manager_shm_name(x->f_ui_manager);
+    if (name)
+      SETSYMBOL(&av, name);
+    else
+      SETFLOAT(&av, 0);
+    outlet_anything(out, s, 1, &av);
+  } else if (argv[0].a_type == A_SYMBOL) {
+    faust_ui_manager_shm_open(x->f_ui_manager, argv[0].a_w.w_symbol);
+  } else if (argv[0].a_type == A_FLOAT && argv[0].a_w.w_float == 0) {
+    faust_ui_manager_shm_close(x->f_ui_manager);
+  } else if (argv[0].a_type == A_FLOAT) {
+    // use the instance name (or the object name if none)
+    t_symbol *name = x->f_instance_name?x->f_instance_name:x->f_unique_name;
+    if (name)
+      faust_ui_manager_shm_open(x->f_ui_manager, name);
+    else
+      pd_error(x, "faustgen2~: shm needs a name");
+  } else {
+    pd_error(x, "faustgen2~: wrong argument to shm (expected name, 0 or 1)");
+  }
+}
+
+static void faustgen_tilde_lazygui(t_faustgen_tilde *x, t_symbol* s, int argc, t_atom* argv)
+{
+  if (argc <= 0) {
+    t_atom av;
+    t_outlet *out = faust_io_manager_get_extra_output(x->f_io_manager);
+    SETFLOAT(&av, x->f_lazygui);
+    outlet_anything(out, s, 1, &av);
+  } else if (argv[0].a_type == A_FLOAT) {
+    x->f_lazygui = argv[0].a_w.w_float != 0;
+  } else {
+    pd_error(x, "faustgen2~: wrong argument to lazygui (expected 0 or 1)");
+  }
+}
+
+static void faustgen_tilde_guipage(t_faustgen_tilde *x, t_symbol* s, int argc, t_atom* argv)
+{
+  if (argc <= 0) {
+    t_atom av;
+    t_outlet *out = faust_io_manager_get_extra_output(x->f_io_manager);
+    SETFLOAT(&av, x->f_guipage);
+    outlet_anything(out, s, 1, &av);
+  } else if (argv[0].a_type == A_FLOAT && argv[0].a_w.w_float >= 0) {
+    // maximum number of controls per page (0 = no paging); this regenerates
+    // the GUI if it's already there
+    x->f_guipage = argv[0].a_w.w_float;
+    if (x->f_dsp_instance)
+      faustgen_tilde_make_gui(x, false);
+  } else {
+    pd_error(x, "faustgen2~: wrong argument to guipage (expected number of controls)");
+  }
+}
+
+static void faustgen_tilde_cpubudget(t_faustgen_tilde *x, t_symbol* s, int argc, t_atom* argv)
+{
+  if (argc <= 0) {
+    // output the current budget and the total load of all objects (percent)
+    t_atom av[2];
+    t_outlet *out = faust_io_manager_get_extra_output(x->f_io_manager);
+    double load = 0.0;
+    for (t_faustgen_tilde *y = voice_budget.objs; y; y = y->f_next)
+      load += y->f_load;
+    SETFLOAT(av, voice_budget.budget*100.0);
+    SETFLOAT(av+1, load*100.0);
+    outlet_anything(out, s, 2, av);
+  } else if (argv[0].a_type == A_FLOAT && argv[0].a_w.w_float >= 0) {
+    // this is a global setting which applies to all faustgen2~ objects, 0
+    // disables the budget
+    voice_budget.budget = argv[0].a_w.w_float/100.0;
+  } else {
+    pd_error(x, "faustgen2~: wrong argument to cpubudget (expected percentage)");
+  }
+}
+
+static void faustgen_tilde_rate(t_faustgen_tilde *x, t_symbol* s, int argc, t_atom* argv)
+{
+  int i;
+  for (i = 0; i < N_UPDATE; i++)
+    if (s == update_sym[i]) break;
+  if (i >= N_UPDATE) return; // shouldn't happen
+  if (argc <= 0) {
+    // output the current rate and delta
+    t_atom av[2];
+    t_outlet *out = faust_io_manager_get_extra_output(x->f_io_manager);
+    SETFLOAT(av, x->f_update_rate[i]);
+    SETFLOAT(av+1, x->f_update_delta[i]);
+    outlet_anything(out, s, 2, av);
+  } else if (argc <= 2 && argv[0].a_type == A_FLOAT && argv[0].a_w.w_float >= 0 &&
+             (argc == 1 || (argv[1].a_type == A_FLOAT &&
+                            argv[1].a_w.w_float >= 0 && argv[1].a_w.w_float <= 1))) {
+    // update interval in msecs (0 = each dsp cycle), optionally followed by
+    // the minimum change as a fraction of the control range
+    x->f_update_rate[i] = argv[0].a_w.w_float;
+    x->f_update_next[i] = 0;
+    if (argc > 1) {
+      x->f_update_delta[i] = argv[1].a_w.w_float;
+      faust_ui_manager_set_delta(x->f_ui_manager, x->f_update_delta[UPDATE_GUI],
+                                 x->f_update_delta[UPDATE_MIDI],
+                                 x->f_update_delta[UPDATE_OSC]);
     }
+  } else {
+    pd_error(x, "faustgen2~: wrong arguments to %s (expected msecs and optional delta)", s->s_name);
+  }
+}
+
+static void faustgen_tilde_maxvoices(t_faustgen_tilde *x, t_symbol* s, int argc, t_atom* argv)
+{
+  if (argc <= 0) {
+    // output the voice limit and the current number of voices
+    t_atom av[2];
+    t_outlet *out = faust_io_manager_get_extra_output(x->f_io_manager);
+    SETFLOAT(av, x->f_polylimit);
+    SETFLOAT(av+1, x->f_dsps ? x->f_npoly : 0);
+    outlet_anything(out, s, 2, av);
+  } else if (argv[0].a_type == A_FLOAT && argv[0].a_w.w_float >= 0 &&
+             (argc == 1 || (argc == 2 && argv[1].a_type == A_FLOAT))) {
+    // voice limit (0 = fixed number of voices), optionally followed by the
+    // idle time in msecs after which extra voices are removed again
+    x->f_polylimit = argv[0].a_w.w_float;
+    if (argc > 1 && argv[1].a_w.w_float > 0)
+      x->f_idle_time = argv[1].a_w.w_float;
+    if (x->f_dsps && x->f_npoly > x->f_minpoly)
+      clock_delay(x->f_shrink_clock, x->f_idle_time);
+  } else {
+    pd_error(x, "faustgen2~: wrong arguments to maxvoices (expected voice limit and optional idle time)");
   }
 }
 
@@ -1017,7 +1726,15 @@ static bool anything(t_faust_ui_manager *ui, t_symbol* s, int argc, t_atom* argv
       return false;
     }
     start = (int)argv[0].a_w.w_float;
-    for(i = 0; i < argc - 1; ++i)
+    // ag: Try the precomputed name family first. This only leaves us with
+    // the elements it couldn't handle, if any, which are processed (and
+    // reported) individually below.
+    i = faust_ui_manager_set_list(ui, s, start, argc - 1, argv + 1);
+    if(i < 0)
+    {
+        i = 0;
+    }
+    for(; i < argc - 1; ++i)
     {
       snprintf(name, MAXFAUSTSTRING, "%s%i", s->s_name, start+i);
       if(argv[i+1].a_type != A_FLOAT)
@@ -1044,6 +1761,17 @@ static bool midichan_check(t_channelmask msk, int chan)
 
 static void faustgen_tilde_anything(t_faustgen_tilde *x, t_symbol* s, int argc, t_atom* argv)
 {
+  if(s == gensym("sysex")) {
+    // SMMF sysex message; we only process MTS tuning messages here, anything
+    // else is silently ignored
+    if(x->f_dsps && !x->f_midiin) return;
+    if(x->f_dsps || x->f_dsp_instance) {
+      // real-time messages also retune the sounding notes
+      if(faust_ui_manager_mts(x->f_ui_manager, argc, argv) > 0 && x->f_dsps)
+        voices_retune(x);
+    }
+    return;
+  }
   if(x->f_dsps) {
     // multiple instances, old-style polyphony processing
     /* We only handle the note messages here, since we have to dispatch them
@@ -1109,6 +1837,116 @@ static void faustgen_tilde_anything(t_faustgen_tilde *x, t_symbol* s, int argc,
     pd_error(x, "faustgen2~: no dsp instance");
 }
 
+// ag: Output the passive controls, each kind at its own rate (see the
+// guirate, oscrate and midirate methods). XXXFIXME: If we have multiple dsps
+// (in old-style polyphony), we only output MIDI and OSC data from the first
+// instance here, to prevent duplicate messages. Maybe they should be
+// aggregated instead. (See the remarks in faustgen_tilde_anything.)
+static void faustgen_tilde_passive_out(t_faustgen_tilde *x)
+{
+    double const now = clock_getsystime();
+    if ((x->f_midiout || x->f_midirecv) && now >= x->f_update_next[UPDATE_MIDI]) {
+      t_outlet *out = x->f_midiout?faust_io_manager_get_extra_output(x->f_io_manager):NULL;
+      faust_ui_manager_midiout(x->f_ui_manager, x->f_midichan, x->f_midirecv, out);
+      if (x->f_update_rate[UPDATE_MIDI] > 0)
+        x->f_update_next[UPDATE_MIDI] = clock_getsystimeafter(x->f_update_rate[UPDATE_MIDI]);
+    }
+    if ((x->f_oscout || x->f_oscrecv) && now >= x->f_update_next[UPDATE_OSC]) {
+      t_outlet *out = x->f_oscout?faust_io_manager_get_extra_output(x->f_io_manager):NULL;
+      faust_ui_manager_oscout(x->f_ui_manager, x->f_oscrecv, out);
+      if (x->f_update_rate[UPDATE_OSC] > 0)
+        x->f_update_next[UPDATE_OSC] = clock_getsystimeafter(x->f_update_rate[UPDATE_OSC]);
+    }
+    if (now >= x->f_update_next[UPDATE_GUI]) {
+      if (x->f_instance_name && x->f_instance_name->s_thing)
+        faust_ui_manager_gui_update(x->f_ui_manager);
+      if (x->f_update_rate[UPDATE_GUI] > 0)
+        x->f_update_next[UPDATE_GUI] = clock_getsystimeafter(x->f_update_rate[UPDATE_GUI]);
+    }
+}
+
+// ag: Pick up control changes from the shared-memory block, if any.
+static void faustgen_tilde_shm_in(t_faustgen_tilde *x)
+{
+    if (faust_ui_manager_shm_poll(x->f_ui_manager) && x->f_uis) {
+      // also update the other instances
+      for (int i = 1; i < x->f_npoly; i++)
+        faust_ui_manager_shm_apply(x->f_uis[i], x->f_ui_manager);
+    }
+}
+
+// ag: Advance a preset morph in progress.
+static void faustgen_tilde_morph(t_faustgen_tilde *x, int nsamples)
+{
+    if (faust_ui_manager_preset_morph_tick(x->f_ui_manager, nsamples))
+      faustgen_tilde_sync_voices(x);
+}
+
+// ag: Advance the parameter ramps in progress.
+static void faustgen_tilde_ramps(t_faustgen_tilde *x, int nsamples)
+{
+    double const ms = x->f_sr > 0.0 ? nsamples*1000.0/x->f_sr : 0.0;
+    if (x->f_uis) {
+      // each instance has its own ramps
+      for (int i = 0; i < x->f_npoly; i++)
+        faust_ui_manager_ramp_tick(x->f_uis[i], ms);
+    } else {
+      faust_ui_manager_ramp_tick(x->f_ui_manager, ms);
+    }
+}
+
+// ag: Feed the control inlets into their zones.
+static void faustgen_tilde_signal_in(t_faustgen_tilde *x, int nsamples)
+{
+    size_t const nctls = faust_io_manager_get_ncontrols(x->f_io_manager);
+    if (nctls && nctls == faust_ui_manager_get_nsignal_inputs(x->f_ui_manager)) {
+      faust_ui_manager_signal_in(x->f_ui_manager,
+                                 faust_io_manager_get_control_signals(x->f_io_manager),
+                                 nsamples);
+      if (x->f_uis) {
+        // also update the other instances
+        for (int i = 1; i < x->f_npoly; i++)
+          faust_ui_manager_signal_apply(x->f_uis[i], x->f_ui_manager);
+      }
+    }
+}
+
+// ag: Output the passive controls on the control outlets.
+static void faustgen_tilde_signal_out(t_faustgen_tilde *x, int nsamples)
+{
+    size_t const nctls = faust_io_manager_get_ncontrol_outputs(x->f_io_manager);
+    if (nctls && nctls == faust_ui_manager_get_nsignal_outputs(x->f_ui_manager)) {
+      faust_ui_manager_signal_out(x->f_ui_manager,
+                                  faust_io_manager_get_control_output_signals(x->f_io_manager),
+                                  nsamples);
+    }
+}
+
+// ag: Compute a dsp block. During automation playback, the block is split
+// at the times of the automation events, each of which is applied to the
+// given ui manager right before the sample it refers to.
+static void faustgen_tilde_compute(t_faustgen_tilde *x, llvm_dsp *dsp, t_faust_ui_manager *ui,
+                                   int nsamples, int ninputs, int noutputs,
+                                   void **sigs, size_t size)
+{
+    void **seg = x->f_signal_segment;
+    int pos = 0;
+    if (!seg || faust_ui_manager_auto_next(x->f_ui_manager, 0, nsamples) >= nsamples) {
+      // no events in this block, except maybe at the start
+      faust_ui_manager_auto_apply(ui, x->f_ui_manager, 0, nsamples);
+      computeCDSPInstance(dsp, nsamples, (FAUSTFLOAT**)sigs, (FAUSTFLOAT**)(sigs+ninputs));
+      return;
+    }
+    while (pos < nsamples) {
+      int const next = faust_ui_manager_auto_next(x->f_ui_manager, pos, nsamples);
+      faust_ui_manager_auto_apply(ui, x->f_ui_manager, pos, next);
+      for (int i = 0; i < ninputs + noutputs; i++)
+        seg[i] = (char*)sigs[i] + pos*size;
+      computeCDSPInstance(dsp, next-pos, (FAUSTFLOAT**)seg, (FAUSTFLOAT**)(seg+ninputs));
+      pos = next;
+    }
+}
+
 static t_int *faustgen_tilde_perform_single(t_int *w)
 {
     int i, j;
@@ -1135,8 +1973,15 @@ static t_int *faustgen_tilde_perform_single(t_int *w)
           }
         }
       }
+      faustgen_tilde_signal_out(x, nsamples);
+      x->f_load = 0.0;
       return (w+9);
     }
+    faustgen_tilde_shm_in(x);
+    faustgen_tilde_morph(x, nsamples);
+    faustgen_tilde_ramps(x, nsamples);
+    faustgen_tilde_signal_in(x, nsamples);
+    double const start = sys_getrealtime();
     for(i = 0; i < ninputs; ++i)
     {
         for(j = 0; j < nsamples; ++j)
@@ -1144,44 +1989,63 @@ static t_int *faustgen_tilde_perform_single(t_int *w)
             faustsigs[i][j] = (FAUSTFLOAT)realinputs[i][j];
         }
     }
-    computeCDSPInstance(dsp, nsamples, (FAUSTFLOAT**)faustsigs, (FAUSTFLOAT**)(faustsigs+ninputs));
-    for(i = 0; i < noutputs; ++i)
-    {
+    if (x->f_dsps) {
+      // sum up the outputs from all dsp instances, skipping dormant voices
+      bool const budget = voice_budget.budget > 0.0 && x->f_npoly > 1;
+      int nvoices = 0;
+      for(i = 0; i < noutputs; ++i)
+      {
         for(j = 0; j < nsamples; ++j)
         {
-            realoutputs[i][j] = (t_sample)faustsigs[ninputs+i][j];
+          realoutputs[i][j] = 0.0;
         }
-    }
-    if (x->f_dsps) {
-      // sum up the outputs from all dsp instances
-      for (int k = 1; k < x->f_npoly; k++) {
-        computeCDSPInstance(x->f_dsps[k], nsamples, (FAUSTFLOAT**)faustsigs, (FAUSTFLOAT**)(faustsigs+ninputs));
+      }
+      for (int k = 0; k < x->f_npoly; k++) {
+        t_faust_voice *v = x->f_voices+k;
+        double level = 0.0;
+        if (budget && v->dormant) {
+          // keep up with the automation
+          faust_ui_manager_auto_apply(x->f_uis[k], x->f_ui_manager, 0, nsamples);
+          continue;
+        }
+        faustgen_tilde_compute(x, x->f_dsps[k], x->f_uis[k], nsamples, ninputs, noutputs,
+                               (void**)faustsigs, sizeof(**faustsigs));
         for(i = 0; i < noutputs; ++i)
         {
           for(j = 0; j < nsamples; ++j)
           {
-            realoutputs[i][j] += (t_sample)faustsigs[ninputs+i][j];
+            double const y = faustsigs[ninputs+i][j];
+            realoutputs[i][j] += (t_sample)y;
+            if (fabs(y) > level) level = fabs(y);
           }
         }
+        v->level = level;
+        // a released voice which has fallen silent goes to sleep
+        if (budget && !v->active && level < VOICE_SILENCE) v->dormant = true;
+        nvoices++;
       }
-    }
-    // XXXFIXME: If we have multiple dsps (in old-style polyphony), we only
-    // output MIDI and OSC data from the first instance here, to prevent
-    // duplicate messages. Maybe they should be aggregated instead. (See the
-    // remarks in faustgen_tilde_anything.)
-    if (x->f_midiout || x->f_midirecv) {
-      t_outlet *out = x->f_midiout?faust_io_manager_get_extra_output(x->f_io_manager):NULL;
-      faust_ui_manager_midiout(x->f_ui_manager, x->f_midichan, x->f_midirecv, out);
-    }
-    if (clock_getsystime() >= x->f_next_tick) {
-      if (x->f_oscout || x->f_oscrecv) {
-        t_outlet *out = x->f_oscout?faust_io_manager_get_extra_output(x->f_io_manager):NULL;
-        faust_ui_manager_oscout(x->f_ui_manager, x->f_oscrecv, out);
+      if (nvoices > 0 && x->f_sr > 0.0) {
+        double const load = (sys_getrealtime()-start)*x->f_sr/nsamples/nvoices;
+        x->f_voice_load += VOICE_LOAD_SMOOTH*(load-x->f_voice_load);
+      }
+    } else {
+      faustgen_tilde_compute(x, dsp, x->f_ui_manager, nsamples, ninputs, noutputs,
+                             (void**)faustsigs, sizeof(**faustsigs));
+      for(i = 0; i < noutputs; ++i)
+      {
+          for(j = 0; j < nsamples; ++j)
+          {
+              realoutputs[i][j] = (t_sample)faustsigs[ninputs+i][j];
+          }
       }
-      if (x->f_instance_name && x->f_instance_name->s_thing)
-        faust_ui_manager_gui_update(x->f_ui_manager);
-      x->f_next_tick = clock_getsystimeafter(gui_update_time);
     }
+    if (x->f_sr > 0.0) {
+      double const load = (sys_getrealtime()-start)*x->f_sr/nsamples;
+      x->f_load += VOICE_LOAD_SMOOTH*(load-x->f_load);
+    }
+    faust_ui_manager_auto_tick(x->f_ui_manager, nsamples, x->f_sr);
+    faustgen_tilde_signal_out(x, nsamples);
+    faustgen_tilde_passive_out(x);
     return (w+9);
 }
 
@@ -1211,8 +2075,15 @@ static t_int *faustgen_tilde_perform_double(t_int *w)
           }
         }
       }
+      faustgen_tilde_signal_out(x, nsamples);
+      x->f_load = 0.0;
       return (w+9);
     }
+    faustgen_tilde_shm_in(x);
+    faustgen_tilde_morph(x, nsamples);
+    faustgen_tilde_ramps(x, nsamples);
+    faustgen_tilde_signal_in(x, nsamples);
+    double const start = sys_getrealtime();
     for(i = 0; i < ninputs; ++i)
     {
         for(j = 0; j < nsamples; ++j)
@@ -1220,44 +2091,63 @@ static t_int *faustgen_tilde_perform_double(t_int *w)
             faustsigs[i][j] = (FAUSTFLOAT)realinputs[i][j];
         }
     }
-    computeCDSPInstance(dsp, nsamples, (FAUSTFLOAT**)faustsigs, (FAUSTFLOAT**)(faustsigs+ninputs));
-    for(i = 0; i < noutputs; ++i)
-    {
+    if (x->f_dsps) {
+      // sum up the outputs from all dsp instances, skipping dormant voices
+      bool const budget = voice_budget.budget > 0.0 && x->f_npoly > 1;
+      int nvoices = 0;
+      for(i = 0; i < noutputs; ++i)
+      {
         for(j = 0; j < nsamples; ++j)
         {
-            realoutputs[i][j] = (t_sample)faustsigs[ninputs+i][j];
+          realoutputs[i][j] = 0.0;
         }
-    }
-    if (x->f_dsps) {
-      // sum up the outputs from all dsp instances
-      for (int k = 1; k < x->f_npoly; k++) {
-        computeCDSPInstance(x->f_dsps[k], nsamples, (FAUSTFLOAT**)faustsigs, (FAUSTFLOAT**)(faustsigs+ninputs));
+      }
+      for (int k = 0; k < x->f_npoly; k++) {
+        t_faust_voice *v = x->f_voices+k;
+        double level = 0.0;
+        if (budget && v->dormant) {
+          // keep up with the automation
+          faust_ui_manager_auto_apply(x->f_uis[k], x->f_ui_manager, 0, nsamples);
+          continue;
+        }
+        faustgen_tilde_compute(x, x->f_dsps[k], x->f_uis[k], nsamples, ninputs, noutputs,
+                               (void**)faustsigs, sizeof(**faustsigs));
         for(i = 0; i < noutputs; ++i)
         {
           for(j = 0; j < nsamples; ++j)
           {
-            realoutputs[i][j] += (t_sample)faustsigs[ninputs+i][j];
+            double const y = faustsigs[ninputs+i][j];
+            realoutputs[i][j] += (t_sample)y;
+            if (fabs(y) > level) level = fabs(y);
           }
         }
+        v->level = level;
+        // a released voice which has fallen silent goes to sleep
+        if (budget && !v->active && level < VOICE_SILENCE) v->dormant = true;
+        nvoices++;
       }
-    }
-    // XXXFIXME: If we have multiple dsps (in old-style polyphony), we only
-    // output MIDI and OSC data from the first instance here, to prevent
-    // duplicate messages. Maybe they should be aggregated instead. (See the
-    // remarks in faustgen_tilde_anything.)
-    if (x->f_midiout || x->f_midirecv) {
-      t_outlet *out = x->f_midiout?faust_io_manager_get_extra_output(x->f_io_manager):NULL;
-      faust_ui_manager_midiout(x->f_ui_manager, x->f_midichan, x->f_midirecv, out);
-    }
-    if (clock_getsystime() >= x->f_next_tick) {
-      if (x->f_oscout || x->f_oscrecv) {
-        t_outlet *out = x->f_oscout?faust_io_manager_get_extra_output(x->f_io_manager):NULL;
-        faust_ui_manager_oscout(x->f_ui_manager, x->f_oscrecv, out);
+      if (nvoices > 0 && x->f_sr > 0.0) {
+        double const load = (sys_getrealtime()-start)*x->f_sr/nsamples/nvoices;
+        x->f_voice_load += VOICE_LOAD_SMOOTH*(load-x->f_voice_load);
+      }
+    } else {
+      faustgen_tilde_compute(x, dsp, x->f_ui_manager, nsamples, ninputs, noutputs,
+                             (void**)faustsigs, sizeof(**faustsigs));
+      for(i = 0; i < noutputs; ++i)
+      {
+          for(j = 0; j < nsamples; ++j)
+          {
+              realoutputs[i][j] = (t_sample)faustsigs[ninputs+i][j];
+          }
       }
-      if (x->f_instance_name && x->f_instance_name->s_thing)
-        faust_ui_manager_gui_update(x->f_ui_manager);
-      x->f_next_tick = clock_getsystimeafter(gui_update_time);
     }
+    if (x->f_sr > 0.0) {
+      double const load = (sys_getrealtime()-start)*x->f_sr/nsamples;
+      x->f_load += VOICE_LOAD_SMOOTH*(load-x->f_load);
+    }
+    faust_ui_manager_auto_tick(x->f_ui_manager, nsamples, x->f_sr);
+    faustgen_tilde_signal_out(x, nsamples);
+    faustgen_tilde_passive_out(x);
     return (w+9);
 }
 
@@ -1284,6 +2174,11 @@ static void faustgen_tilde_free_signals(t_faustgen_tilde *x)
         free(x->f_signal_matrix_double);
     }
     x->f_signal_matrix_double = NULL;
+    if(x->f_signal_segment)
+    {
+        free(x->f_signal_segment);
+    }
+    x->f_signal_segment = NULL;
 }
 
 static void faustgen_tilde_alloc_signals_single(t_faustgen_tilde *x, size_t const ninputs, size_t const noutputs, size_t const nsamples)
@@ -1306,6 +2201,12 @@ static void faustgen_tilde_alloc_signals_single(t_faustgen_tilde *x, size_t cons
     {
         x->f_signal_matrix_single[i] = (x->f_signal_aligned_single+(i*nsamples));
     }
+    x->f_signal_segment = (void **)malloc((ninputs + noutputs) * sizeof(void *));
+    if(!x->f_signal_segment)
+    {
+        pd_error(x, "memory allocation failed");
+        return;
+    }
 }
 
 static void faustgen_tilde_alloc_signals_double(t_faustgen_tilde *x, size_t const ninputs, size_t const noutputs, size_t const nsamples)
@@ -1328,10 +2229,17 @@ static void faustgen_tilde_alloc_signals_double(t_faustgen_tilde *x, size_t cons
     {
         x->f_signal_matrix_double[i] = (x->f_signal_aligned_double+(i*nsamples));
     }
+    x->f_signal_segment = (void **)malloc((ninputs + noutputs) * sizeof(void *));
+    if(!x->f_signal_segment)
+    {
+        pd_error(x, "memory allocation failed");
+        return;
+    }
 }
 
 static void faustgen_tilde_dsp(t_faustgen_tilde *x, t_signal **sp)
 {
+    x->f_sr = sp[0]->s_sr;
     if(x->f_dsp_instance)
     {
         char initialized = getSampleRateCDSPInstance(x->f_dsp_instance) != sp[0]->s_sr;
@@ -1416,6 +2324,9 @@ static t_symbol *make_unique_name(t_symbol *dsp_name)
 
 static void faustgen_tilde_free(t_faustgen_tilde *x)
 {
+    t_faustgen_tilde **y = &voice_budget.objs;
+    while (*y && *y != x) y = &(*y)->f_next;
+    if (*y) *y = x->f_next;
     if (x->f_unique_name) {
       pd_unbind(&x->f_obj.ob_pd, gensym("faustgen2~"));
       pd_unbind(&x->f_obj.ob_pd, x->f_dsp_name);
@@ -1427,8 +2338,15 @@ static void faustgen_tilde_free(t_faustgen_tilde *x)
                   make_instance_name(x->f_dsp_name, x->f_instance_name));
       }
     }
+    if (gensym("#A")->s_thing == &x->f_obj.ob_pd)
+      pd_unbind(&x->f_obj.ob_pd, gensym("#A"));
     faustgen_tilde_delete_instance(x);
     faustgen_tilde_delete_factory(x);
+    clock_free(x->f_grow_clock);
+    clock_free(x->f_shrink_clock);
+    clock_free(x->f_gui_clock);
+    clock_free(x->f_auto_clock);
+    binbuf_free(x->f_pending);
     if (x->f_uis) {
       for (int i = 0; i < x->f_npoly; i++)
         faust_ui_manager_free(x->f_uis[i]);
@@ -1472,8 +2390,9 @@ static void *faustgen_tilde_new(t_symbol* s, int argc, t_atom* argv)
         x->f_signal_aligned_single = NULL;
         x->f_signal_matrix_double  = NULL;
         x->f_signal_aligned_double = NULL;
+        x->f_signal_segment        = NULL;
         
-        x->f_ui_manager     = faust_ui_manager_new((t_object *)x);
+        x->f_ui_manager     = faust_ui_manager_new((t_object *)x, x->f_canvas);
         x->f_io_manager     = faust_io_manager_new((t_object *)x, x->f_canvas);
         x->f_opt_manager    = faust_opt_manager_new((t_object *)x, x->f_canvas);
         x->f_dsp_name       = is_loader_obj ? real_dsp_name(s) :
@@ -1487,8 +2406,33 @@ static void *faustgen_tilde_new(t_symbol* s, int argc, t_atom* argv)
         x->f_activesym = gensym("active");
         x->f_active = true;
         x->f_isdouble = false;
-        x->f_npoly = 0;
+        x->f_setzone = setfaustflt_float;
+        x->f_update_rate[UPDATE_GUI] = x->f_update_rate[UPDATE_OSC] = gui_update_time;
+        x->f_update_rate[UPDATE_MIDI] = 0;
+        for (int i = 0; i < N_UPDATE; i++) {
+          x->f_update_delta[i] = 0;
+          x->f_update_next[i] = 0;
+        }
+        x->f_npoly = x->f_minpoly = x->f_maxpoly = x->f_polylimit = 0;
+        x->f_idle_time = 5000;
+        x->f_grow_clock = clock_new(x, (t_method)faustgen_tilde_grow_voices);
+        x->f_shrink_clock = clock_new(x, (t_method)faustgen_tilde_shrink_voices);
+        x->f_persist = false;
+        x->f_pending = binbuf_new();
+        x->f_auto_clock = clock_new(x, (t_method)faustgen_tilde_auto_poll);
+        x->f_lazygui = false;
+        x->f_guipage = 0;
+        x->f_gui_clock = clock_new(x, (t_method)faustgen_tilde_gui_tick);
         x->f_voices = NULL;
+        x->f_sr = 0.0;
+        x->f_load = x->f_voice_load = 0.0;
+        x->f_next = NULL;
+        // shm= creation flag, the block is opened after compilation
+        t_symbol *shm_name = NULL;
+        // siginlet= and sigoutlet= creation flags, collected before
+        // compilation
+        t_atom *sigin_names = NULL, *sigout_names = NULL;
+        int n_sigin_names = 0, n_sigout_names = 0;
         // parse the remaining creation arguments
         if (argc > 0 && argv) {
           int n_num = 0;
@@ -1534,6 +2478,84 @@ static void *faustgen_tilde_new(t_symbol* s, int argc, t_atom* argv)
                   x->f_oscout = num != 0;
                 else
                   x->f_oscrecv = gensym(arg);
+              } else if (strncmp(argv->a_w.w_symbol->s_name, "maxvoices=",
+                                 strlen("maxvoices=")) == 0) {
+                // maxvoices flag; an integer which sets the voice limit of
+                // the elastic voice pool (0 = fixed number of voices)
+                const char *arg = argv->a_w.w_symbol->s_name+strlen("maxvoices=");
+                unsigned num;
+                if (sscanf(arg, "%u", &num) == 1)
+                  x->f_polylimit = num;
+                else
+                  pd_error(x, "faustgen2~: bad maxvoices value '%s'", arg);
+              } else if (strncmp(argv->a_w.w_symbol->s_name, "lazygui=",
+                                 strlen("lazygui=")) == 0) {
+                // lazygui flag; this can be empty (turning on lazy GUI
+                // generation) or an integer (turning it off or on)
+                const char *arg = argv->a_w.w_symbol->s_name+strlen("lazygui=");
+                unsigned num;
+                if (!*arg)
+                  x->f_lazygui = true;
+                else if (sscanf(arg, "%u", &num) == 1)
+                  x->f_lazygui = num != 0;
+                else
+                  pd_error(x, "faustgen2~: bad lazygui value '%s'", arg);
+              } else if (strncmp(argv->a_w.w_symbol->s_name, "siginlet=",
+                                 strlen("siginlet=")) == 0) {
+                // siginlet flag; name of a control to be driven by a signal
+                // inlet, may be repeated
+                const char *arg = argv->a_w.w_symbol->s_name+strlen("siginlet=");
+                t_atom *names = *arg ?
+                  resizebytes(sigin_names, n_sigin_names*sizeof(t_atom),
+                              (n_sigin_names+1)*sizeof(t_atom)) : NULL;
+                if (names) {
+                  sigin_names = names;
+                  SETSYMBOL(sigin_names+n_sigin_names, gensym(arg));
+                  n_sigin_names++;
+                } else
+                  pd_error(x, "faustgen2~: bad siginlet value '%s'", arg);
+              } else if (strncmp(argv->a_w.w_symbol->s_name, "sigoutlet=",
+                                 strlen("sigoutlet=")) == 0) {
+                // sigoutlet flag; name of a passive control to be output as
+                // a signal, may be repeated
+                const char *arg = argv->a_w.w_symbol->s_name+strlen("sigoutlet=");
+                t_atom *names = *arg ?
+                  resizebytes(sigout_names, n_sigout_names*sizeof(t_atom),
+                              (n_sigout_names+1)*sizeof(t_atom)) : NULL;
+                if (names) {
+                  sigout_names = names;
+                  SETSYMBOL(sigout_names+n_sigout_names, gensym(arg));
+                  n_sigout_names++;
+                } else
+                  pd_error(x, "faustgen2~: bad sigoutlet value '%s'", arg);
+              } else if (strncmp(argv->a_w.w_symbol->s_name, "shm=",
+                                 strlen("shm=")) == 0) {
+                // shm flag; open a shared-memory parameter block with the
+                // given name (the instance name if empty), see the shm method
+                const char *arg = argv->a_w.w_symbol->s_name+strlen("shm=");
+                shm_name = *arg ? gensym(arg) : &s_;
+              } else if (strncmp(argv->a_w.w_symbol->s_name, "persist=",
+                                 strlen("persist=")) == 0) {
+                // persist flag; this can be empty (turning on state saving)
+                // or an integer (turning it off or on)
+                const char *arg = argv->a_w.w_symbol->s_name+strlen("persist=");
+                unsigned num;
+                if (!*arg)
+                  x->f_persist = true;
+                else if (sscanf(arg, "%u", &num) == 1)
+                  x->f_persist = num != 0;
+                else
+                  pd_error(x, "faustgen2~: bad persist value '%s'", arg);
+              } else if (strncmp(argv->a_w.w_symbol->s_name, "guipage=",
+                                 strlen("guipage=")) == 0) {
+                // guipage flag; the maximum number of controls per page in
+                // the GUI (0 = no paging)
+                const char *arg = argv->a_w.w_symbol->s_name+strlen("guipage=");
+                unsigned num;
+                if (sscanf(arg, "%u", &num) == 1)
+                  x->f_guipage = num;
+                else
+                  pd_error(x, "faustgen2~: bad guipage value '%s'", arg);
               } else {
                 // the instance name is used as an additional identifier of
                 // the dsp in the receivers (see below); the plan is to also
@@ -1545,6 +2567,14 @@ static void *faustgen_tilde_new(t_symbol* s, int argc, t_atom* argv)
               break;
           }
         }
+        if (sigin_names) {
+          faust_ui_manager_set_signal_inputs(x->f_ui_manager, n_sigin_names, sigin_names);
+          freebytes(sigin_names, n_sigin_names*sizeof(t_atom));
+        }
+        if (sigout_names) {
+          faust_ui_manager_set_signal_outputs(x->f_ui_manager, n_sigout_names, sigout_names);
+          freebytes(sigout_names, n_sigout_names*sizeof(t_atom));
+        }
         // any remaining creation arguments are for the compiler
         faust_opt_manager_parse_compile_options(x->f_opt_manager, argc, argv);
         faustgen_tilde_compile(x);
@@ -1568,18 +2598,25 @@ static void *faustgen_tilde_new(t_symbol* s, int argc, t_atom* argv)
           pd_bind(&x->f_obj.ob_pd,
                   make_instance_name(x->f_dsp_name, x->f_instance_name));
           // create the Pd GUI
-          faust_ui_manager_gui(x->f_ui_manager,
-                               x->f_unique_name, x->f_instance_name);
-          if (x->f_uis) {
-            // also install receivers on the other instances
-            for (int i = 1; i < x->f_npoly; i++)
-              faust_ui_manager_gui2(x->f_uis[i],
-                                    x->f_unique_name, x->f_instance_name);
-          }
+          faustgen_tilde_make_gui(x, false);
+        }
+        // ag: Bind #A so that we receive the saved state which follows the
+        // object in the patch file (see faustgen_tilde_save). As with Pd's
+        // arrays, #A is bashed to refer to the most recently created object.
+        gensym("#A")->s_thing = 0;
+        pd_bind(&x->f_obj.ob_pd, gensym("#A"));
+        if (shm_name) {
+          if (shm_name == &s_)
+            shm_name = x->f_instance_name?x->f_instance_name:x->f_unique_name;
+          faust_ui_manager_shm_open(x->f_ui_manager, shm_name);
         }
+        // register with the cpu budget
+        x->f_next = voice_budget.objs;
+        voice_budget.objs = x;
         // ag: kick off GUI updates every gui_update_time msecs (we do this
         // even if the GUI wasn't created yet, in case it may created later)
-        x->f_next_tick = clock_getsystimeafter(gui_update_time);
+        x->f_update_next[UPDATE_GUI] = x->f_update_next[UPDATE_OSC] =
+          clock_getsystimeafter(gui_update_time);
     }
     return x;
 }
@@ -1624,6 +2661,23 @@ static int faustgen_loader(t_symbol *name)
     class_addmethod(c,  (t_method)faustgen_tilde_oscout,            gensym("oscout"),           A_GIMME, 0);
     class_addmethod(c,  (t_method)faustgen_tilde_midiout,           gensym("midiout"),          A_GIMME, 0);
     class_addmethod(c,  (t_method)faustgen_tilde_midichan,          gensym("midichan"),         A_GIMME, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_cpubudget,         gensym("cpubudget"),        A_GIMME, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_maxvoices,         gensym("maxvoices"),        A_GIMME, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_rate,              gensym("guirate"),          A_GIMME, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_rate,              gensym("oscrate"),          A_GIMME, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_rate,              gensym("midirate"),         A_GIMME, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_lazygui,           gensym("lazygui"),          A_GIMME, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_guipage,           gensym("guipage"),          A_GIMME, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_shm,               gensym("shm"),              A_GIMME, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_preset,            gensym("preset"),           A_GIMME, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_ramp,              gensym("ramp"),             A_GIMME, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_persist,           gensym("persist"),          A_GIMME, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_automate,          gensym("automate"),         A_GIMME, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_state,             gensym("state"),            A_GIMME, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_statepreset,       gensym("statepreset"),      A_GIMME, 0);
+    class_setsavefn(c, faustgen_tilde_save);
+    class_addmethod(c,  (t_method)faustgen_tilde_siginlets,         gensym("siginlets"),        A_GIMME, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_sigoutlets,        gensym("sigoutlets"),       A_GIMME, 0);
     class_addmethod(c,  (t_method)faustgen_tilde_menu_open,         gensym("click"),            A_NULL, 0);
     class_addmethod(c,  (t_method)faustgen_tilde_menu_open,         gensym("menu-open"),        A_NULL, 0);
     class_addbang(c, (t_method)faustgen_tilde_allnotesoff);
@@ -1684,6 +2738,8 @@ void faustgen2_tilde_setup(void)
   else
     // since Pd>=0.47, Pd tries the loaders for each path
     sys_register_loader((loader_t)faustgen_loader_pathwise);
+  for (int i = 0; i < N_UPDATE; i++)
+    update_sym[i] = gensym(update_sym_s[i]);
   // register the faustgen2~ class
   t_class* c = class_new(gensym("faustgen2~"),
                          (t_newmethod)faustgen_tilde_new,
@@ -1703,6 +2759,23 @@ void faustgen2_tilde_setup(void)
     class_addmethod(c,  (t_method)faustgen_tilde_oscout,            gensym("oscout"),           A_GIMME, 0);
     class_addmethod(c,  (t_method)faustgen_tilde_midiout,           gensym("midiout"),          A_GIMME, 0);
     class_addmethod(c,  (t_method)faustgen_tilde_midichan,          gensym("midichan"),         A_GIMME, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_cpubudget,         gensym("cpubudget"),        A_GIMME, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_maxvoices,         gensym("maxvoices"),        A_GIMME, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_rate,              gensym("guirate"),          A_GIMME, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_rate,              gensym("oscrate"),          A_GIMME, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_rate,              gensym("midirate"),         A_GIMME, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_lazygui,           gensym("lazygui"),          A_GIMME, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_guipage,           gensym("guipage"),          A_GIMME, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_shm,               gensym("shm"),              A_GIMME, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_preset,            gensym("preset"),           A_GIMME, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_ramp,              gensym("ramp"),             A_GIMME, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_persist,           gensym("persist"),          A_GIMME, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_automate,          gensym("automate"),         A_GIMME, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_state,             gensym("state"),            A_GIMME, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_statepreset,       gensym("statepreset"),      A_GIMME, 0);
+    class_setsavefn(c, faustgen_tilde_save);
+    class_addmethod(c,  (t_method)faustgen_tilde_siginlets,         gensym("siginlets"),        A_GIMME, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_sigoutlets,        gensym("sigoutlets"),       A_GIMME, 0);
 #if 0
     class_addmethod(c,  (t_method)faustgen_tilde_open_texteditor,   gensym("click"),            A_NULL, 0);
 #endif
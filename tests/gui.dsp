@@ -0,0 +1,11 @@
+declare name 		"Dummy";
+declare version 	"1.0";
+declare author 		"Heu... me...";
+
+import("stdfaust.lib");
+
+process = _ <: par(i, 32, _ * hslider("gain%i [unit:linear]", 0.02, 0, 1, 0.001)) :> _ : level
+with
+{
+  level = _ <: attach(_, an.amp_follower(0.1) : hbargraph("level", 0, 1));
+};
@@ -0,0 +1,15 @@
+declare name 		"Dummy";
+declare version 	"1.0";
+declare author 		"Heu... me...";
+
+import("stdfaust.lib");
+
+// MIDI bindings with logarithmic, exponential and linear mappings
+process = os.osc(freq*ba.semi2ratio(bend)) : fi.lowpass(2, cutoff) : *(gain)
+with
+{
+  freq = hslider("freq [midi:ctrl 1] [scale:log] [unit:Hz]", 440, 50, 5000, 1);
+  cutoff = hslider("cutoff [midi:ctrl 2] [scale:exp] [unit:Hz]", 1000, 100, 10000, 1);
+  gain = hslider("gain [midi:ctrl 7] [unit:linear]", 0.2, 0, 1, 0.001);
+  bend = hslider("bend [midi:pitchwheel] [unit:semitones]", 0, -2, 2, 0.01);
+};
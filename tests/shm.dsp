@@ -0,0 +1,11 @@
+declare name 		"Dummy";
+declare version 	"1.0";
+declare author 		"Heu... me...";
+
+
+process = _ * gain * (1 - mute)
+with
+{
+  gain = hslider("gain [unit:linear]", 0.2, 0 , 1, 0.001);
+  mute = checkbox("mute");
+};
@@ -0,0 +1,49 @@
+#!/usr/bin/env python3
+# Set a control in the shared-memory parameter block of a faustgen2~ object
+# (see the shm message and shm.pd). Linux only, the block is looked up in
+# /dev/shm.
+#
+# usage: shm_write.py name [control value]
+#
+# Without a control and value, the controls in the block are listed.
+
+import mmap, os, struct, sys
+
+HEADER = struct.Struct("=8sIIII")         # magic, version, n, seq, layout
+CONTROL = struct.Struct("=64sii3d")       # name, type, pad, min, max, init
+TYPES = ["button", "toggle", "number", "bargraph"]
+
+def main(argv):
+    if len(argv) not in (2, 4):
+        sys.exit("usage: %s name [control value]" % argv[0])
+    path = "/dev/shm/faustgen2-%s" % argv[1].replace("/", "_")
+    fd = os.open(path, os.O_RDWR)
+    m = mmap.mmap(fd, 0)
+    os.close(fd)
+    magic, version, n, seq, layout = HEADER.unpack_from(m, 0)
+    if magic != b"FAUSTSHM" or version != 1:
+        sys.exit("%s: not a faustgen2~ parameter block" % path)
+    values = HEADER.size + n*CONTROL.size
+    controls = []
+    for i in range(n):
+        name, type, pad, min, max, init = CONTROL.unpack_from(m, HEADER.size + i*CONTROL.size)
+        name = name.split(b"\0", 1)[0].decode()
+        controls.append(name)
+        if len(argv) == 2:
+            value, = struct.unpack_from("=d", m, values + 8*i)
+            print("%s (%s) %g [%g, %g]" % (name, TYPES[type], value, min, max))
+    if len(argv) == 2:
+        return
+    # match the long name, or its last component
+    k = [i for i, name in enumerate(controls)
+         if name == argv[2] or name.split("/")[-1] == argv[2]]
+    if not k:
+        sys.exit("%s: no such control" % argv[2])
+    # seqlock protocol: make seq odd, write the value, make it even again
+    struct.pack_into("=I", m, 16, seq+1)
+    struct.pack_into("=d", m, values + 8*k[0], float(argv[3]))
+    struct.pack_into("=I", m, 16, seq+2)
+    m.close()
+
+if __name__ == "__main__":
+    main(sys.argv)
@@ -0,0 +1,13 @@
+declare name 		"Dummy";
+declare version 	"1.0";
+declare author 		"Heu... me...";
+
+import("stdfaust.lib");
+
+process = fi.lowpass(2, cutoff) * gain : level
+with
+{
+  cutoff = hslider("cutoff [pd:signal]", 1000, 50, 5000, 1);
+  gain = hslider("gain [unit:linear]", 0.2, 0 , 1, 0.001);
+  level = _ <: attach(_, an.amp_follower(0.1) : hbargraph("level [pd:signal]", 0, 1));
+};
@@ -0,0 +1,16 @@
+declare name 		"Dummy";
+declare version 	"1.0";
+declare author 		"Heu... me...";
+
+import("stdfaust.lib");
+
+// The sound file is looked up relative to the patch and on the Pd search path.
+process = 0, index : sound : !, !, _ * gain
+with
+{
+  sound = soundfile("sound [url:{'../external/examples/sine.wav'}]", 1);
+  play = button("play");
+  gain = hslider("gain [unit:linear]", 0.5, 0 , 1, 0.001);
+  // restart at each press of the play button
+  index = ba.countup(ma.SR*10, play > play');
+};
@@ -0,0 +1,14 @@
+declare name 		"Dummy";
+declare version 	"1.0";
+declare author 		"Heu... me...";
+
+import("stdfaust.lib");
+
+// voice controls
+freq(k) = nentry("/freq%k[voice:freq]", 440, 20, 20000, 1);
+gain(k) = nentry("/gain%k[voice:gain]", 0.3, 0, 10, 0.01);
+gate(k) = button("/gate%k[voice:gate]");
+
+n = 4;
+
+process = sum(i, n, os.osc(freq(i))*(gate(i):en.adsr(0.01, 0.3, 0.5, 0.2))*gain(i)) * 0.2;
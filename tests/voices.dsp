@@ -0,0 +1,12 @@
+declare name 		"Dummy";
+declare version 	"1.0";
+declare author 		"Heu... me...";
+declare options		"[midi:on][nvoices:2]";
+
+import("stdfaust.lib");
+
+freq = nentry("freq", 440, 20, 20000, 1);
+gain = nentry("gain", 0.3, 0, 10, 0.01);
+gate = button("gate");
+
+process = os.sawtooth(freq)*(gate:en.adsr(0.01, 0.3, 0.5, 0.2))*gain * 0.1;